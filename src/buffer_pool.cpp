@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "buffer_pool.hpp"
+
+#include <boost/thread/once.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#if defined(_MSC_VER)
+	#define WEBSOCKETPP_THREAD_LOCAL __declspec(thread)
+#else
+	#define WEBSOCKETPP_THREAD_LOCAL __thread
+#endif
+
+using websocketpp::buffer_pool;
+using websocketpp::shared_buffer;
+using websocketpp::shared_buffer_ptr;
+
+const size_t buffer_pool::MIN_CLASS_SIZE;
+const size_t buffer_pool::MAX_CLASS_SIZE;
+const size_t buffer_pool::NUM_CLASSES;
+const size_t buffer_pool::CLASS_BYTES_LIMIT;
+const size_t buffer_pool::MAX_FREE_SHARED_BUFFERS;
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2097152; // 2MB
+
+bool g_huge_pages = false;
+
+// The thread_specific_ptr owns each thread's pool and deletes it when the
+// thread exits. It is never destroyed itself so buffers released during
+// static destruction still find a pool. Lookups through it are slow, so the
+// pool is also cached in a plain thread local pointer.
+boost::thread_specific_ptr<buffer_pool>* g_pools = NULL;
+boost::once_flag g_pools_once = BOOST_ONCE_INIT;
+WEBSOCKETPP_THREAD_LOCAL buffer_pool* t_pool = NULL;
+
+// Called once, by whichever thread asks for a pool first.
+void create_pools() {
+	g_pools = new boost::thread_specific_ptr<buffer_pool>();
+}
+
+size_t class_size(size_t c) {
+	return buffer_pool::MIN_CLASS_SIZE << (2*c);
+}
+
+// Smallest class that can hold size bytes. NUM_CLASSES if none can.
+size_t class_for_size(size_t size) {
+	size_t c = 0;
+	while (c < buffer_pool::NUM_CLASSES && class_size(c) < size) {
+		c++;
+	}
+	return c;
+}
+
+// Largest class that a buffer with this capacity can serve. NUM_CLASSES if
+// it is too small for any of them.
+size_t class_for_capacity(size_t capacity) {
+	if (capacity < buffer_pool::MIN_CLASS_SIZE) {
+		return buffer_pool::NUM_CLASSES;
+	}
+	size_t c = 0;
+	while (c+1 < buffer_pool::NUM_CLASSES && class_size(c+1) <= capacity) {
+		c++;
+	}
+	return c;
+}
+
+size_t class_limit(size_t c) {
+	size_t n = buffer_pool::CLASS_BYTES_LIMIT / class_size(c);
+	return n > 0 ? n : 1;
+}
+
+void advise_huge_pages(std::vector<unsigned char>& buf) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (!g_huge_pages || buf.capacity() < HUGE_PAGE_SIZE) {
+		return;
+	}
+	
+	// only whole huge pages inside the allocation can be advised
+	uintptr_t begin = reinterpret_cast<uintptr_t>(&buf[0]);
+	uintptr_t end = begin + buf.capacity();
+	begin = (begin + HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+	end &= ~(HUGE_PAGE_SIZE-1);
+	
+	if (end > begin) {
+		madvise(reinterpret_cast<void*>(begin),end-begin,MADV_HUGEPAGE);
+	}
+#endif
+}
+
+}
+
+void websocketpp::intrusive_ptr_add_ref(shared_buffer* b) {
+	++b->m_refs;
+}
+
+void websocketpp::intrusive_ptr_release(shared_buffer* b) {
+	if (--b->m_refs == 0) {
+		buffer_pool::local().recycle(b);
+	}
+}
+
+buffer_pool& buffer_pool::local() {
+	if (t_pool == NULL) {
+		boost::call_once(g_pools_once,&create_pools);
+		t_pool = new buffer_pool();
+		g_pools->reset(t_pool);
+	}
+	return *t_pool;
+}
+
+void buffer_pool::set_huge_pages(bool enabled) {
+	g_huge_pages = enabled;
+}
+
+buffer_pool::buffer_pool() {
+	m_counters.hits = 0;
+	m_counters.misses = 0;
+	m_counters.returns = 0;
+	m_counters.discards = 0;
+}
+
+buffer_pool::~buffer_pool() {
+	for (size_t i = 0; i < m_free_shared.size(); i++) {
+		delete m_free_shared[i];
+	}
+	if (t_pool == this) {
+		t_pool = NULL;
+	}
+}
+
+void buffer_pool::acquire(std::vector<unsigned char>& buf,size_t size) {
+	if (buf.capacity() >= size) {
+		buf.clear();
+		return;
+	}
+	
+	release(buf);
+	
+	size_t c = class_for_size(size);
+	
+	if (c == NUM_CLASSES) {
+		// too big to pool
+		m_counters.misses++;
+		buf.reserve(size);
+		advise_huge_pages(buf);
+		return;
+	}
+	
+	if (!m_free[c].empty()) {
+		m_counters.hits++;
+		buf.swap(m_free[c].back());
+		m_free[c].pop_back();
+		return;
+	}
+	
+	m_counters.misses++;
+	buf.reserve(class_size(c));
+	advise_huge_pages(buf);
+}
+
+void buffer_pool::reserve(std::vector<unsigned char>& buf,size_t size) {
+	if (buf.capacity() >= size) {
+		return;
+	}
+	
+	// Grow at least geometrically, as pool classes do, so that appending to
+	// a buffer larger than MAX_CLASS_SIZE doesn't copy it every time.
+	std::vector<unsigned char> tmp;
+	acquire(tmp,std::max(size,2*buf.capacity()));
+	tmp.assign(buf.begin(),buf.end());
+	buf.swap(tmp);
+	release(tmp);
+}
+
+void buffer_pool::release(std::vector<unsigned char>& buf) {
+	if (buf.capacity() == 0) {
+		return;
+	}
+	
+	size_t c = class_for_capacity(buf.capacity());
+	
+	if (c == NUM_CLASSES || buf.capacity() > MAX_CLASS_SIZE || 
+		m_free[c].size() >= class_limit(c)) 
+	{
+		m_counters.discards++;
+		std::vector<unsigned char>().swap(buf);
+		return;
+	}
+	
+	m_counters.returns++;
+	buf.clear();
+	m_free[c].push_back(std::vector<unsigned char>());
+	m_free[c].back().swap(buf);
+}
+
+shared_buffer_ptr buffer_pool::make_shared_buffer(size_t size) {
+	shared_buffer* b;
+	
+	if (m_free_shared.empty()) {
+		m_counters.misses++;
+		b = new shared_buffer();
+	} else {
+		b = m_free_shared.back();
+		m_free_shared.pop_back();
+	}
+	
+	acquire(b->m_data,size);
+	return shared_buffer_ptr(b);
+}
+
+const buffer_pool::counters& buffer_pool::get_counters() const {
+	return m_counters;
+}
+
+void buffer_pool::recycle(shared_buffer* b) {
+	release(b->m_data);
+	
+	if (m_free_shared.size() < MAX_FREE_SHARED_BUFFERS) {
+		m_free_shared.push_back(b);
+	} else {
+		delete b;
+	}
+}
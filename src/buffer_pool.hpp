@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <boost/detail/atomic_count.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+class buffer_pool;
+
+// A byte vector with an intrusive reference count for data that is shared
+// between a session and its pending asynchronous writes. Create them with
+// buffer_pool::make_shared_buffer. When the last reference is dropped the
+// buffer and its storage go back to the pool of the thread that dropped it.
+class shared_buffer : boost::noncopyable {
+public:
+	std::vector<unsigned char>& get_data() {
+		return m_data;
+	}
+	const std::vector<unsigned char>& get_data() const {
+		return m_data;
+	}
+private:
+	friend class buffer_pool;
+	friend void intrusive_ptr_add_ref(shared_buffer* b);
+	friend void intrusive_ptr_release(shared_buffer* b);
+	
+	shared_buffer() : m_refs(0) {}
+	
+	boost::detail::atomic_count	m_refs;
+	std::vector<unsigned char>	m_data;
+};
+
+typedef boost::intrusive_ptr<shared_buffer> shared_buffer_ptr;
+
+void intrusive_ptr_add_ref(shared_buffer* b);
+void intrusive_ptr_release(shared_buffer* b);
+
+// Per thread cache of byte vector storage in power of four size classes from
+// 256 bytes to 16MB. Frames, message assembly and outgoing data take their
+// storage from the pool of the thread they run on and give it back when they
+// are done with it, so a session that has warmed up sends and receives 
+// without calling malloc.
+//
+// Storage moves in and out of the pool by swapping vectors, so the vectors
+// the rest of the library works with stay plain std::vector<unsigned char>.
+class buffer_pool : boost::noncopyable {
+public:
+	struct counters {
+		uint64_t	hits;		// requests served from the pool
+		uint64_t	misses;		// allocations the pool had to make
+		uint64_t	returns;	// buffers taken back for reuse
+		uint64_t	discards;	// buffers freed rather than kept
+	};
+	
+	static const size_t MIN_CLASS_SIZE = 256;
+	static const size_t MAX_CLASS_SIZE = 16777216; // 16MB
+	static const size_t NUM_CLASSES = 9;
+	
+	// most bytes kept in each size class, at least one buffer is always kept
+	static const size_t CLASS_BYTES_LIMIT = 4194304; // 4MB
+	static const size_t MAX_FREE_SHARED_BUFFERS = 1024;
+	
+	// The pool for the calling thread. It is created on first use.
+	static buffer_pool& local();
+	
+	// Ask the kernel to back buffers of 2MB and up with transparent huge 
+	// pages. Only has an effect on Linux. Off by default. Applies to all
+	// threads and should be set before any buffers are allocated.
+	static void set_huge_pages(bool enabled);
+	
+	~buffer_pool();
+	
+	// Leaves buf empty with room for at least size bytes. If buf does not
+	// already have the room its storage is replaced with pooled storage.
+	void acquire(std::vector<unsigned char>& buf,size_t size);
+	
+	// Like buf.reserve(size), but the new storage comes from the pool and the
+	// old storage goes back to it. Storage at least doubles when it grows. 
+	// The contents of buf are kept.
+	void reserve(std::vector<unsigned char>& buf,size_t size);
+	
+	// Takes back the storage of buf, leaving it empty with no capacity.
+	void release(std::vector<unsigned char>& buf);
+	
+	// Returns an empty shared buffer with room for at least size bytes.
+	shared_buffer_ptr make_shared_buffer(size_t size);
+	
+	const counters& get_counters() const;
+private:
+	friend void intrusive_ptr_release(shared_buffer* b);
+	
+	buffer_pool();
+	
+	void recycle(shared_buffer* b);
+	
+	std::vector< std::vector<unsigned char> >	m_free[NUM_CLASSES];
+	std::vector<shared_buffer*>					m_free_shared;
+	counters									m_counters;
+};
+
+}
+
+#endif // BUFFER_POOL_HPP
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "http_head.hpp"
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using websocketpp::http_head;
+
+const size_t http_head::MAX_SIZE;
+const size_t http_head::MAX_HEADERS;
+const size_t http_head::INITIAL_SIZE;
+const size_t http_head::TABLE_SIZE;
+const size_t http_head::INDEX_SIZE;
+
+namespace {
+
+inline unsigned char fold(char c) {
+	return (c >= 'A' && c <= 'Z') ? c+('a'-'A') : c;
+}
+
+bool iequal(const char* a,const char* b,size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (fold(a[i]) != fold(b[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// FNV-1a of the case folded name
+size_t hash_name(const char* name,size_t len) {
+	uint32_t h = 2166136261u;
+	
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ fold(name[i])) * 16777619u;
+	}
+	return h;
+}
+
+bool is_space(char c) {
+	return c == ' ' || c == '\t';
+}
+
+}
+
+bool http_head::span::iequals(const char* s) const {
+	return std::strlen(s) == size && iequal(data,s,size);
+}
+
+http_head::http_head() 
+ : m_state(READING),
+   m_end(0),
+   m_line(0),
+   m_head_end(0),
+   m_headers(0),
+   m_started(false)
+{
+	m_start_line.off = m_start_line.len = 0;
+	
+	for (size_t i = 0; i < 3; i++) {
+		m_parts[i].off = m_parts[i].len = 0;
+	}
+}
+
+unsigned char* http_head::prepare() {
+	if (m_arena.empty()) {
+		// the table has to start out zeroed, which resize does
+		buffer_pool::local().acquire(m_arena,INDEX_SIZE+INITIAL_SIZE);
+		m_arena.resize(INDEX_SIZE+INITIAL_SIZE);
+	}
+	
+	size_t room = m_arena.size()-INDEX_SIZE;
+	
+	if (room-m_end < INITIAL_SIZE/4 && room < MAX_SIZE) {
+		size_t n = INDEX_SIZE+std::min(2*room,MAX_SIZE);
+		buffer_pool::local().reserve(m_arena,n);
+		m_arena.resize(n);
+	}
+	
+	return &m_arena[INDEX_SIZE+m_end];
+}
+
+size_t http_head::space() const {
+	if (m_arena.empty()) {
+		return 0;
+	}
+	return std::min(m_arena.size()-INDEX_SIZE,MAX_SIZE)-m_end;
+}
+
+http_head::state http_head::commit(size_t n) {
+	if (m_state != READING) {
+		return m_state;
+	}
+	
+	n = std::min(n,space());
+	
+	const char* t = text();
+	const char* p = t+m_end;
+	const char* end = p+n;
+	m_end += n;
+	
+	while (m_state == READING) {
+		const char* nl = static_cast<const char*>(std::memchr(p,'\n',end-p));
+		
+		if (nl == NULL) {
+			break;
+		}
+		
+		parse_line(m_line,nl-t);
+		m_line = nl-t+1;
+		p = nl+1;
+	}
+	
+	if (m_state == DONE) {
+		m_head_end = m_line;
+		join_repeated();
+	} else if (m_state == READING && m_end == MAX_SIZE) {
+		m_state = FAILED;
+	}
+	
+	return m_state;
+}
+
+http_head::state http_head::get_state() const {
+	return m_state;
+}
+
+http_head::span http_head::start_line() const {
+	return get_span(m_start_line);
+}
+
+http_head::span http_head::start_part(size_t i) const {
+	return i < 3 ? get_span(m_parts[i]) : span();
+}
+
+http_head::span http_head::header(const char* name) const {
+	const field* f = find(name,std::strlen(name));
+	return f == NULL ? span() : get_span(f->value);
+}
+
+http_head::span http_head::header(const std::string& name) const {
+	const field* f = find(name.data(),name.size());
+	return f == NULL ? span() : get_span(f->value);
+}
+
+http_head::span http_head::raw() const {
+	size_t n = (m_state == DONE ? m_head_end : m_end);
+	return n == 0 ? span() : span(text(),n);
+}
+
+http_head::span http_head::excess() const {
+	if (m_state != DONE || m_end == m_head_end) {
+		return span();
+	}
+	return span(text()+m_head_end,m_end-m_head_end);
+}
+
+void http_head::clear() {
+	buffer_pool::local().release(m_arena);
+	*this = http_head();
+}
+
+http_head::field* http_head::fields() {
+	return reinterpret_cast<field*>(&m_arena[0]);
+}
+
+const http_head::field* http_head::fields() const {
+	return reinterpret_cast<const field*>(&m_arena[0]);
+}
+
+uint8_t* http_head::table() {
+	return &m_arena[MAX_HEADERS*sizeof(field)];
+}
+
+const uint8_t* http_head::table() const {
+	return &m_arena[MAX_HEADERS*sizeof(field)];
+}
+
+const char* http_head::text() const {
+	return reinterpret_cast<const char*>(&m_arena[INDEX_SIZE]);
+}
+
+http_head::span http_head::get_span(const range& r) const {
+	return r.len == 0 ? span() : span(text()+r.off,r.len);
+}
+
+// Parses the line from begin up to the newline at end.
+void http_head::parse_line(size_t begin,size_t end) {
+	const char* t = text();
+	
+	if (end > begin && t[end-1] == '\r') {
+		end--;
+	}
+	
+	if (end == begin) {
+		// blank lines before the start line are ignored
+		if (m_started) {
+			m_state = DONE;
+		}
+		return;
+	}
+	
+	range r;
+	
+	if (!m_started) {
+		m_started = true;
+		m_start_line.off = begin;
+		m_start_line.len = end-begin;
+		
+		for (size_t i = 0; i < 3; i++) {
+			const char* sp = NULL;
+			
+			if (i < 2) {
+				sp = static_cast<const char*>(std::memchr(t+begin,' ',end-begin));
+			}
+			
+			size_t stop = (sp == NULL ? end : sp-t);
+			m_parts[i].off = begin;
+			m_parts[i].len = stop-begin;
+			begin = std::min(stop+1,end);
+		}
+		return;
+	}
+	
+	// lines that aren't headers are ignored
+	const char* colon = static_cast<const char*>(std::memchr(t+begin,':',end-begin));
+	
+	if (colon == NULL || colon == t+begin) {
+		return;
+	}
+	
+	range name;
+	name.off = begin;
+	name.len = colon-t-begin;
+	
+	size_t v = colon-t+1;
+	
+	while (v < end && is_space(t[v])) {
+		v++;
+	}
+	while (end > v && is_space(t[end-1])) {
+		end--;
+	}
+	
+	r.off = v;
+	r.len = end-v;
+	add_header(name,r);
+}
+
+void http_head::add_header(const range& name,const range& value) {
+	if (m_headers == MAX_HEADERS) {
+		m_state = FAILED;
+		return;
+	}
+	
+	field* f = fields();
+	const char* t = text();
+	uint8_t* slots = table();
+	
+	f[m_headers].name = name;
+	f[m_headers].value = value;
+	f[m_headers].next = 0;
+	
+	size_t h = hash_name(t+name.off,name.len) & (TABLE_SIZE-1);
+	
+	for (; slots[h] != 0; h = (h+1) & (TABLE_SIZE-1)) {
+		field* g = &f[slots[h]-1];
+		
+		if (g->name.len != name.len || 
+		    !iequal(t+g->name.off,t+name.off,name.len)) 
+		{
+			continue;
+		}
+		
+		// a repeat, chained to the first so it can be joined at the end
+		while (g->next != 0) {
+			g = &f[g->next-1];
+		}
+		g->next = m_headers+1;
+		m_headers++;
+		return;
+	}
+	
+	slots[h] = m_headers+1;
+	m_headers++;
+}
+
+// Replaces the value of each repeated header with all of its values joined,
+// written to the back of the arena.
+void http_head::join_repeated() {
+	for (size_t i = 0; i < m_headers; i++) {
+		if (fields()[i].next == 0) {
+			continue;
+		}
+		
+		size_t len = 0;
+		
+		for (size_t j = i+1; j != 0; j = fields()[j-1].next) {
+			len += fields()[j-1].value.len + (j == i+1 ? 0 : 2);
+		}
+		
+		size_t at = m_arena.size();
+		buffer_pool::local().reserve(m_arena,at+len);
+		m_arena.resize(at+len);
+		
+		field* f = fields();
+		unsigned char* out = &m_arena[at];
+		
+		for (size_t j = i+1; j != 0; ) {
+			field& g = f[j-1];
+			
+			if (j != i+1) {
+				*out++ = ',';
+				*out++ = ' ';
+			}
+			
+			std::memcpy(out,text()+g.value.off,g.value.len);
+			out += g.value.len;
+			
+			// the repeats are done with
+			j = g.next;
+			
+			if (&g != &f[i]) {
+				g.next = 0;
+			}
+		}
+		
+		f[i].next = 0;
+		f[i].value.off = at-INDEX_SIZE;
+		f[i].value.len = len;
+	}
+}
+
+const http_head::field* http_head::find(const char* name,size_t len) const {
+	if (m_arena.empty()) {
+		return NULL;
+	}
+	
+	const field* f = fields();
+	const char* t = text();
+	const uint8_t* slots = table();
+	
+	size_t h = hash_name(name,len) & (TABLE_SIZE-1);
+	
+	for (; slots[h] != 0; h = (h+1) & (TABLE_SIZE-1)) {
+		const field& g = f[slots[h]-1];
+		
+		if (g.name.len == len && iequal(t+g.name.off,name,len)) {
+			return &g;
+		}
+	}
+	return NULL;
+}
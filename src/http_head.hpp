@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_HEAD_HPP
+#define HTTP_HEAD_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Incremental parser for the head of an HTTP request or response, that is
+// the start line and headers up to the blank line.
+//
+// Bytes are read straight into a single arena, taken from the thread's 
+// buffer pool, and parsed in place as they arrive. The start line and the
+// headers are recorded as offsets into the arena, and headers are found 
+// through a small open addressed table keyed on their case folded names,
+// so a handshake is parsed without any allocation besides the arena. The
+// table lives at the front of the arena.
+//
+// Values of a header that appears more than once are joined with ", ", as
+// if they had been sent as one list.
+class http_head {
+public:
+	// largest head accepted
+	static const size_t MAX_SIZE = 16384;
+	static const size_t MAX_HEADERS = 64;
+	
+	// room for the first read. The arena grows as needed up to MAX_SIZE.
+	static const size_t INITIAL_SIZE = 1024;
+	
+	enum state {
+		READING,
+		DONE,
+		FAILED
+	};
+	
+	// Bytes in the arena. Valid until the next call to commit or clear.
+	struct span {
+		span() : data(NULL), size(0) {}
+		span(const char* d,size_t n) : data(d), size(n) {}
+		
+		bool empty() const {
+			return size == 0;
+		}
+		
+		std::string str() const {
+			return size == 0 ? std::string() : std::string(data,size);
+		}
+		
+		// case insensitive comparison with s
+		bool iequals(const char* s) const;
+		
+		const char*	data;
+		size_t		size;
+	};
+	
+	http_head();
+	
+	// Returns free space for the next read. The pointer is valid until the
+	// next call to commit.
+	unsigned char* prepare();
+	size_t space() const;
+	
+	// Parses n bytes written to the space returned by prepare. A head that 
+	// doesn't end within MAX_SIZE bytes, or has more than MAX_HEADERS 
+	// headers, fails.
+	state commit(size_t n);
+	state get_state() const;
+	
+	// The start line, and its three parts. For a request those are the
+	// method, target and version, for a response the version, status code
+	// and reason. The last part runs to the end of the line.
+	span start_line() const;
+	span start_part(size_t i) const;
+	
+	// value of the header with this name, in any case. Empty if there is
+	// none.
+	span header(const char* name) const;
+	span header(const std::string& name) const;
+	
+	// the whole head, including the blank line
+	span raw() const;
+	
+	// bytes read past the end of the head
+	span excess() const;
+	
+	// Gives the arena back to the buffer pool and starts over.
+	void clear();
+private:
+	// offset and length of a run of the text after the index
+	struct range {
+		uint16_t	off;
+		uint16_t	len;
+	};
+	
+	struct field {
+		range	name;
+		range	value;
+		
+		// index+1 of the next field with the same name, or 0
+		uint8_t	next;
+	};
+	
+	static const size_t TABLE_SIZE = 128;
+	static const size_t INDEX_SIZE = MAX_HEADERS*sizeof(field)+TABLE_SIZE;
+	
+	field* fields();
+	const field* fields() const;
+	uint8_t* table();
+	const uint8_t* table() const;
+	const char* text() const;
+	span get_span(const range& r) const;
+	
+	void parse_line(size_t begin,size_t end);
+	void add_header(const range& name,const range& value);
+	void join_repeated();
+	const field* find(const char* name,size_t len) const;
+	
+	std::vector<unsigned char>	m_arena;
+	state						m_state;
+	size_t						m_end;
+	size_t						m_line;
+	size_t						m_head_end;
+	range						m_start_line;
+	range						m_parts[3];
+	size_t						m_headers;
+	bool						m_started;
+};
+
+}
+
+#endif // HTTP_HEAD_HPP
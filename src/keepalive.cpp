@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "keepalive.hpp"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+using websocketpp::keepalive_scheduler;
+using websocketpp::timing_wheel;
+
+boost::asio::io_service::id keepalive_scheduler::id;
+
+const uint32_t keepalive_scheduler::CHECK_MS;
+
+namespace {
+
+uint64_t to_ticks(uint32_t ms) {
+	return std::max<uint64_t>(1,(ms + timing_wheel::TICK_MS - 1)/
+	                            timing_wheel::TICK_MS);
+}
+
+}
+
+keepalive_scheduler::entry::entry(boost::asio::io_service& io_service)
+ : m_scheduler(boost::asio::use_service<keepalive_scheduler>(io_service)),
+   m_group(NULL),
+   m_tick(0),
+   m_waiting(false) {}
+
+keepalive_scheduler::entry::~entry() {
+	stop();
+}
+
+void keepalive_scheduler::entry::start(uint32_t interval_ms,
+                                       uint32_t timeout_ms,
+                                       const boost::function<void()>& on_idle,
+                                       const boost::function<void()>& on_timeout)
+{
+	stop();
+	m_on_idle = on_idle;
+	m_on_timeout = on_timeout;
+	m_scheduler.add(*this,interval_ms,timeout_ms);
+}
+
+void keepalive_scheduler::entry::stop() {
+	if (m_group != NULL) {
+		m_scheduler.remove(*this);
+	}
+}
+
+void keepalive_scheduler::entry::touch() {
+	if (m_group != NULL) {
+		m_scheduler.touch(*this);
+	}
+}
+
+keepalive_scheduler::keepalive_scheduler(boost::asio::io_service& io_service)
+ : boost::asio::io_service::service(io_service),
+   m_wheel(boost::asio::use_service<timing_wheel>(io_service)),
+   m_check_timer(io_service),
+   m_size(0) {}
+
+keepalive_scheduler::~keepalive_scheduler() {
+	for (group_map::iterator it = m_groups.begin(); it != m_groups.end(); ++it) {
+		delete it->second;
+	}
+}
+
+size_t keepalive_scheduler::size() const {
+	return m_size;
+}
+
+void keepalive_scheduler::add(entry& e,uint32_t interval_ms,
+                              uint32_t timeout_ms) {
+	std::pair<uint64_t,uint64_t> key(to_ticks(interval_ms),to_ticks(timeout_ms));
+	group_map::iterator it = m_groups.find(key);
+	
+	if (it == m_groups.end()) {
+		group* g = new group();
+		g->interval = key.first;
+		g->timeout = key.second;
+		g->idle.init();
+		g->waiting.init();
+		it = m_groups.insert(std::make_pair(key,g)).first;
+	}
+	
+	// the wheel only keeps time while it has a timer
+	if (!m_check_timer.pending()) {
+		m_check_timer.start(
+			CHECK_MS,
+			boost::bind(&keepalive_scheduler::handle_check,this)
+		);
+	}
+	
+	e.m_group = it->second;
+	e.m_tick = m_wheel.get_tick();
+	e.m_waiting = false;
+	e.m_group->idle.push_back(&e);
+	m_size++;
+}
+
+void keepalive_scheduler::remove(entry& e) {
+	e.unlink();
+	e.m_group = NULL;
+	m_size--;
+	
+	if (m_size == 0) {
+		m_check_timer.cancel();
+	}
+}
+
+void keepalive_scheduler::touch(entry& e) {
+	uint64_t now = m_wheel.get_tick();
+	
+	// Entries touched in the same tick are in order already.
+	if (e.m_tick == now && !e.m_waiting) {
+		return;
+	}
+	
+	e.unlink();
+	e.m_tick = now;
+	e.m_waiting = false;
+	e.m_group->idle.push_back(&e);
+}
+
+void keepalive_scheduler::requeue(timing_wheel::link& due,
+                                  timing_wheel::link& list) {
+	while (!due.empty()) {
+		timing_wheel::link* l = due.next;
+		l->unlink();
+		list.push_back(l);
+	}
+}
+
+void keepalive_scheduler::check() {
+	uint64_t now = m_wheel.get_tick();
+	
+	for (group_map::iterator it = m_groups.begin(); it != m_groups.end(); ++it) {
+		group& g = *it->second;
+		timing_wheel::link due;
+		due.init();
+		
+		// Handlers may start, stop and touch any entry, so the entries that
+		// are due are taken off the lists before any is called.
+		while (!g.waiting.empty()) {
+			entry* e = static_cast<entry*>(g.waiting.next);
+			if (e->m_tick + g.timeout > now) {
+				break;
+			}
+			e->unlink();
+			due.push_back(e);
+		}
+		
+		try {
+			while (!due.empty()) {
+				entry* e = static_cast<entry*>(due.next);
+				remove(*e);
+				
+				// e may be gone once the handler returns
+				boost::function<void()> handler = e->m_on_timeout;
+				handler();
+			}
+		} catch (...) {
+			requeue(due,g.waiting);
+			throw;
+		}
+		
+		while (!g.idle.empty()) {
+			entry* e = static_cast<entry*>(g.idle.next);
+			if (e->m_tick + g.interval > now) {
+				break;
+			}
+			e->unlink();
+			due.push_back(e);
+		}
+		
+		try {
+			while (!due.empty()) {
+				entry* e = static_cast<entry*>(due.next);
+				e->unlink();
+				e->m_tick = now;
+				e->m_waiting = true;
+				g.waiting.push_back(e);
+				
+				boost::function<void()> handler = e->m_on_idle;
+				handler();
+			}
+		} catch (...) {
+			requeue(due,g.idle);
+			throw;
+		}
+	}
+}
+
+void keepalive_scheduler::handle_check() {
+	if (m_size == 0) {
+		return;
+	}
+	
+	m_check_timer.start(
+		CHECK_MS,
+		boost::bind(&keepalive_scheduler::handle_check,this)
+	);
+	check();
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef KEEPALIVE_HPP
+#define KEEPALIVE_HPP
+
+#include "timing_wheel.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <map>
+#include <utility>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Finds the sessions on an io_service that have gone quiet, so that they can
+// be pinged, and those that then stay quiet, so that they can be dropped.
+//
+// Sessions with the same interval and timeout are kept in two lists, one in
+// order of when they last received anything and one in order of when they
+// were pinged. Receiving moves a session to the end of the first list. Once
+// every CHECK_MS a single timer on the io_service's timing wheel takes the 
+// whole run of sessions at the front of each list that are due, so the 
+// pings of a check go out together and nothing is done for sessions that
+// aren't due.
+//
+// There is one scheduler per io_service, created on first use. It must only
+// be used from a thread running the io_service.
+class keepalive_scheduler : public boost::asio::io_service::service {
+public:
+	static boost::asio::io_service::id id;
+	
+	static const uint32_t CHECK_MS = 1000;
+	
+	struct group;
+	
+	// A session's place in the scheduler.
+	class entry : private timing_wheel::link, boost::noncopyable {
+	public:
+		explicit entry(boost::asio::io_service& io_service);
+		~entry();
+		
+		// Calls on_idle once nothing has been received for interval_ms and
+		// on_timeout if still nothing has been received timeout_ms after 
+		// that. Either may be up to CHECK_MS late. The entry is stopped 
+		// before on_timeout is called.
+		void start(uint32_t interval_ms,uint32_t timeout_ms,
+		           const boost::function<void()>& on_idle,
+		           const boost::function<void()>& on_timeout);
+		void stop();
+		
+		// Notes that something was received.
+		void touch();
+		
+		bool active() const {
+			return m_group != NULL;
+		}
+	private:
+		friend class keepalive_scheduler;
+		
+		keepalive_scheduler&	m_scheduler;
+		group*					m_group;
+		
+		// tick of the last touch, or of the ping once waiting is set
+		uint64_t				m_tick;
+		bool					m_waiting;
+		
+		boost::function<void()>	m_on_idle;
+		boost::function<void()>	m_on_timeout;
+	};
+	
+	struct group {
+		uint64_t			interval;	// ticks
+		uint64_t			timeout;	// ticks
+		timing_wheel::link	idle;
+		timing_wheel::link	waiting;
+	};
+	
+	explicit keepalive_scheduler(boost::asio::io_service& io_service);
+	~keepalive_scheduler();
+	
+	// number of sessions watched
+	size_t size() const;
+	
+	// Checks every session now rather than at the next CHECK_MS. For tests.
+	void check();
+private:
+	typedef std::map< std::pair<uint64_t,uint64_t>,group* > group_map;
+	
+	void add(entry& e,uint32_t interval_ms,uint32_t timeout_ms);
+	void remove(entry& e);
+	void touch(entry& e);
+	
+	// puts entries that were due back on list after a handler threw
+	void requeue(timing_wheel::link& due,timing_wheel::link& list);
+	
+	void handle_check();
+	
+	timing_wheel&		m_wheel;
+	timing_wheel::timer	m_check_timer;
+	group_map			m_groups;
+	size_t				m_size;
+};
+
+}
+
+#endif // KEEPALIVE_HPP
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MPSC_QUEUE_HPP
+#define MPSC_QUEUE_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+
+namespace websocketpp {
+
+// Lock free queue of nodes that any number of threads push onto and one
+// thread takes off, all at once.
+//
+// Nodes are intrusive: T must have a T* member called next, which the queue
+// owns while the node is on it. Pushing is a single compare and swap onto a
+// stack. The consumer swaps the whole stack out and reverses it, so nodes 
+// come out in the order they were pushed.
+//
+// push reports when it found the queue empty, which is the one push of a 
+// batch that has to wake the consumer. Pushes made before the consumer takes
+// the batch don't.
+template <typename T>
+class mpsc_queue : boost::noncopyable {
+public:
+	mpsc_queue() : m_head(NULL) {}
+	
+	// Adds node to the queue. Returns true if the queue was empty, in which
+	// case the consumer has to be told to call pop_all.
+	bool push(T* node) {
+		T* head = m_head.load(boost::memory_order_relaxed);
+		
+		do {
+			node->next = head;
+		} while (!m_head.compare_exchange_weak(head,node,
+		                                       boost::memory_order_release,
+		                                       boost::memory_order_relaxed));
+		
+		return head == NULL;
+	}
+	
+	// Takes every node off the queue and returns them as a list linked by
+	// next, oldest first. Only one thread may call this.
+	T* pop_all() {
+		T* node = m_head.exchange(NULL,boost::memory_order_acquire);
+		T* list = NULL;
+		
+		while (node != NULL) {
+			T* next = node->next;
+			node->next = list;
+			list = node;
+			node = next;
+		}
+		
+		return list;
+	}
+	
+	bool empty() const {
+		return m_head.load(boost::memory_order_relaxed) == NULL;
+	}
+private:
+	boost::atomic<T*>	m_head;
+};
+
+}
+
+#endif // MPSC_QUEUE_HPP
@@ -27,6 +27,10 @@
 
 #include "network_utilities.hpp"
 
+#include "simd/sha1_kernels.hpp"
+
+#include <cstring>
+
 uint64_t htonll(uint64_t src) { 
 	static int typ = TYP_INIT; 
 	unsigned char c; 
@@ -173,3 +177,73 @@ bool websocketpp::ws_uri::parse(const std::string& uri) {
 	}
 
 }
+
+void websocketpp::split_header_list(const std::string& value,
+                                    std::vector<std::string>& out) {
+	std::string::size_type start = 0;
+	bool quoted = false;
+	
+	for (std::string::size_type i = 0; i <= value.size(); i++) {
+		if (i < value.size() && value[i] == '"') {
+			quoted = !quoted;
+		}
+		
+		if (i < value.size() && (quoted || value[i] != ',')) {
+			continue;
+		}
+		
+		std::string::size_type first = value.find_first_not_of(" \t",start);
+		std::string::size_type last = value.find_last_not_of(" \t",i-1);
+		
+		if (first != std::string::npos && first < i && last >= first) {
+			out.push_back(value.substr(first,last-first+1));
+		}
+		
+		start = i+1;
+	}
+}
+
+namespace {
+
+const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+const char BASE64_CHARS[] = 
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+}
+
+void websocketpp::make_accept_key(const char* key,size_t len,char* out) {
+	const size_t guid_len = sizeof(WEBSOCKET_GUID)-1;
+	unsigned char digest[20];
+	
+	// a valid key is 24 characters, which makes 60 bytes to hash
+	unsigned char buf[64];
+	
+	if (len+guid_len <= sizeof(buf)) {
+		std::memcpy(buf,key,len);
+		std::memcpy(buf+len,WEBSOCKET_GUID,guid_len);
+		simd::sha1(buf,len+guid_len,digest);
+	} else {
+		std::string s(key,len);
+		s.append(WEBSOCKET_GUID,guid_len);
+		simd::sha1(reinterpret_cast<const unsigned char*>(s.data()),s.size(),
+		           digest);
+	}
+	
+	// six groups of three bytes, then the last two with one byte of padding
+	for (size_t i = 0; i < 6; i++) {
+		uint32_t v = (uint32_t(digest[3*i]) << 16) | 
+		             (uint32_t(digest[3*i+1]) << 8) | digest[3*i+2];
+		
+		out[4*i] = BASE64_CHARS[v >> 18];
+		out[4*i+1] = BASE64_CHARS[(v >> 12) & 63];
+		out[4*i+2] = BASE64_CHARS[(v >> 6) & 63];
+		out[4*i+3] = BASE64_CHARS[v & 63];
+	}
+	
+	uint32_t v = (uint32_t(digest[18]) << 16) | (uint32_t(digest[19]) << 8);
+	out[24] = BASE64_CHARS[v >> 18];
+	out[25] = BASE64_CHARS[(v >> 12) & 63];
+	out[26] = BASE64_CHARS[(v >> 6) & 63];
+	out[27] = '=';
+}
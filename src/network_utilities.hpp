@@ -30,6 +30,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/regex.hpp>
 
 // http://www.viva64.com/en/k/0018/
@@ -55,6 +56,20 @@ struct ws_uri {
 	uint16_t	port;
 	std::string	resource;
 };
+
+// Splits a comma separated header value, such as Sec-WebSocket-Extensions, 
+// into its elements with surrounding whitespace removed. Commas inside 
+// quoted strings don't split. Empty elements are skipped.
+void split_header_list(const std::string& value,std::vector<std::string>& out);
+
+// length of a Sec-WebSocket-Accept value
+const size_t ACCEPT_KEY_SIZE = 28;
+
+// Writes the Sec-WebSocket-Accept value for the Sec-WebSocket-Key key, the 
+// base64 of the SHA-1 of the key followed by the WebSocket GUID. Exactly
+// ACCEPT_KEY_SIZE characters are written, with no terminator. Nothing is
+// allocated unless the key is longer than a valid one.
+void make_accept_key(const char* key,size_t len,char* out);
 }
 
 
@@ -0,0 +1,643 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "permessage_deflate.hpp"
+
+#include "buffer_pool.hpp"
+#include "websocket_frame.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+using websocketpp::permessage_deflate;
+
+namespace {
+
+const char EXTENSION_NAME[] = "permessage-deflate";
+
+// A sync flush ends with an empty stored block, 00 00 ff ff. Senders strip
+// it from each message and receivers put it back.
+const unsigned char EMPTY_BLOCK[4] = {0x00,0x00,0xff,0xff};
+
+const int MIN_WINDOW_BITS = 8;
+const int MAX_WINDOW_BITS = 15;
+
+// smallest window zlib's deflate can use
+const int MIN_DEFLATE_WINDOW_BITS = 9;
+
+// Messages recorded before the ratio of an opcode is trusted, and how much
+// each new one moves it.
+const uint32_t MIN_RATIO_SAMPLES = 4;
+const double RATIO_WEIGHT = 0.125;
+
+// Parses a window bits value. Returns 0 if it isn't one.
+int parse_window_bits(const std::string& v) {
+	if (v.size() < 1 || v.size() > 2 || v[0] == '0' ||
+	    v.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return 0;
+	}
+	
+	int bits = atoi(v.c_str());
+	
+	if (bits < MIN_WINDOW_BITS || bits > MAX_WINDOW_BITS) {
+		return 0;
+	}
+	return bits;
+}
+
+}
+
+permessage_deflate::settings::settings()
+ : enabled(false),
+   server_max_window_bits(MAX_WINDOW_BITS),
+   client_max_window_bits(MAX_WINDOW_BITS),
+   server_no_context_takeover(false),
+   client_no_context_takeover(false),
+   compression_level(Z_DEFAULT_COMPRESSION),
+   memory_level(8),
+   min_compress_size(64),
+   max_compress_ratio(0.95),
+   bypass_messages(128) {}
+
+permessage_deflate::counters::counters()
+ : compressed(0),
+   too_small(0),
+   bypassed(0),
+   bypasses(0),
+   bytes_in(0),
+   bytes_out(0) {}
+
+permessage_deflate::history::history() : ratio(0),samples(0),bypass(0) {}
+
+permessage_deflate::params::params()
+ : server_no_context_takeover(false),
+   client_no_context_takeover(false),
+   server_max_window_bits(0),
+   client_max_window_bits(0) {}
+
+permessage_deflate::permessage_deflate()
+ : m_active(false),
+   m_min_compress_size(0),
+   m_max_compress_ratio(1),
+   m_bypass_messages(0),
+   m_deflate_bits(MAX_WINDOW_BITS),
+   m_deflate_reset(false),
+   m_compression_level(Z_DEFAULT_COMPRESSION),
+   m_memory_level(8),
+   m_inflate_bits(MAX_WINDOW_BITS),
+   m_inflate_reset(false),
+   m_deflate(NULL),
+   m_inflate(NULL),
+   m_reserved(0) {}
+
+permessage_deflate::~permessage_deflate() {
+	if (m_deflate) {
+		zlib_pool::local().release_deflate(m_deflate,m_deflate_bits,
+		                                   m_compression_level,m_memory_level);
+	}
+	if (m_inflate) {
+		zlib_pool::local().release_inflate(m_inflate,m_inflate_bits);
+		
+		// a borrowed stream in the middle of a message
+		if (m_inflate_reset && m_budget) {
+			m_budget->release(zlib_pool::inflate_memory(m_inflate_bits));
+		}
+	}
+	if (m_budget) {
+		m_budget->release(m_reserved);
+	}
+}
+
+std::string permessage_deflate::negotiate(const settings& s,
+                                          const std::vector<std::string>& offers) {
+	for (size_t i = 0; i < offers.size(); i++) {
+		params p;
+		
+		if (!parse(offers[i],p)) {
+			continue;
+		}
+		
+		// the window we compress with
+		int server_bits = std::max(s.server_max_window_bits,
+		                           MIN_DEFLATE_WINDOW_BITS);
+		
+		if (p.server_max_window_bits != 0) {
+			if (p.server_max_window_bits < MIN_DEFLATE_WINDOW_BITS) {
+				continue;
+			}
+			server_bits = std::min(server_bits,p.server_max_window_bits);
+		}
+		
+		// The window the client compresses with. It can only be limited if
+		// the client said it can do that.
+		int client_bits = MAX_WINDOW_BITS;
+		
+		if (p.client_max_window_bits != 0) {
+			client_bits = s.client_max_window_bits;
+			
+			if (p.client_max_window_bits > 0) {
+				client_bits = std::min(client_bits,p.client_max_window_bits);
+			}
+		}
+		
+		bool server_reset = s.server_no_context_takeover || 
+		                    p.server_no_context_takeover;
+		bool client_reset = s.client_no_context_takeover || 
+		                    p.client_no_context_takeover;
+		int memory_level = s.memory_level;
+		
+		if (!reserve(s,server_bits,server_reset,memory_level,client_bits,
+		             client_reset,p.client_max_window_bits != 0))
+		{
+			continue;
+		}
+		
+		std::stringstream r;
+		r << EXTENSION_NAME;
+		
+		if (server_reset) {
+			r << "; server_no_context_takeover";
+		}
+		if (client_reset) {
+			r << "; client_no_context_takeover";
+		}
+		if (p.server_max_window_bits != 0 || server_bits < MAX_WINDOW_BITS) {
+			r << "; server_max_window_bits=" << server_bits;
+		}
+		if (p.client_max_window_bits != 0 && client_bits < MAX_WINDOW_BITS) {
+			r << "; client_max_window_bits=" << client_bits;
+		}
+		
+		init(server_bits,server_reset,memory_level,client_bits,client_reset,s);
+		return r.str();
+	}
+	
+	return "";
+}
+
+std::string permessage_deflate::generate_offer(const settings& s) {
+	std::stringstream r;
+	r << EXTENSION_NAME;
+	
+	if (s.server_no_context_takeover) {
+		r << "; server_no_context_takeover";
+	}
+	if (s.client_no_context_takeover) {
+		r << "; client_no_context_takeover";
+	}
+	if (s.server_max_window_bits < MAX_WINDOW_BITS) {
+		r << "; server_max_window_bits=" << s.server_max_window_bits;
+	}
+	
+	// we can compress with whatever window the server asks for
+	r << "; client_max_window_bits";
+	if (s.client_max_window_bits < MAX_WINDOW_BITS) {
+		r << "=" << std::max(s.client_max_window_bits,MIN_DEFLATE_WINDOW_BITS);
+	}
+	
+	return r.str();
+}
+
+bool permessage_deflate::accept_response(const settings& s,
+                                         const std::string& response) {
+	params p;
+	
+	if (!parse(response,p) || p.client_max_window_bits == -1) {
+		return false;
+	}
+	
+	// the server has to accept what we asked for
+	if (s.server_no_context_takeover && !p.server_no_context_takeover) {
+		return false;
+	}
+	if (s.server_max_window_bits < MAX_WINDOW_BITS && 
+	    (p.server_max_window_bits == 0 || 
+	     p.server_max_window_bits > s.server_max_window_bits))
+	{
+		return false;
+	}
+	
+	int client_bits = std::max(s.client_max_window_bits,MIN_DEFLATE_WINDOW_BITS);
+	
+	if (p.client_max_window_bits != 0) {
+		if (p.client_max_window_bits < MIN_DEFLATE_WINDOW_BITS) {
+			return false;
+		}
+		client_bits = std::min(client_bits,p.client_max_window_bits);
+	}
+	
+	int server_bits = MAX_WINDOW_BITS;
+	
+	if (p.server_max_window_bits != 0) {
+		server_bits = p.server_max_window_bits;
+	}
+	
+	bool client_reset = s.client_no_context_takeover || 
+	                    p.client_no_context_takeover;
+	
+	// The windows are settled by now. The client's streams are counted but
+	// it has no way left to keep within the limit.
+	if (s.budget) {
+		m_reserved = 0;
+		
+		if (!client_reset) {
+			m_reserved += zlib_pool::deflate_memory(client_bits,s.memory_level);
+		}
+		if (!p.server_no_context_takeover) {
+			m_reserved += zlib_pool::inflate_memory(server_bits);
+		}
+		s.budget->force_reserve(m_reserved);
+		m_budget = s.budget;
+	}
+	
+	init(client_bits,client_reset,s.memory_level,server_bits,
+	     p.server_no_context_takeover,s);
+	return true;
+}
+
+bool permessage_deflate::is_permessage_deflate(const std::string& extension) {
+	std::string::size_type end = extension.find(';');
+	
+	return boost::trim_copy(extension.substr(0,end)) == EXTENSION_NAME;
+}
+
+bool permessage_deflate::is_active() const {
+	return m_active;
+}
+
+uint32_t permessage_deflate::get_shared_key() const {
+	if (!m_active || !m_deflate_reset) {
+		return 0;
+	}
+	
+	return zlib_pool::deflate_key(m_deflate_bits,m_compression_level,
+	                              m_memory_level);
+}
+
+bool permessage_deflate::should_compress(frame::opcode op,size_t len) {
+	if (len < m_min_compress_size) {
+		m_counters.too_small++;
+		return false;
+	}
+	
+	history& h = get_history(op);
+	
+	if (h.bypass > 0) {
+		h.bypass--;
+		m_counters.bypassed++;
+		return false;
+	}
+	return true;
+}
+
+void permessage_deflate::record(frame::opcode op,size_t in,size_t out) {
+	m_counters.compressed++;
+	m_counters.bytes_in += in;
+	m_counters.bytes_out += out;
+	
+	history& h = get_history(op);
+	double ratio = in == 0 ? 1 : double(out)/in;
+	
+	if (h.samples == 0) {
+		h.ratio = ratio;
+	} else {
+		h.ratio += (ratio-h.ratio)*RATIO_WEIGHT;
+	}
+	h.samples++;
+	
+	if (h.samples >= MIN_RATIO_SAMPLES && h.ratio > m_max_compress_ratio &&
+	    m_bypass_messages > 0) 
+	{
+		// start over when compression is tried again
+		h.bypass = m_bypass_messages;
+		h.samples = 0;
+		m_counters.bypasses++;
+	}
+}
+
+const permessage_deflate::counters& permessage_deflate::get_counters() const {
+	return m_counters;
+}
+
+bool permessage_deflate::compress(const unsigned char* data,size_t len,
+                                  std::vector<unsigned char>& out) {
+	z_stream* z = m_deflate;
+	size_t borrowed = 0;
+	
+	if (z == NULL) {
+		if (m_deflate_reset && m_budget) {
+			borrowed = zlib_pool::deflate_memory(m_deflate_bits,m_memory_level);
+			
+			if (!m_budget->reserve(borrowed)) {
+				return false;
+			}
+		}
+		
+		z = zlib_pool::local().acquire_deflate(m_deflate_bits,
+		                                       m_compression_level,
+		                                       m_memory_level);
+		
+		if (z == NULL) {
+			if (borrowed != 0) {
+				m_budget->release(borrowed);
+			}
+			throw frame_error("Could not initialize deflate",
+			                  frame::FERR_FATAL_SESSION_ERROR);
+		}
+		
+		if (!m_deflate_reset) {
+			m_deflate = z;
+		}
+	}
+	
+	// room for the whole message plus the flush, in most cases
+	size_t size = deflateBound(z,len) + 16;
+	buffer_pool::local().acquire(out,size);
+	out.resize(size);
+	
+	z->next_in = const_cast<unsigned char*>(data);
+	z->avail_in = len;
+	
+	size_t used = 0;
+	
+	for (;;) {
+		z->next_out = &out[used];
+		z->avail_out = out.size()-used;
+		
+		deflate(z,Z_SYNC_FLUSH);
+		used = out.size()-z->avail_out;
+		
+		if (z->avail_out != 0) {
+			break;
+		}
+		
+		buffer_pool::local().reserve(out,out.size()*2);
+		out.resize(out.size()*2);
+	}
+	
+	if (used >= 4 && std::equal(EMPTY_BLOCK,EMPTY_BLOCK+4,&out[used-4])) {
+		used -= 4;
+	}
+	out.resize(used);
+	
+	if (m_deflate_reset) {
+		// the pool resets the stream
+		zlib_pool::local().release_deflate(z,m_deflate_bits,
+		                                   m_compression_level,m_memory_level);
+		
+		if (borrowed != 0) {
+			m_budget->release(borrowed);
+		}
+	}
+	
+	return true;
+}
+
+void permessage_deflate::decompress(const unsigned char* data,size_t len,
+                                    bool fin,std::vector<unsigned char>& out,
+                                    size_t max_size) {
+	if (m_inflate == NULL) {
+		m_inflate = zlib_pool::local().acquire_inflate(m_inflate_bits);
+		
+		if (m_inflate == NULL) {
+			throw frame_error("Could not initialize inflate",
+			                  frame::FERR_FATAL_SESSION_ERROR);
+		}
+		
+		// Incoming messages have to be inflated, so a stream borrowed for
+		// one is counted even if that goes over the limit.
+		if (m_inflate_reset && m_budget) {
+			m_budget->force_reserve(zlib_pool::inflate_memory(m_inflate_bits));
+		}
+	}
+	
+	// the frame's payload, then for the last frame the empty block that the
+	// sender left off
+	const unsigned char* input[2] = {data,EMPTY_BLOCK};
+	size_t input_len[2] = {len,fin ? sizeof(EMPTY_BLOCK) : 0};
+	
+	size_t used = out.size();
+	
+	for (int i = 0; i < 2; i++) {
+		m_inflate->next_in = const_cast<unsigned char*>(input[i]);
+		m_inflate->avail_in = input_len[i];
+		
+		if (input_len[i] == 0) {
+			continue;
+		}
+		
+		// keep going while there is input, or output that didn't fit
+		for (;;) {
+			if (out.size() == used) {
+				size_t size = used + std::max(len*2,size_t(4096));
+				buffer_pool::local().reserve(out,size);
+				out.resize(size);
+			}
+			
+			m_inflate->next_out = &out[used];
+			m_inflate->avail_out = out.size()-used;
+			
+			int ret = inflate(m_inflate,Z_SYNC_FLUSH);
+			used = out.size()-m_inflate->avail_out;
+			
+			if (used > max_size) {
+				out.resize(used);
+				throw frame_error("Decompressed message is too big",
+				                  frame::FERR_MSG_TOO_BIG);
+			}
+			
+			if (ret == Z_STREAM_END) {
+				// A final block ends the stream, so there is no context to
+				// take over. Anything after it is ignored.
+				inflateReset(m_inflate);
+				break;
+			} else if (ret == Z_BUF_ERROR) {
+				// nothing more to do with what we have
+				break;
+			} else if (ret != Z_OK) {
+				out.resize(used);
+				throw frame_error("Invalid compressed data",
+				                  frame::FERR_PAYLOAD_VIOLATION);
+			}
+			
+			if (m_inflate->avail_in == 0 && m_inflate->avail_out != 0) {
+				break;
+			}
+		}
+	}
+	
+	out.resize(used);
+	
+	if (fin && m_inflate_reset) {
+		// the pool resets the stream
+		zlib_pool::local().release_inflate(m_inflate,m_inflate_bits);
+		m_inflate = NULL;
+		
+		if (m_budget) {
+			m_budget->release(zlib_pool::inflate_memory(m_inflate_bits));
+		}
+	}
+}
+
+permessage_deflate::history& permessage_deflate::get_history(frame::opcode op) {
+	return op == frame::BINARY_FRAME ? m_binary : m_text;
+}
+
+bool permessage_deflate::parse(const std::string& extension,params& p) {
+	std::vector<std::string> tokens;
+	boost::split(tokens,extension,boost::is_any_of(";"));
+	
+	if (boost::trim_copy(tokens[0]) != EXTENSION_NAME) {
+		return false;
+	}
+	
+	for (size_t i = 1; i < tokens.size(); i++) {
+		std::string name = boost::trim_copy(tokens[i]);
+		std::string value;
+		bool has_value = false;
+		std::string::size_type eq = name.find('=');
+		
+		if (eq != std::string::npos) {
+			value = boost::trim_copy(name.substr(eq+1));
+			name = boost::trim_copy(name.substr(0,eq));
+			has_value = true;
+			
+			if (value.size() >= 2 && value[0] == '"' && 
+			    value[value.size()-1] == '"') 
+			{
+				value = value.substr(1,value.size()-2);
+			}
+		}
+		
+		// each parameter may appear once
+		if (name == "server_no_context_takeover") {
+			if (has_value || p.server_no_context_takeover) {
+				return false;
+			}
+			p.server_no_context_takeover = true;
+		} else if (name == "client_no_context_takeover") {
+			if (has_value || p.client_no_context_takeover) {
+				return false;
+			}
+			p.client_no_context_takeover = true;
+		} else if (name == "server_max_window_bits") {
+			if (p.server_max_window_bits != 0) {
+				return false;
+			}
+			p.server_max_window_bits = parse_window_bits(value);
+			
+			if (p.server_max_window_bits == 0) {
+				return false;
+			}
+		} else if (name == "client_max_window_bits") {
+			if (p.client_max_window_bits != 0) {
+				return false;
+			}
+			
+			if (has_value) {
+				p.client_max_window_bits = parse_window_bits(value);
+				
+				if (p.client_max_window_bits == 0) {
+					return false;
+				}
+			} else {
+				p.client_max_window_bits = -1;
+			}
+		} else {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+bool permessage_deflate::reserve(const settings& s,int& deflate_bits,
+                                 bool deflate_reset,int& memory_level,
+                                 int& inflate_bits,bool inflate_reset,
+                                 bool limit_inflate) {
+	if (!s.budget) {
+		return true;
+	}
+	
+	for (;;) {
+		size_t bytes = 0;
+		
+		if (!deflate_reset) {
+			bytes += zlib_pool::deflate_memory(deflate_bits,memory_level);
+		}
+		if (!inflate_reset) {
+			bytes += zlib_pool::inflate_memory(inflate_bits);
+		}
+		
+		if (s.budget->reserve(bytes)) {
+			m_budget = s.budget;
+			m_reserved = bytes;
+			return true;
+		}
+		
+		// Halve both windows if possible. Most of a deflate stream's memory
+		// is its hash table, which the memory level sizes, so that is halved
+		// along with its window.
+		bool smaller = false;
+		
+		if (!deflate_reset && deflate_bits > MIN_DEFLATE_WINDOW_BITS) {
+			deflate_bits--;
+			memory_level = std::max(memory_level-1,1);
+			smaller = true;
+		}
+		if (!inflate_reset && limit_inflate && 
+		    inflate_bits > MIN_DEFLATE_WINDOW_BITS) 
+		{
+			inflate_bits--;
+			smaller = true;
+		}
+		
+		if (!smaller) {
+			return false;
+		}
+	}
+}
+
+void permessage_deflate::init(int deflate_bits,bool deflate_reset,
+                              int memory_level,int inflate_bits,
+                              bool inflate_reset,const settings& s) {
+	m_active = true;
+	m_deflate_bits = deflate_bits;
+	m_deflate_reset = deflate_reset;
+	m_compression_level = s.compression_level;
+	m_memory_level = memory_level;
+	m_min_compress_size = s.min_compress_size;
+	m_max_compress_ratio = s.max_compress_ratio;
+	m_bypass_messages = s.bypass_messages;
+	
+	// zlib inflates a window of 8 bits with a 9 bit window just as well
+	m_inflate_bits = std::max(inflate_bits,MIN_DEFLATE_WINDOW_BITS);
+	m_inflate_reset = inflate_reset;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PERMESSAGE_DEFLATE_HPP
+#define PERMESSAGE_DEFLATE_HPP
+
+#include "websocket_frame.hpp"
+#include "zlib_pool.hpp"
+
+#include <boost/noncopyable.hpp>
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// The permessage-deflate extension (RFC 7692) for one connection. Negotiates
+// the extension's parameters in the opening handshake, then compresses the
+// payloads of outgoing messages and decompresses those of incoming ones.
+//
+// zlib streams are created the first time they are needed, so a connection
+// that only ever sends, or only receives, pays for only one of them. In a 
+// direction without context takeover every message starts from a fresh 
+// stream, so the stream is borrowed from the thread's zlib_pool for the one
+// message and a connection holds none between messages.
+//
+// Not every message is worth compressing. Messages below a size threshold are
+// sent as they are, and so are messages of an opcode that recently hasn't 
+// compressed well, for a while before it is tried again.
+class permessage_deflate : boost::noncopyable {
+public:
+	// What this end asks for, or is willing to accept. Window bits are the
+	// base two logarithm of the LZ77 window size, from 9 to 15. (RFC 7692 
+	// allows 8 but zlib can't compress with a window that small.)
+	struct settings {
+		settings();
+		
+		bool	enabled;
+		int		server_max_window_bits;
+		int		client_max_window_bits;
+		bool	server_no_context_takeover;
+		bool	client_no_context_takeover;
+		
+		// zlib deflateInit2 parameters
+		int		compression_level;
+		int		memory_level;
+		
+		// Outgoing messages smaller than this are sent uncompressed.
+		size_t	min_compress_size;
+		
+		// If recent messages of an opcode compressed to more than this
+		// fraction of their size, the next bypass_messages of that opcode
+		// are sent uncompressed.
+		double		max_compress_ratio;
+		uint32_t	bypass_messages;
+		
+		// Memory limit for zlib streams shared with other connections, if
+		// any. A server that can't keep the streams of a new connection 
+		// within it negotiates smaller windows, or declines the extension if
+		// that isn't enough. Streams borrowed for one message are only 
+		// counted while they are in use, and a message that can't borrow one
+		// is sent uncompressed.
+		zlib_budget_ptr	budget;
+	};
+	
+	// how the compression decisions for outgoing messages went
+	struct counters {
+		counters();
+		
+		uint64_t	compressed;		// messages sent compressed
+		uint64_t	too_small;		// messages under min_compress_size
+		uint64_t	bypassed;		// messages sent as they are while bypassing
+		uint64_t	bypasses;		// times compression was turned off
+		uint64_t	bytes_in;		// payload bytes of compressed messages
+		uint64_t	bytes_out;		// and what they compressed to
+	};
+	
+	permessage_deflate();
+	~permessage_deflate();
+	
+	// Server side. Accepts the first of the client's extension offers that 
+	// is an acceptable permessage-deflate offer and returns the extension 
+	// response for it, or an empty string if there is none.
+	std::string negotiate(const settings& s,
+	                      const std::vector<std::string>& offers);
+	
+	// Client side. The extension offer to send.
+	static std::string generate_offer(const settings& s);
+	
+	// Client side. Sets up the extension from the server's response to the
+	// offer made for s. Returns false if the response is not valid for that
+	// offer, in which case the connection must fail.
+	bool accept_response(const settings& s,const std::string& response);
+	
+	// true if extension is a permessage-deflate offer or response
+	static bool is_permessage_deflate(const std::string& extension);
+	
+	// true once negotiation has succeeded
+	bool is_active() const;
+	
+	// Identifies how outgoing messages are compressed when each one is 
+	// compressed on its own. Connections with the same key compress a message
+	// to the same bytes, so the result can be shared between them. Returns 0
+	// if messages take over context from earlier ones and can't be shared.
+	uint32_t get_shared_key() const;
+	
+	// true if an outgoing message with this opcode and payload size should be
+	// compressed. Counts the message as skipped if not.
+	bool should_compress(frame::opcode op,size_t len);
+	
+	// Counts a message of opcode op compressed from in bytes to out bytes.
+	// Turns compression off for the opcode for a while if recent messages 
+	// haven't compressed well.
+	void record(frame::opcode op,size_t in,size_t out);
+	
+	const counters& get_counters() const;
+	
+	// Compresses the whole payload of a message into out. Returns false if
+	// the budget has no room for a stream, in which case the message must be
+	// sent uncompressed.
+	bool compress(const unsigned char* data,size_t len,
+	              std::vector<unsigned char>& out);
+	
+	// Decompresses the payload of one frame of a compressed message onto the
+	// end of out. fin is true for the last frame of the message. Throws a
+	// frame_error if the data isn't valid or out would grow past max_size.
+	void decompress(const unsigned char* data,size_t len,bool fin,
+	                std::vector<unsigned char>& out,size_t max_size);
+private:
+	// parameters of one extension offer or response
+	struct params {
+		params();
+		
+		bool	server_no_context_takeover;
+		bool	client_no_context_takeover;
+		
+		// 0 if absent, -1 for client_max_window_bits without a value
+		int		server_max_window_bits;
+		int		client_max_window_bits;
+	};
+	
+	static bool parse(const std::string& extension,params& p);
+	
+	// Counts the memory of the streams kept for the whole connection against
+	// the budget, making their windows smaller until it fits if need be. The
+	// inflate window can only be made smaller if the peer allows it. Returns
+	// false if it doesn't fit with the smallest windows.
+	bool reserve(const settings& s,int& deflate_bits,bool deflate_reset,
+	             int& memory_level,int& inflate_bits,bool inflate_reset,
+	             bool limit_inflate);
+	
+	void init(int deflate_bits,bool deflate_reset,int memory_level,
+	          int inflate_bits,bool inflate_reset,const settings& s);
+	
+	// recent compression ratio of one opcode
+	struct history {
+		history();
+		
+		double		ratio;
+		uint32_t	samples;
+		uint32_t	bypass;		// messages still to send uncompressed
+	};
+	
+	history& get_history(frame::opcode op);
+	
+	bool		m_active;
+	
+	size_t		m_min_compress_size;
+	double		m_max_compress_ratio;
+	uint32_t	m_bypass_messages;
+	history		m_text;
+	history		m_binary;
+	counters	m_counters;
+	
+	int			m_deflate_bits;
+	bool		m_deflate_reset;
+	int			m_compression_level;
+	int			m_memory_level;
+	
+	int			m_inflate_bits;
+	bool		m_inflate_reset;
+	
+	// NULL until first needed, and between messages if borrowed
+	z_stream*	m_deflate;
+	z_stream*	m_inflate;
+	
+	// bytes of the budget held for streams kept for the whole connection
+	zlib_budget_ptr	m_budget;
+	size_t			m_reserved;
+};
+
+}
+
+#endif // PERMESSAGE_DEFLATE_HPP
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "prepared_message.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+#include <utility>
+
+using websocketpp::prepared_message;
+using websocketpp::frame;
+using websocketpp::frame_error;
+
+// There is an entry for each set of deflate parameters the message has been
+// sent with, which in practice is very few.
+struct prepared_message::compressed_cache {
+	boost::mutex	lock;
+	std::vector< std::pair<uint32_t,prepared_message> >	frames;
+};
+
+prepared_message::prepared_message()
+ : m_opcode(frame::CONTINUATION_FRAME),m_header_len(0),m_compressed(false) {}
+
+prepared_message::prepared_message(const std::string& msg) {
+	init(frame::TEXT_FRAME,
+	     reinterpret_cast<const unsigned char*>(msg.data()),msg.size());
+}
+
+prepared_message::prepared_message(const std::vector<unsigned char>& data) {
+	init(frame::BINARY_FRAME,data.empty() ? NULL : &data[0],data.size());
+}
+
+prepared_message::prepared_message(frame::opcode op,const unsigned char* data,
+                                   size_t len) {
+	init(op,data,len);
+}
+
+bool prepared_message::empty() const {
+	return !m_buffer;
+}
+
+frame::opcode prepared_message::get_opcode() const {
+	return m_opcode;
+}
+
+const unsigned char* prepared_message::get_payload_data() const {
+	if (!m_buffer) {
+		return NULL;
+	}
+	return &m_buffer->get_data()[0] + m_header_len;
+}
+
+size_t prepared_message::get_payload_size() const {
+	if (!m_buffer) {
+		return 0;
+	}
+	return m_buffer->get_data().size() - m_header_len;
+}
+
+const websocketpp::shared_buffer_ptr& prepared_message::get_buffer() const {
+	return m_buffer;
+}
+
+bool prepared_message::is_compressed() const {
+	return m_compressed;
+}
+
+prepared_message prepared_message::get_compressed(permessage_deflate& d) const {
+	if (!m_cache || !d.should_compress(m_opcode,get_payload_size())) {
+		return *this;
+	}
+	
+	uint32_t key = d.get_shared_key();
+	
+	// Holding the lock while compressing means that sessions that want the
+	// same frame at the same time wait for it rather than all compress it.
+	boost::mutex::scoped_lock guard(m_cache->lock);
+	
+	for (size_t i = 0; i < m_cache->frames.size(); i++) {
+		if (m_cache->frames[i].first == key) {
+			const prepared_message& m = m_cache->frames[i].second;
+			d.record(m_opcode,get_payload_size(),m.get_payload_size());
+			return m;
+		}
+	}
+	
+	// if there is no memory to compress it with it is sent as it is
+	std::vector<unsigned char> payload;
+	if (!d.compress(get_payload_data(),get_payload_size(),payload)) {
+		return *this;
+	}
+	
+	d.record(m_opcode,get_payload_size(),payload.size());
+	
+	// A message that doesn't get smaller is sent as it is by every session
+	// with this key.
+	prepared_message m = *this;
+	m.m_cache.reset();
+	
+	if (payload.size() < get_payload_size()) {
+		m = prepared_message();
+		m.init(m_opcode,&payload[0],payload.size(),true);
+	}
+	buffer_pool::local().release(payload);
+	
+	m_cache->frames.push_back(std::make_pair(key,m));
+	return m;
+}
+
+void prepared_message::init(frame::opcode op,const unsigned char* data,
+                            size_t len,bool rsv1) {
+	if (len > frame::max_payload_size) {
+		throw frame_error("requested payload is over implimentation defined limit",frame::FERR_MSG_TOO_BIG);
+	}
+	
+	if (len > frame::BASIC_PAYLOAD_LIMIT && op > frame::MAX_FRAME_OPCODE) {
+		throw frame_error("control frames can't have large payloads",frame::FERR_PROTOCOL_VIOLATION);
+	}
+	
+	char header[frame::MAX_HEADER_LENGTH];
+	
+	m_opcode = op;
+	m_header_len = frame::write_header(header,true,op,len,rsv1);
+	m_compressed = rsv1;
+	
+	m_buffer = buffer_pool::local().make_shared_buffer(m_header_len+len);
+	
+	std::vector<unsigned char>& buf = m_buffer->get_data();
+	buf.insert(buf.end(),header,header+m_header_len);
+	buf.insert(buf.end(),data,data+len);
+	
+	// only data messages are compressed, and only once
+	if (!rsv1 && op <= frame::MAX_FRAME_OPCODE) {
+		m_cache.reset(new compressed_cache());
+	}
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef PREPARED_MESSAGE_HPP
+#define PREPARED_MESSAGE_HPP
+
+#include "buffer_pool.hpp"
+#include "permessage_deflate.hpp"
+#include "websocket_frame.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// A message that has been framed once, ready to be sent to any number of
+// sessions. The frame is built as an unmasked server frame in an immutable,
+// reference counted buffer. session::send queues a reference to that buffer
+// rather than copying it, so broadcasting a prepared message costs a pointer
+// per session no matter how large the message is.
+//
+// Sessions that compress each message on its own with the same 
+// permessage-deflate parameters produce the same compressed frame, so that
+// is built once per set of parameters and shared too.
+//
+// prepared_messages are cheap to copy and may be shared between threads.
+class prepared_message {
+public:
+	prepared_message();
+	
+	// a text message
+	explicit prepared_message(const std::string& msg);
+	
+	// a binary message
+	explicit prepared_message(const std::vector<unsigned char>& data);
+	
+	// a single frame message of any opcode
+	prepared_message(frame::opcode op,const unsigned char* data,size_t len);
+	
+	bool empty() const;
+	frame::opcode get_opcode() const;
+	
+	const unsigned char* get_payload_data() const;
+	size_t get_payload_size() const;
+	
+	// the serialized frame, header followed by payload
+	const shared_buffer_ptr& get_buffer() const;
+	
+	// true if the payload is compressed and RSV1 is set
+	bool is_compressed() const;
+	
+	// The message compressed by d, which must have a shared key. The first
+	// call for each key compresses the message and later calls, from any
+	// session, return the same frame. Control frames, messages that d 
+	// decides not to compress or has no memory to compress, and messages 
+	// that don't get smaller are returned as they are.
+	prepared_message get_compressed(permessage_deflate& d) const;
+private:
+	struct compressed_cache;
+	
+	void init(frame::opcode op,const unsigned char* data,size_t len,
+	          bool rsv1 = false);
+	
+	shared_buffer_ptr	m_buffer;
+	frame::opcode		m_opcode;
+	unsigned int		m_header_len;
+	bool				m_compressed;
+	
+	// compressed versions of the message, shared by all copies of it
+	boost::shared_ptr<compressed_cache>	m_cache;
+};
+
+}
+
+#endif // PREPARED_MESSAGE_HPP
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "receive_buffer.hpp"
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using websocketpp::receive_buffer;
+
+const size_t receive_buffer::DEFAULT_CAPACITY;
+const size_t receive_buffer::MIN_READ_SIZE;
+
+receive_buffer::receive_buffer(size_t capacity)
+	: m_capacity(capacity),
+	  m_begin(0),
+	  m_end(0) {}
+
+unsigned char* receive_buffer::data() {
+	return m_storage.empty() ? NULL : &m_storage[m_begin];
+}
+
+size_t receive_buffer::size() const {
+	return m_end-m_begin;
+}
+
+bool receive_buffer::empty() const {
+	return m_begin == m_end;
+}
+
+void receive_buffer::consume(size_t n) {
+	m_begin += std::min(n,size());
+	
+	// Once everything has been read the next read can start at the front
+	// for free.
+	if (m_begin == m_end) {
+		m_begin = 0;
+		m_end = 0;
+	}
+}
+
+unsigned char* receive_buffer::prepare(size_t min_space) {
+	if (m_storage.empty()) {
+		size_t n = std::max(m_capacity,min_space);
+		buffer_pool::local().acquire(m_storage,n);
+		m_storage.resize(n);
+	}
+	
+	if (space() < min_space && m_begin > 0) {
+		compact();
+	}
+	
+	if (space() < min_space) {
+		m_storage.resize(std::max(m_storage.size()*2,m_end+min_space));
+	}
+	
+	return &m_storage[m_end];
+}
+
+size_t receive_buffer::space() const {
+	return m_storage.size()-m_end;
+}
+
+void receive_buffer::commit(size_t n) {
+	m_end += std::min(n,space());
+}
+
+void receive_buffer::append(const unsigned char* src,size_t n) {
+	if (n == 0) {
+		return;
+	}
+	std::memcpy(prepare(n),src,n);
+	commit(n);
+}
+
+size_t receive_buffer::capacity() const {
+	return m_storage.size();
+}
+
+void receive_buffer::release() {
+	if (!empty() || m_storage.empty()) {
+		return;
+	}
+	buffer_pool::local().release(m_storage);
+	m_begin = 0;
+	m_end = 0;
+}
+
+void receive_buffer::compact() {
+	if (m_begin == 0) {
+		return;
+	}
+	std::memmove(&m_storage[0],&m_storage[m_begin],size());
+	m_end -= m_begin;
+	m_begin = 0;
+}
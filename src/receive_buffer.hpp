@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef RECEIVE_BUFFER_HPP
+#define RECEIVE_BUFFER_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace websocketpp {
+
+// A contiguous buffer for bytes read from the network. Bytes are appended at
+// the back by socket reads and taken from the front by the frame parser, 
+// which parses headers and small payloads directly out of it.
+//
+// Rather than wrapping around like a ring, which would split frames across 
+// the end of the storage, the unread bytes are moved back to the front when
+// the free space runs low. After a read has been fully parsed there are at
+// most a few header bytes left to move, and usually none.
+class receive_buffer {
+public:
+	static const size_t DEFAULT_CAPACITY = 16384;
+	
+	// least free space a socket read should be started with
+	static const size_t MIN_READ_SIZE = 4096;
+	
+	// Storage is taken from the thread's buffer pool on the first prepare
+	// and can be given back with release while nothing is unread.
+	explicit receive_buffer(size_t capacity = DEFAULT_CAPACITY);
+	
+	// unread bytes
+	unsigned char* data();
+	size_t size() const;
+	bool empty() const;
+	
+	// marks the first n unread bytes as read
+	void consume(size_t n);
+	
+	// Returns the free space at the back of the buffer, compacting or 
+	// growing it first if less than min_space bytes are free. The pointer is
+	// valid until the next call that changes the buffer. 
+	unsigned char* prepare(size_t min_space = 1);
+	size_t space() const;
+	
+	// marks n bytes written to the space returned by prepare as unread
+	void commit(size_t n);
+	
+	// copies n bytes onto the back of the buffer
+	void append(const unsigned char* src,size_t n);
+	
+	size_t capacity() const;
+	
+	// Returns the storage to the thread's buffer pool if no bytes are 
+	// unread, so that a connection that is waiting for data holds none.
+	void release();
+private:
+	void compact();
+	
+	std::vector<unsigned char>	m_storage;
+	size_t						m_capacity;
+	size_t						m_begin;
+	size_t						m_end;
+};
+
+}
+
+#endif // RECEIVE_BUFFER_HPP
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "rtt_histogram.hpp"
+
+#include <cmath>
+
+using websocketpp::rtt_histogram;
+
+const size_t rtt_histogram::BUCKETS;
+
+rtt_histogram::rtt_histogram() {
+	for (size_t i = 0; i < BUCKETS; i++) {
+		m_buckets[i].store(0,boost::memory_order_relaxed);
+	}
+}
+
+size_t rtt_histogram::bucket_for(uint64_t us) {
+	if (us > 0xFFFFFFFF) {
+		us = 0xFFFFFFFF;
+	}
+	
+	// the first four buckets hold a single value each
+	if (us < 4) {
+		return us;
+	}
+	
+	// After that the two bits below the highest set one pick one of the 
+	// four buckets for that power of two.
+	size_t e = 0;
+	while (us >> (e+1) != 0) {
+		e++;
+	}
+	
+	return 4*(e-1) + ((us >> (e-2)) & 3);
+}
+
+uint64_t rtt_histogram::bucket_max(size_t bucket) {
+	if (bucket < 4) {
+		return bucket;
+	}
+	
+	size_t e = bucket/4 + 1;
+	uint64_t lowest = (uint64_t(4 + bucket%4)) << (e-2);
+	
+	return lowest + (uint64_t(1) << (e-2)) - 1;
+}
+
+void rtt_histogram::record(uint64_t us) {
+	m_buckets[bucket_for(us)].fetch_add(1,boost::memory_order_relaxed);
+}
+
+uint64_t rtt_histogram::count() const {
+	uint64_t n = 0;
+	
+	for (size_t i = 0; i < BUCKETS; i++) {
+		n += m_buckets[i].load(boost::memory_order_relaxed);
+	}
+	return n;
+}
+
+uint64_t rtt_histogram::percentile(double p) const {
+	std::vector<uint64_t> counts = get_counts();
+	uint64_t n = 0;
+	
+	for (size_t i = 0; i < BUCKETS; i++) {
+		n += counts[i];
+	}
+	
+	if (n == 0) {
+		return 0;
+	}
+	
+	// rank of the time wanted, from 1 to n
+	uint64_t rank = static_cast<uint64_t>(std::ceil(p*n));
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > n) {
+		rank = n;
+	}
+	
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank) {
+			return bucket_max(i);
+		}
+	}
+	
+	return bucket_max(BUCKETS-1);
+}
+
+std::vector<uint64_t> rtt_histogram::get_counts() const {
+	std::vector<uint64_t> counts(BUCKETS);
+	
+	for (size_t i = 0; i < BUCKETS; i++) {
+		counts[i] = m_buckets[i].load(boost::memory_order_relaxed);
+	}
+	return counts;
+}
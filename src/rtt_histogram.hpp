@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef RTT_HISTOGRAM_HPP
+#define RTT_HISTOGRAM_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Round trip times of many sessions, in microseconds. Each power of two is
+// split into four buckets, so a percentile is within 25% of the real value.
+// Times of an hour or more count as just under 2^32 microseconds, about 71 
+// minutes.
+//
+// Safe to record into and read from any thread. A read made while others 
+// record sees each count as it was at some point during the read.
+class rtt_histogram : boost::noncopyable {
+public:
+	static const size_t BUCKETS = 124;
+	
+	rtt_histogram();
+	
+	void record(uint64_t us);
+	
+	// number of times recorded
+	uint64_t count() const;
+	
+	// Smallest time that at least p (0 to 1) of the recorded times are no
+	// more than, to the upper end of its bucket. 0 if nothing was recorded.
+	uint64_t percentile(double p) const;
+	
+	// counts of each bucket, and the largest time in each
+	std::vector<uint64_t> get_counts() const;
+	static uint64_t bucket_max(size_t bucket);
+	
+	static size_t bucket_for(uint64_t us);
+private:
+	boost::atomic<uint64_t>	m_buckets[BUCKETS];
+};
+
+typedef boost::shared_ptr<rtt_histogram> rtt_histogram_ptr;
+
+}
+
+#endif // RTT_HISTOGRAM_HPP
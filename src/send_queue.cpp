@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "send_queue.hpp"
+
+#include <algorithm>
+
+using websocketpp::send_queue;
+
+const size_t send_queue::COPY_THRESHOLD;
+const size_t send_queue::MAX_SEGMENTS;
+const size_t send_queue::COPY_BUFFER_SIZE;
+const size_t send_queue::MAX_WRITE_SIZE;
+const size_t send_queue::HEADER_BUFFER_SIZE;
+
+struct send_queue::message_less {
+	bool operator()(const segment& s,uint64_t id) const {
+		return s.message < id;
+	}
+	bool operator()(uint64_t id,const segment& s) const {
+		return id < s.message;
+	}
+};
+
+send_queue::send_queue() 
+ : m_write_size(0),
+   m_message(0),
+   m_droppable(false),
+   m_priority_message(false),
+   m_started(0),
+   m_partial(0),
+   m_in_flight(0),
+   m_priority_in_flight(0),
+   m_size(0),
+   m_in_flight_size(0) {}
+
+uint64_t send_queue::begin_message(bool droppable,bool priority) {
+	m_droppable = droppable && !priority;
+	m_priority_message = priority;
+	return ++m_message;
+}
+
+void send_queue::append(const void* data,size_t len) {
+	if (len == 0) {
+		return;
+	}
+	
+	if (!m_copy_buffer) {
+		m_copy_buffer = buffer_pool::local().make_shared_buffer(
+			std::max(len,COPY_BUFFER_SIZE)
+		);
+	}
+	
+	// Segments refer to the copy buffer by offset, so growing it is safe as
+	// long as none of it is being written.
+	std::vector<unsigned char>& v = m_copy_buffer->get_data();
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	size_t offset = v.size();
+	
+	buffer_pool::local().reserve(v,offset+len);
+	v.insert(v.end(),p,p+len);
+	
+	push_segment(m_copy_buffer,offset,len);
+}
+
+void send_queue::push(const shared_buffer_ptr& buf,const unsigned char* data,
+                      size_t len) {
+	if (len < COPY_THRESHOLD) {
+		append(data,len);
+		return;
+	}
+	
+	push_segment(buf,data-&buf->get_data()[0],len);
+}
+
+void send_queue::push(const shared_buffer_ptr& buf) {
+	const std::vector<unsigned char>& v = buf->get_data();
+	
+	if (!v.empty()) {
+		push(buf,&v[0],v.size());
+	}
+}
+
+void send_queue::push_fragmented(const shared_buffer_ptr& buf,
+                                 const unsigned char* data,size_t len,
+                                 frame::opcode op,bool rsv1,
+                                 size_t frame_size) {
+	m_size += len;
+	
+	segment s;
+	s.buf = buf;
+	s.offset = data-&buf->get_data()[0];
+	s.len = len;
+	s.message = m_message;
+	s.droppable = m_droppable;
+	s.ends_frame = false;
+	s.frame_size = frame_size;
+	s.op = op;
+	s.rsv1 = rsv1;
+	(m_priority_message ? m_priority : m_segments).push_back(s);
+}
+
+bool send_queue::drop_message(uint64_t id) {
+	std::pair<std::deque<segment>::iterator,std::deque<segment>::iterator> r;
+	r = std::equal_range(m_segments.begin(),m_segments.end(),id,message_less());
+	
+	if (r.first == r.second || id == m_started ||
+	    static_cast<size_t>(r.first-m_segments.begin()) < m_in_flight) 
+	{
+		return false;
+	}
+	
+	for (std::deque<segment>::iterator it = r.first; it != r.second; ++it) {
+		m_size -= it->len;
+	}
+	
+	m_segments.erase(r.first,r.second);
+	return true;
+}
+
+bool send_queue::drop_oldest(uint64_t keep) {
+	for (size_t i = m_in_flight; i < m_segments.size(); i++) {
+		const segment& s = m_segments[i];
+		
+		if (!s.droppable || s.message == keep) {
+			continue;
+		}
+		
+		if (drop_message(s.message)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool send_queue::empty() const {
+	return m_segments.size() == m_in_flight && 
+	       m_priority.size() == m_priority_in_flight;
+}
+
+size_t send_queue::size() const {
+	return m_size;
+}
+
+size_t send_queue::in_flight_size() const {
+	return m_in_flight_size;
+}
+
+const std::vector<boost::asio::const_buffer>& send_queue::prepare_write() {
+	m_write_buffers.clear();
+	m_write_size = 0;
+	m_copy_buffer.reset();
+	
+	size_t i = m_in_flight;
+	
+	// A frame that has been partly written has to be finished before any
+	// other frame can start.
+	if (m_partial != 0) {
+		i = add_segments(m_segments,i,m_partial);
+	}
+	
+	m_priority_in_flight = add_segments(m_priority,m_priority_in_flight,0);
+	m_in_flight = add_segments(m_segments,i,0);
+	
+	// if no data went out the started message, if any, is where it was
+	if (m_in_flight > 0) {
+		m_started = 0;
+		m_partial = 0;
+		
+		if (m_in_flight < m_segments.size()) {
+			const segment& last = m_segments[m_in_flight-1];
+			
+			if (last.message == m_segments[m_in_flight].message) {
+				m_started = last.message;
+				
+				if (!last.ends_frame) {
+					m_partial = last.message;
+				}
+			}
+		}
+	}
+	
+	return m_write_buffers;
+}
+
+size_t send_queue::add_segments(std::deque<segment>& lane,size_t i,
+                                uint64_t only) {
+	const unsigned char* end = NULL;
+	
+	if (!m_write_buffers.empty()) {
+		end = boost::asio::buffer_cast<const unsigned char*>(m_write_buffers.back())
+		      + boost::asio::buffer_size(m_write_buffers.back());
+	}
+	
+	for (; i < lane.size() && m_write_size < MAX_WRITE_SIZE; i++) {
+		if (only != 0 && lane[i].message != only) {
+			break;
+		}
+		
+		if (lane[i].frame_size != 0) {
+			cut_frame(lane,i);
+		}
+		
+		const unsigned char* p = &lane[i].buf->get_data()[0] + lane[i].offset;
+		
+		if (p != end && m_write_buffers.size() == MAX_SEGMENTS) {
+			break;
+		}
+		
+		if (m_write_size + lane[i].len > MAX_WRITE_SIZE) {
+			// write what fits now and leave the rest as a new segment
+			segment rest = lane[i];
+			size_t n = MAX_WRITE_SIZE - m_write_size;
+			
+			rest.offset += n;
+			rest.len -= n;
+			lane[i].len = n;
+			lane[i].ends_frame = false;
+			lane.insert(lane.begin()+i+1,rest);
+		}
+		
+		const segment& s = lane[i];
+		
+		if (p == end) {
+			// continues the previous buffer
+			const boost::asio::const_buffer& b = m_write_buffers.back();
+			m_write_buffers.back() = boost::asio::const_buffer(
+				boost::asio::buffer_cast<const unsigned char*>(b),
+				boost::asio::buffer_size(b) + s.len
+			);
+		} else {
+			m_write_buffers.push_back(boost::asio::const_buffer(p,s.len));
+		}
+		
+		end = p + s.len;
+		m_size -= s.len;
+		m_in_flight_size += s.len;
+		m_write_size += s.len;
+		
+		if (only != 0 && s.ends_frame) {
+			return i+1;
+		}
+	}
+	
+	return i;
+}
+
+void send_queue::cut_frame(std::deque<segment>& lane,size_t i) {
+	segment payload = lane[i];
+	segment header = lane[i];
+	segment rest = lane[i];
+	
+	payload.len = std::min(rest.len,rest.frame_size);
+	payload.frame_size = 0;
+	payload.ends_frame = true;
+	
+	rest.offset += payload.len;
+	rest.len -= payload.len;
+	rest.op = frame::CONTINUATION_FRAME;
+	rest.rsv1 = false;
+	
+	if (!m_header_buffer || m_header_buffer->get_data().size() + 
+	    frame::MAX_HEADER_LENGTH > m_header_buffer->get_data().capacity())
+	{
+		m_header_buffer = buffer_pool::local().make_shared_buffer(
+			HEADER_BUFFER_SIZE
+		);
+	}
+	
+	std::vector<unsigned char>& v = m_header_buffer->get_data();
+	size_t offset = v.size();
+	
+	v.resize(offset+frame::MAX_HEADER_LENGTH);
+	unsigned int len = frame::write_header(
+		reinterpret_cast<char*>(&v[offset]),
+		rest.len == 0,
+		header.op,
+		payload.len,
+		header.rsv1
+	);
+	v.resize(offset+len);
+	
+	header.buf = m_header_buffer;
+	header.offset = offset;
+	header.len = len;
+	header.frame_size = 0;
+	m_size += len;
+	
+	lane[i] = header;
+	lane.insert(lane.begin()+i+1,payload);
+	
+	if (rest.len != 0) {
+		lane.insert(lane.begin()+i+2,rest);
+	}
+}
+
+void send_queue::finish_write() {
+	m_segments.erase(m_segments.begin(),m_segments.begin()+m_in_flight);
+	m_priority.erase(m_priority.begin(),m_priority.begin()+m_priority_in_flight);
+	m_write_buffers.clear();
+	m_in_flight = 0;
+	m_priority_in_flight = 0;
+	m_in_flight_size = 0;
+}
+
+void send_queue::clear() {
+	m_segments.clear();
+	m_priority.clear();
+	m_write_buffers.clear();
+	m_copy_buffer.reset();
+	m_started = 0;
+	m_partial = 0;
+	m_in_flight = 0;
+	m_priority_in_flight = 0;
+	m_size = 0;
+	m_in_flight_size = 0;
+}
+
+void send_queue::push_segment(const shared_buffer_ptr& buf,size_t offset,
+                              size_t len) {
+	m_size += len;
+	
+	std::deque<segment>& lane = m_priority_message ? m_priority : m_segments;
+	size_t in_flight = m_priority_message ? m_priority_in_flight : m_in_flight;
+	
+	// extend the last segment if this carries straight on from it
+	if (lane.size() > in_flight) {
+		segment& last = lane.back();
+		
+		if (last.buf == buf && last.message == m_message && 
+		    last.frame_size == 0 &&
+		    last.offset+last.len == offset) 
+		{
+			last.len += len;
+			return;
+		}
+	}
+	
+	segment s;
+	s.buf = buf;
+	s.offset = offset;
+	s.len = len;
+	s.message = m_message;
+	s.droppable = m_droppable;
+	s.ends_frame = false;
+	s.frame_size = 0;
+	s.op = frame::CONTINUATION_FRAME;
+	s.rsv1 = false;
+	lane.push_back(s);
+}
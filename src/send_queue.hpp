@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SEND_QUEUE_HPP
+#define SEND_QUEUE_HPP
+
+#include "buffer_pool.hpp"
+#include "websocket_frame.hpp"
+
+#include <boost/asio/buffer.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Outgoing data for one connection, as a list of segments that is written
+// with a single gathering write.
+//
+// Frame headers and small payloads are copied into a session owned buffer,
+// so runs of small frames still go out as one segment. Payloads of 
+// COPY_THRESHOLD bytes or more are queued by reference to the shared buffer
+// that holds them and are never copied.
+//
+// Data is grouped into messages so that a message that hasn't started to be
+// written yet can be dropped again, which is how the slow consumer policies
+// shed load.
+//
+// Priority messages (pings and pongs) go in a separate lane that is written
+// ahead of all queued data, except for the rest of a frame that has already
+// been partly written. Writes are limited to MAX_WRITE_SIZE bytes so that a
+// priority message never waits behind more than that. Large messages can be
+// queued as a payload that is cut into frames as it is written, which lets
+// priority messages in between the frames.
+class send_queue {
+public:
+	// Payloads smaller than this are cheaper to copy than to give their own
+	// segment.
+	static const size_t COPY_THRESHOLD = 512;
+	
+	// Most buffers handed to one write. Boost.Asio passes at most 64 buffers
+	// to a single writev, so more than that would only be split across 
+	// several system calls anyway.
+	static const size_t MAX_SEGMENTS = 64;
+	
+	// Most bytes handed to one write. Larger segments are written in pieces.
+	static const size_t MAX_WRITE_SIZE = 65536;
+	
+	// Initial size of the buffers that copied data is gathered into.
+	static const size_t COPY_BUFFER_SIZE = 4096;
+	
+	// Size of the buffers that headers of fragmented messages are written 
+	// into.
+	static const size_t HEADER_BUFFER_SIZE = 1024;
+	
+	send_queue();
+	
+	// Starts a new message and returns its id. Data appended or pushed until
+	// the next call belongs to it. Messages that are not droppable (control 
+	// frames, HTTP responses) are never removed by drop_oldest. Priority
+	// messages are never droppable.
+	uint64_t begin_message(bool droppable,bool priority = false);
+	
+	// Copies len bytes onto the end of the queue.
+	void append(const void* data,size_t len);
+	
+	// Queues len bytes at data, which must belong to buf and must not be
+	// changed while the queue holds the reference.
+	void push(const shared_buffer_ptr& buf,const unsigned char* data,size_t len);
+	
+	// Queues the whole of buf.
+	void push(const shared_buffer_ptr& buf);
+	
+	// Queues len bytes at data as the payload of an unmasked message that is
+	// sent as frames of at most frame_size bytes. The frame headers are 
+	// written as the frames are. rsv1 is set on the first frame. data must
+	// belong to buf as for push.
+	void push_fragmented(const shared_buffer_ptr& buf,const unsigned char* data,
+	                     size_t len,frame::opcode op,bool rsv1,
+	                     size_t frame_size);
+	
+	// Removes a message that hasn't started to be written. Returns false if
+	// any of it has been or is being written, or if it is gone.
+	bool drop_message(uint64_t id);
+	
+	// Removes the oldest droppable message, other than keep, that hasn't 
+	// started to be written. Returns false if there is none.
+	bool drop_oldest(uint64_t keep);
+	
+	// true if there is nothing waiting to be written
+	bool empty() const;
+	
+	// bytes waiting to be written, not counting a write in progress
+	size_t size() const;
+	
+	// bytes in the write in progress
+	size_t in_flight_size() const;
+	
+	// Moves up to MAX_SEGMENTS buffers and MAX_WRITE_SIZE bytes from the 
+	// front of the queue into the next write and returns them. They stay 
+	// valid until finish_write is called. Only one write may be in progress
+	// at a time.
+	const std::vector<boost::asio::const_buffer>& prepare_write();
+	
+	// Drops the segments of the write in progress.
+	void finish_write();
+	
+	// Drops everything, including a write in progress.
+	void clear();
+private:
+	struct segment {
+		shared_buffer_ptr	buf;
+		size_t				offset;
+		size_t				len;
+		uint64_t			message;
+		bool				droppable;
+		
+		// A frame of a fragmented message ends after this segment.
+		bool				ends_frame;
+		
+		// If not zero the segment is payload still to be cut into frames of
+		// this size, the next of which has opcode op and RSV1 bit rsv1.
+		size_t				frame_size;
+		frame::opcode		op;
+		bool				rsv1;
+	};
+	
+	struct message_less;
+	
+	void push_segment(const shared_buffer_ptr& buf,size_t offset,size_t len);
+	
+	// Adds segments of lane, starting at index i, to the write until a limit
+	// is reached or, if only is not zero, a segment of another message is.
+	// Returns the index of the first segment not added.
+	size_t add_segments(std::deque<segment>& lane,size_t i,uint64_t only);
+	
+	// Replaces the fragmented payload at lane[i] with the header and payload
+	// of its next frame, followed by what is left of it.
+	void cut_frame(std::deque<segment>& lane,size_t i);
+	
+	std::deque<segment>						m_segments;
+	std::deque<segment>						m_priority;
+	std::vector<boost::asio::const_buffer>	m_write_buffers;
+	size_t									m_write_size;
+	
+	// Buffer that copied data is currently appended to. It is retired once
+	// any of it is written.
+	shared_buffer_ptr	m_copy_buffer;
+	
+	// Buffer that frame headers are written into by cut_frame. It is never 
+	// grown so that headers in a write stay put.
+	shared_buffer_ptr	m_header_buffer;
+	
+	uint64_t	m_message;
+	bool		m_droppable;
+	bool		m_priority_message;
+	
+	// Data message that has been partly written. Its remaining segments are
+	// at the front of m_segments. If m_partial is set the last write ended 
+	// in the middle of one of its frames, and the rest of that frame must be
+	// written before anything else.
+	uint64_t	m_started;
+	uint64_t	m_partial;
+	
+	// The first m_in_flight segments of m_segments and m_priority_in_flight
+	// of m_priority belong to the write in progress.
+	size_t	m_in_flight;
+	size_t	m_priority_in_flight;
+	size_t	m_size;
+	size_t	m_in_flight_size;
+};
+
+}
+
+#endif // SEND_QUEUE_HPP
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "cpu_features.hpp"
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+using websocketpp::simd::cpu_features;
+
+namespace {
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r,leaf,subleaf);
+	for (int i = 0; i < 4; i++) {
+		regs[i] = static_cast<unsigned int>(r[i]);
+	}
+#else
+	__cpuid_count(leaf,subleaf,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+// Reads the extended control register that tells us which register files
+// the operating system saves on a context switch.
+unsigned long long xgetbv0() {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int lo,hi;
+	__asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+cpu_features detect() {
+	cpu_features f;
+
+	f.sse2 = false;
+	f.ssse3 = false;
+	f.sse41 = false;
+	f.avx2 = false;
+	f.sha = false;
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+	unsigned int r[4];
+
+	cpuid(0,0,r);
+	unsigned int max_leaf = r[0];
+
+	if (max_leaf < 1) {
+		return f;
+	}
+
+	cpuid(1,0,r);
+	f.sse2 = (r[3] & (1u << 26)) != 0;
+	f.ssse3 = (r[2] & (1u << 9)) != 0;
+	f.sse41 = (r[2] & (1u << 19)) != 0;
+
+	// AVX state must be enabled by the OS (OSXSAVE set and XCR0 saving both
+	// the XMM and YMM registers) before any AVX instruction may be used.
+	bool os_avx = false;
+	if ((r[2] & (1u << 27)) && (r[2] & (1u << 28))) {
+		os_avx = (xgetbv0() & 0x6) == 0x6;
+	}
+
+	if (max_leaf >= 7) {
+		cpuid(7,0,r);
+		f.avx2 = os_avx && (r[1] & (1u << 5)) != 0;
+		f.sha = f.sse41 && (r[1] & (1u << 29)) != 0;
+	}
+#endif
+
+	return f;
+}
+
+}
+
+const cpu_features& websocketpp::simd::get_cpu_features() {
+	static const cpu_features features = detect();
+	return features;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_SIMD_CPU_FEATURES_HPP
+#define WEBSOCKETPP_SIMD_CPU_FEATURES_HPP
+
+// WEBSOCKETPP_SIMD_X86 is defined when the vector kernels for x86 processors
+// are compiled in. Define WEBSOCKETPP_NO_SIMD to build only the portable
+// scalar versions.
+#if !defined(WEBSOCKETPP_NO_SIMD) && \
+    (defined(__x86_64__) || defined(__i386__) || \
+     defined(_M_X64) || defined(_M_IX86))
+	#define WEBSOCKETPP_SIMD_X86
+#endif
+
+// Kernels that use instructions beyond the compiler's baseline are marked
+// with these so they can live in the same translation unit as the portable
+// code. MSVC allows intrinsics anywhere and needs no annotation.
+#if defined(WEBSOCKETPP_SIMD_X86) && defined(__GNUC__)
+	#define WEBSOCKETPP_TARGET_SSE2 __attribute__((target("sse2")))
+	#define WEBSOCKETPP_TARGET_SSE41 __attribute__((target("sse4.1")))
+	#define WEBSOCKETPP_TARGET_AVX2 __attribute__((target("avx2")))
+	#define WEBSOCKETPP_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#else
+	#define WEBSOCKETPP_TARGET_SSE2
+	#define WEBSOCKETPP_TARGET_SSE41
+	#define WEBSOCKETPP_TARGET_AVX2
+	#define WEBSOCKETPP_TARGET_SHA
+#endif
+
+namespace websocketpp {
+namespace simd {
+
+// Instruction set extensions that kernels may dispatch on. A feature is only
+// reported when both the processor and the operating system support it.
+struct cpu_features {
+	bool sse2;
+	bool ssse3;
+	bool sse41;
+	bool avx2;
+	bool sha;
+};
+
+// Returns the features of the processor we are running on. Detection is done
+// once, the first time this is called.
+const cpu_features& get_cpu_features();
+
+} // namespace simd
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_SIMD_CPU_FEATURES_HPP
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "masking.hpp"
+
+#include <boost/atomic.hpp>
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace simd = websocketpp::simd;
+
+namespace {
+
+// Below this size the vector kernels hand off to mask_word. Its loop is
+// already compiled to vector instructions by most compilers and it has no
+// setup cost, so it wins for the small frames that dominate chat traffic.
+const size_t VECTOR_THRESHOLD = 256;
+
+// Below this size the vector kernels use unaligned stores throughout. Above
+// it, lining dst up first keeps stores from splitting cache lines, which is
+// worth the scalar prologue.
+const size_t ALIGN_THRESHOLD = 4096;
+
+// Masks bytes one at a time until dst is aligned to a multiple of align or
+// the data runs out. Advances all of the cursors.
+inline void mask_until_aligned(const unsigned char*& src,unsigned char*& dst,
+                               size_t& len,const char* key,size_t& key_index,
+                               size_t align)
+{
+	while (len > 0 && (reinterpret_cast<uintptr_t>(dst) & (align-1)) != 0) {
+		*dst++ = *src++ ^ static_cast<unsigned char>(key[key_index]);
+		key_index = (key_index+1) & 3;
+		len--;
+	}
+}
+
+simd::mask_kernel select_mask_kernel();
+
+size_t mask_resolve(const unsigned char* src,unsigned char* dst,size_t len,
+                    const char* key,size_t key_index);
+
+// mask() jumps through this pointer. It starts out pointing at a resolver
+// that runs CPUID, swaps in the real kernel and forwards the call. Racing
+// threads all store the same value, so relaxed ordering is enough; the
+// pointer is atomic only so that those stores are not a data race.
+boost::atomic<simd::mask_kernel> g_mask_kernel(&mask_resolve);
+
+size_t mask_resolve(const unsigned char* src,unsigned char* dst,size_t len,
+                    const char* key,size_t key_index)
+{
+	simd::mask_kernel k = select_mask_kernel();
+	g_mask_kernel.store(k,boost::memory_order_relaxed);
+	return k(src,dst,len,key,key_index);
+}
+
+simd::mask_kernel select_mask_kernel() {
+#if defined(WEBSOCKETPP_SIMD_X86)
+	const simd::cpu_features& f = simd::get_cpu_features();
+
+	if (f.avx2) {
+		return &simd::mask_avx2;
+	}
+	if (f.sse2) {
+		return &simd::mask_sse2;
+	}
+#endif
+	return &simd::mask_word;
+}
+
+}
+
+size_t simd::mask(const unsigned char* src,unsigned char* dst,size_t len,
+                  const char* key,size_t key_index)
+{
+	mask_kernel k = g_mask_kernel.load(boost::memory_order_relaxed);
+	return k(src,dst,len,key,key_index & 3);
+}
+
+const char* simd::get_mask_kernel_name() {
+	mask_kernel k = select_mask_kernel();
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (k == &mask_avx2) {
+		return "avx2";
+	}
+	if (k == &mask_sse2) {
+		return "sse2";
+	}
+#endif
+	if (k == &mask_word) {
+		return "word";
+	}
+	return "scalar";
+}
+
+size_t simd::mask_scalar(const unsigned char* src,unsigned char* dst,
+                         size_t len,const char* key,size_t key_index)
+{
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = src[i] ^ static_cast<unsigned char>(key[(key_index+i) & 3]);
+	}
+	return (key_index+len) & 3;
+}
+
+size_t simd::mask_word(const unsigned char* src,unsigned char* dst,
+                       size_t len,const char* key,size_t key_index)
+{
+	const size_t end_index = (key_index+len) & 3;
+
+	const uint64_t k32 = simd::rotate_key(key,key_index);
+	const uint64_t k = (k32 << 32) | k32;
+
+	// memcpy keeps this free of alignment and aliasing assumptions about src
+	// and dst, compilers turn it into plain (unaligned) loads and stores.
+	while (len >= 4*sizeof(uint64_t)) {
+		uint64_t w[4];
+		std::memcpy(w,src,sizeof(w));
+		w[0] ^= k;
+		w[1] ^= k;
+		w[2] ^= k;
+		w[3] ^= k;
+		std::memcpy(dst,w,sizeof(w));
+
+		src += sizeof(w);
+		dst += sizeof(w);
+		len -= sizeof(w);
+	}
+
+	while (len >= sizeof(uint64_t)) {
+		uint64_t w;
+		std::memcpy(&w,src,sizeof(w));
+		w ^= k;
+		std::memcpy(dst,&w,sizeof(w));
+
+		src += sizeof(w);
+		dst += sizeof(w);
+		len -= sizeof(w);
+	}
+
+	while (len > 0) {
+		*dst++ = *src++ ^ static_cast<unsigned char>(key[key_index]);
+		key_index = (key_index+1) & 3;
+		len--;
+	}
+
+	return end_index;
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+
+WEBSOCKETPP_TARGET_SSE2
+size_t simd::mask_sse2(const unsigned char* src,unsigned char* dst,
+                       size_t len,const char* key,size_t key_index)
+{
+	if (len < VECTOR_THRESHOLD) {
+		return mask_word(src,dst,len,key,key_index);
+	}
+
+	const size_t end_index = (key_index+len) & 3;
+
+	if (len >= ALIGN_THRESHOLD) {
+		mask_until_aligned(src,dst,len,key,key_index,16);
+	}
+
+	const __m128i k = _mm_set1_epi32(static_cast<int>(simd::rotate_key(key,key_index)));
+
+	while (len >= 64) {
+		const __m128i* s = reinterpret_cast<const __m128i*>(src);
+		__m128i* d = reinterpret_cast<__m128i*>(dst);
+
+		__m128i a = _mm_loadu_si128(s);
+		__m128i b = _mm_loadu_si128(s+1);
+		__m128i c = _mm_loadu_si128(s+2);
+		__m128i e = _mm_loadu_si128(s+3);
+		_mm_storeu_si128(d,_mm_xor_si128(a,k));
+		_mm_storeu_si128(d+1,_mm_xor_si128(b,k));
+		_mm_storeu_si128(d+2,_mm_xor_si128(c,k));
+		_mm_storeu_si128(d+3,_mm_xor_si128(e,k));
+
+		src += 64;
+		dst += 64;
+		len -= 64;
+	}
+
+	while (len >= 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst),_mm_xor_si128(a,k));
+
+		src += 16;
+		dst += 16;
+		len -= 16;
+	}
+
+	mask_word(src,dst,len,key,key_index);
+
+	return end_index;
+}
+
+WEBSOCKETPP_TARGET_AVX2
+size_t simd::mask_avx2(const unsigned char* src,unsigned char* dst,
+                       size_t len,const char* key,size_t key_index)
+{
+	if (len < VECTOR_THRESHOLD) {
+		return mask_word(src,dst,len,key,key_index);
+	}
+
+	const size_t end_index = (key_index+len) & 3;
+
+	if (len >= ALIGN_THRESHOLD) {
+		mask_until_aligned(src,dst,len,key,key_index,32);
+	}
+
+	const __m256i k = _mm256_set1_epi32(static_cast<int>(simd::rotate_key(key,key_index)));
+
+	while (len >= 128) {
+		const __m256i* s = reinterpret_cast<const __m256i*>(src);
+		__m256i* d = reinterpret_cast<__m256i*>(dst);
+
+		__m256i a = _mm256_loadu_si256(s);
+		__m256i b = _mm256_loadu_si256(s+1);
+		__m256i c = _mm256_loadu_si256(s+2);
+		__m256i e = _mm256_loadu_si256(s+3);
+		_mm256_storeu_si256(d,_mm256_xor_si256(a,k));
+		_mm256_storeu_si256(d+1,_mm256_xor_si256(b,k));
+		_mm256_storeu_si256(d+2,_mm256_xor_si256(c,k));
+		_mm256_storeu_si256(d+3,_mm256_xor_si256(e,k));
+
+		src += 128;
+		dst += 128;
+		len -= 128;
+	}
+
+	while (len >= 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),_mm256_xor_si256(a,k));
+
+		src += 32;
+		dst += 32;
+		len -= 32;
+	}
+
+	// Leave the upper halves of the ymm registers clean. Otherwise the
+	// next piece of legacy SSE code to run, here or in the caller, pays a
+	// large state transition penalty.
+	_mm256_zeroupper();
+
+	mask_word(src,dst,len,key,key_index);
+
+	return end_index;
+}
+
+#endif // WEBSOCKETPP_SIMD_X86
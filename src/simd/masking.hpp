@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_SIMD_MASKING_HPP
+#define WEBSOCKETPP_SIMD_MASKING_HPP
+
+#include "cpu_features.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include <stdint.h>
+
+namespace websocketpp {
+namespace simd {
+
+// A masking kernel XORs len bytes from src with the repeating four byte key
+// and writes the result to dst. Masking is its own inverse so the same kernel
+// unmasks. src and dst may point to the same buffer but must not otherwise
+// overlap. Neither pointer needs any particular alignment.
+//
+// key_index is the position in key of the byte that applies to src[0]. The
+// return value is the position for the byte following the last one processed
+// so a payload that arrives in pieces can be masked as it streams in.
+typedef size_t (*mask_kernel)(const unsigned char* src,
+                              unsigned char* dst,
+                              size_t len,
+                              const char* key,
+                              size_t key_index);
+
+// Masks using the fastest kernel the running processor supports. The kernel
+// is chosen by CPUID the first time this is called.
+size_t mask(const unsigned char* src,
+            unsigned char* dst,
+            size_t len,
+            const char* key,
+            size_t key_index = 0);
+
+// Name of the kernel that mask() dispatches to ("scalar", "word", "sse2" or
+// "avx2").
+const char* get_mask_kernel_name();
+
+// Returns the key rotated so that its first byte is the one at key_index, as
+// it would be loaded from memory. Because every word and vector width the
+// kernels use is a multiple of four, a key broadcast from this value stays
+// lined up with the data for as long as they advance in whole words.
+inline uint32_t rotate_key(const char* key,size_t key_index) {
+	unsigned char kb[4];
+	for (size_t i = 0; i < 4; i++) {
+		kb[i] = static_cast<unsigned char>(key[(key_index+i) & 3]);
+	}
+	uint32_t k;
+	std::memcpy(&k,kb,sizeof(k));
+	return k;
+}
+
+// Individual kernels. These are exposed for testing and benchmarking, the
+// frame code should always call mask().
+
+// Byte at a time reference implementation.
+size_t mask_scalar(const unsigned char* src,unsigned char* dst,size_t len,
+                   const char* key,size_t key_index);
+
+// Portable 64 bit word at a time version.
+size_t mask_word(const unsigned char* src,unsigned char* dst,size_t len,
+                 const char* key,size_t key_index);
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+size_t mask_sse2(const unsigned char* src,unsigned char* dst,size_t len,
+                 const char* key,size_t key_index);
+
+// Only valid when get_cpu_features().avx2 is true.
+size_t mask_avx2(const unsigned char* src,unsigned char* dst,size_t len,
+                 const char* key,size_t key_index);
+#endif
+
+} // namespace simd
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_SIMD_MASKING_HPP
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sha1_kernels.hpp"
+
+#include <boost/atomic.hpp>
+
+#include <cstring>
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace simd = websocketpp::simd;
+
+namespace {
+
+inline uint32_t rol(uint32_t x,int n) {
+	return (x << n) | (x >> (32-n));
+}
+
+inline uint32_t load_be32(const unsigned char* p) {
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | 
+	       (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void store_be32(unsigned char* p,uint32_t v) {
+	p[0] = static_cast<unsigned char>(v >> 24);
+	p[1] = static_cast<unsigned char>(v >> 16);
+	p[2] = static_cast<unsigned char>(v >> 8);
+	p[3] = static_cast<unsigned char>(v);
+}
+
+simd::sha1_kernel select_sha1_kernel();
+
+void sha1_resolve(uint32_t state[5],const unsigned char* data,size_t blocks);
+
+// sha1() calls through this pointer, which starts out at a resolver in the
+// same way as the masking kernels.
+boost::atomic<simd::sha1_kernel> g_sha1_kernel(&sha1_resolve);
+
+void sha1_resolve(uint32_t state[5],const unsigned char* data,size_t blocks) {
+	simd::sha1_kernel k = select_sha1_kernel();
+	g_sha1_kernel.store(k,boost::memory_order_relaxed);
+	k(state,data,blocks);
+}
+
+simd::sha1_kernel select_sha1_kernel() {
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (simd::get_cpu_features().sha) {
+		return &simd::sha1_sha;
+	}
+#endif
+	return &simd::sha1_scalar;
+}
+
+}
+
+void simd::sha1(const unsigned char* data,size_t len,unsigned char digest[20]) {
+	sha1(data,len,digest,g_sha1_kernel.load(boost::memory_order_relaxed));
+}
+
+void simd::sha1(const unsigned char* data,size_t len,unsigned char digest[20],
+                sha1_kernel kernel) {
+	uint32_t state[5] = {
+		0x67452301,0xEFCDAB89,0x98BADCFE,0x10325476,0xC3D2E1F0
+	};
+	
+	size_t blocks = len/64;
+	
+	if (blocks > 0) {
+		kernel(state,data,blocks);
+	}
+	
+	// The rest of the data, the 0x80 marker and the length in bits take one
+	// more block, or two if they don't fit in one.
+	unsigned char tail[128];
+	size_t rest = len-blocks*64;
+	size_t tail_size = (rest < 56 ? 64 : 128);
+	
+	std::memcpy(tail,data+blocks*64,rest);
+	tail[rest] = 0x80;
+	std::memset(tail+rest+1,0,tail_size-rest-9);
+	
+	uint64_t bits = uint64_t(len) << 3;
+	store_be32(tail+tail_size-8,static_cast<uint32_t>(bits >> 32));
+	store_be32(tail+tail_size-4,static_cast<uint32_t>(bits));
+	
+	kernel(state,tail,tail_size/64);
+	
+	for (size_t i = 0; i < 5; i++) {
+		store_be32(digest+4*i,state[i]);
+	}
+}
+
+const char* simd::get_sha1_kernel_name() {
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (select_sha1_kernel() == &sha1_sha) {
+		return "sha";
+	}
+#endif
+	return "scalar";
+}
+
+// The schedule is kept as a ring of the last 16 words.
+#define SHA1_W(i) (w[(i) & 15] = rol(w[((i)+13) & 15] ^ w[((i)+8) & 15] ^ \
+                                     w[((i)+2) & 15] ^ w[(i) & 15],1))
+
+#define SHA1_R0(a,b,c,d,e,i) \
+	e += ((b & (c ^ d)) ^ d) + w[i] + 0x5A827999 + rol(a,5); b = rol(b,30);
+#define SHA1_R1(a,b,c,d,e,i) \
+	e += ((b & (c ^ d)) ^ d) + SHA1_W(i) + 0x5A827999 + rol(a,5); b = rol(b,30);
+#define SHA1_R2(a,b,c,d,e,i) \
+	e += (b ^ c ^ d) + SHA1_W(i) + 0x6ED9EBA1 + rol(a,5); b = rol(b,30);
+#define SHA1_R3(a,b,c,d,e,i) \
+	e += (((b | c) & d) | (b & c)) + SHA1_W(i) + 0x8F1BBCDC + rol(a,5); \
+	b = rol(b,30);
+#define SHA1_R4(a,b,c,d,e,i) \
+	e += (b ^ c ^ d) + SHA1_W(i) + 0xCA62C1D6 + rol(a,5); b = rol(b,30);
+
+// Five rounds, after which the variables are back in their starting roles.
+#define SHA1_ROUNDS5(R,i) \
+	R(a,b,c,d,e,(i)) R(e,a,b,c,d,(i)+1) R(d,e,a,b,c,(i)+2) \
+	R(c,d,e,a,b,(i)+3) R(b,c,d,e,a,(i)+4)
+
+void simd::sha1_scalar(uint32_t state[5],const unsigned char* data,
+                       size_t blocks) {
+	for (; blocks > 0; blocks--, data += 64) {
+		uint32_t w[16];
+		
+		for (size_t i = 0; i < 16; i++) {
+			w[i] = load_be32(data+4*i);
+		}
+		
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+		
+		SHA1_ROUNDS5(SHA1_R0,0)
+		SHA1_ROUNDS5(SHA1_R0,5)
+		SHA1_ROUNDS5(SHA1_R0,10)
+		SHA1_R0(a,b,c,d,e,15) SHA1_R1(e,a,b,c,d,16) SHA1_R1(d,e,a,b,c,17)
+		SHA1_R1(c,d,e,a,b,18) SHA1_R1(b,c,d,e,a,19)
+		
+		SHA1_ROUNDS5(SHA1_R2,20)
+		SHA1_ROUNDS5(SHA1_R2,25)
+		SHA1_ROUNDS5(SHA1_R2,30)
+		SHA1_ROUNDS5(SHA1_R2,35)
+		
+		SHA1_ROUNDS5(SHA1_R3,40)
+		SHA1_ROUNDS5(SHA1_R3,45)
+		SHA1_ROUNDS5(SHA1_R3,50)
+		SHA1_ROUNDS5(SHA1_R3,55)
+		
+		SHA1_ROUNDS5(SHA1_R4,60)
+		SHA1_ROUNDS5(SHA1_R4,65)
+		SHA1_ROUNDS5(SHA1_R4,70)
+		SHA1_ROUNDS5(SHA1_R4,75)
+		
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+#undef SHA1_W
+#undef SHA1_R0
+#undef SHA1_R1
+#undef SHA1_R2
+#undef SHA1_R3
+#undef SHA1_R4
+#undef SHA1_ROUNDS5
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+
+// Four rounds at a time with the SHA extensions. e is carried in the top
+// lane of e0/e1, which take turns holding the value for the next rounds
+// while the other is saved from abcd. Message words for later rounds are
+// computed alongside in msg0 to msg3.
+WEBSOCKETPP_TARGET_SHA
+void simd::sha1_sha(uint32_t state[5],const unsigned char* data,
+                    size_t blocks) {
+	const __m128i swap = _mm_set_epi64x(0x0001020304050607LL,
+	                                    0x08090a0b0c0d0e0fLL);
+	
+	__m128i abcd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+	__m128i e0 = _mm_set_epi32(static_cast<int>(state[4]),0,0,0);
+	abcd = _mm_shuffle_epi32(abcd,0x1B);
+	
+	for (; blocks > 0; blocks--, data += 64) {
+		const __m128i* p = reinterpret_cast<const __m128i*>(data);
+		__m128i abcd_save = abcd;
+		__m128i e0_save = e0;
+		__m128i e1;
+		
+		// rounds 0-3
+		__m128i msg0 = _mm_shuffle_epi8(_mm_loadu_si128(p),swap);
+		e0 = _mm_add_epi32(e0,msg0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,0);
+		
+		// rounds 4-7
+		__m128i msg1 = _mm_shuffle_epi8(_mm_loadu_si128(p+1),swap);
+		e1 = _mm_sha1nexte_epu32(e1,msg1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,0);
+		msg0 = _mm_sha1msg1_epu32(msg0,msg1);
+		
+		// rounds 8-11
+		__m128i msg2 = _mm_shuffle_epi8(_mm_loadu_si128(p+2),swap);
+		e0 = _mm_sha1nexte_epu32(e0,msg2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,0);
+		msg1 = _mm_sha1msg1_epu32(msg1,msg2);
+		msg0 = _mm_xor_si128(msg0,msg2);
+		
+		// rounds 12-15
+		__m128i msg3 = _mm_shuffle_epi8(_mm_loadu_si128(p+3),swap);
+		e1 = _mm_sha1nexte_epu32(e1,msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0,msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,0);
+		msg2 = _mm_sha1msg1_epu32(msg2,msg3);
+		msg1 = _mm_xor_si128(msg1,msg3);
+		
+		// rounds 16-19
+		e0 = _mm_sha1nexte_epu32(e0,msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1,msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,0);
+		msg3 = _mm_sha1msg1_epu32(msg3,msg0);
+		msg2 = _mm_xor_si128(msg2,msg0);
+		
+		// rounds 20-23
+		e1 = _mm_sha1nexte_epu32(e1,msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2,msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,1);
+		msg0 = _mm_sha1msg1_epu32(msg0,msg1);
+		msg3 = _mm_xor_si128(msg3,msg1);
+		
+		// rounds 24-27
+		e0 = _mm_sha1nexte_epu32(e0,msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3,msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,1);
+		msg1 = _mm_sha1msg1_epu32(msg1,msg2);
+		msg0 = _mm_xor_si128(msg0,msg2);
+		
+		// rounds 28-31
+		e1 = _mm_sha1nexte_epu32(e1,msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0,msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,1);
+		msg2 = _mm_sha1msg1_epu32(msg2,msg3);
+		msg1 = _mm_xor_si128(msg1,msg3);
+		
+		// rounds 32-35
+		e0 = _mm_sha1nexte_epu32(e0,msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1,msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,1);
+		msg3 = _mm_sha1msg1_epu32(msg3,msg0);
+		msg2 = _mm_xor_si128(msg2,msg0);
+		
+		// rounds 36-39
+		e1 = _mm_sha1nexte_epu32(e1,msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2,msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,1);
+		msg0 = _mm_sha1msg1_epu32(msg0,msg1);
+		msg3 = _mm_xor_si128(msg3,msg1);
+		
+		// rounds 40-43
+		e0 = _mm_sha1nexte_epu32(e0,msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3,msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,2);
+		msg1 = _mm_sha1msg1_epu32(msg1,msg2);
+		msg0 = _mm_xor_si128(msg0,msg2);
+		
+		// rounds 44-47
+		e1 = _mm_sha1nexte_epu32(e1,msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0,msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,2);
+		msg2 = _mm_sha1msg1_epu32(msg2,msg3);
+		msg1 = _mm_xor_si128(msg1,msg3);
+		
+		// rounds 48-51
+		e0 = _mm_sha1nexte_epu32(e0,msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1,msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,2);
+		msg3 = _mm_sha1msg1_epu32(msg3,msg0);
+		msg2 = _mm_xor_si128(msg2,msg0);
+		
+		// rounds 52-55
+		e1 = _mm_sha1nexte_epu32(e1,msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2,msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,2);
+		msg0 = _mm_sha1msg1_epu32(msg0,msg1);
+		msg3 = _mm_xor_si128(msg3,msg1);
+		
+		// rounds 56-59
+		e0 = _mm_sha1nexte_epu32(e0,msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3,msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,2);
+		msg1 = _mm_sha1msg1_epu32(msg1,msg2);
+		msg0 = _mm_xor_si128(msg0,msg2);
+		
+		// rounds 60-63
+		e1 = _mm_sha1nexte_epu32(e1,msg3);
+		e0 = abcd;
+		msg0 = _mm_sha1msg2_epu32(msg0,msg3);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,3);
+		msg2 = _mm_sha1msg1_epu32(msg2,msg3);
+		msg1 = _mm_xor_si128(msg1,msg3);
+		
+		// rounds 64-67
+		e0 = _mm_sha1nexte_epu32(e0,msg0);
+		e1 = abcd;
+		msg1 = _mm_sha1msg2_epu32(msg1,msg0);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,3);
+		msg3 = _mm_sha1msg1_epu32(msg3,msg0);
+		msg2 = _mm_xor_si128(msg2,msg0);
+		
+		// rounds 68-71
+		e1 = _mm_sha1nexte_epu32(e1,msg1);
+		e0 = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2,msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,3);
+		msg3 = _mm_xor_si128(msg3,msg1);
+		
+		// rounds 72-75
+		e0 = _mm_sha1nexte_epu32(e0,msg2);
+		e1 = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3,msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd,e0,3);
+		
+		// rounds 76-79
+		e1 = _mm_sha1nexte_epu32(e1,msg3);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd,e1,3);
+		
+		e0 = _mm_sha1nexte_epu32(e0,e0_save);
+		abcd = _mm_add_epi32(abcd,abcd_save);
+	}
+	
+	abcd = _mm_shuffle_epi32(abcd,0x1B);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(state),abcd);
+	state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0,3));
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_SIMD_SHA1_KERNELS_HPP
+#define WEBSOCKETPP_SIMD_SHA1_KERNELS_HPP
+
+#include "cpu_features.hpp"
+
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace websocketpp {
+namespace simd {
+
+// A SHA-1 kernel runs the compression function over a number of 64 byte
+// blocks of data, updating the five word state in place.
+typedef void (*sha1_kernel)(uint32_t state[5],
+                            const unsigned char* data,
+                            size_t blocks);
+
+// Writes the 20 byte SHA-1 digest of len bytes of data to digest, using the
+// fastest kernel the running processor supports. The kernel is chosen by
+// CPUID the first time this is called.
+void sha1(const unsigned char* data,size_t len,unsigned char digest[20]);
+
+// the same with a particular kernel
+void sha1(const unsigned char* data,size_t len,unsigned char digest[20],
+          sha1_kernel kernel);
+
+// Name of the kernel that sha1() dispatches to ("scalar" or "sha").
+const char* get_sha1_kernel_name();
+
+// Individual kernels. These are exposed for testing and benchmarking, 
+// everything else should call sha1().
+
+// Portable version with all 80 rounds unrolled.
+void sha1_scalar(uint32_t state[5],const unsigned char* data,size_t blocks);
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+// Only valid when get_cpu_features().sha is true.
+void sha1_sha(uint32_t state[5],const unsigned char* data,size_t blocks);
+#endif
+
+} // namespace simd
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_SIMD_SHA1_KERNELS_HPP
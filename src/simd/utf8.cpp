@@ -0,0 +1,582 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "utf8.hpp"
+#include "masking.hpp"
+
+#include "../utf8_validator/utf8_validator.hpp"
+
+#include <boost/atomic.hpp>
+
+#include <cstring>
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace simd = websocketpp::simd;
+
+namespace {
+
+// Runs the DFA from begin to end. Stops early on an invalid byte. The decoder
+// state is kept in locals for the length of the run rather than going through
+// the pointers for every byte as utf8_validator::decode does.
+inline bool run_dfa(const unsigned char* begin,const unsigned char* end,
+                    uint32_t* state,uint32_t* codep) {
+	using utf8_validator::utf8d;
+	
+	uint32_t s = *state;
+	uint32_t c = *codep;
+	
+	for (; begin != end; ++begin) {
+		uint32_t byte = *begin;
+		uint32_t type = utf8d[byte];
+		
+		c = (s != utf8_validator::UTF8_ACCEPT) ? 
+			(byte & 0x3fu) | (c << 6) : 
+			(0xff >> type) & byte;
+		s = utf8d[256 + s*16 + type];
+		
+		if (s == utf8_validator::UTF8_REJECT) {
+			break;
+		}
+	}
+	
+	*state = s;
+	*codep = c;
+	return s != utf8_validator::UTF8_REJECT;
+}
+
+// Finishes a multibyte sequence left open by the previous call (or by the
+// previous block) so the fast paths below only ever start from the ACCEPT
+// state. Advances data past the bytes it consumed.
+inline bool finish_sequence(const unsigned char*& data,const unsigned char* end,
+                            uint32_t* state,uint32_t* codep) {
+	while (*state != utf8_validator::UTF8_ACCEPT && data != end) {
+		if (utf8_validator::decode(state,codep,*data++) == utf8_validator::UTF8_REJECT) {
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool is_ascii_word(const unsigned char* p) {
+	uint64_t w;
+	std::memcpy(&w,p,sizeof(w));
+	return (w & 0x8080808080808080ULL) == 0;
+}
+
+// Index of the lowest set bit of a non zero movemask result.
+inline unsigned int first_set_bit(unsigned int m) {
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward(&i,m);
+	return i;
+#else
+	return __builtin_ctz(m);
+#endif
+}
+
+// Validates a block of unmasked data made up of count vectors of width bytes.
+// masks[i] holds the high bits of vector i. A vector that is all ASCII is
+// skipped whenever the DFA is between sequences, otherwise the DFA runs from
+// its first non ASCII byte (or its first byte, if a sequence is open).
+inline bool validate_vectors(const unsigned char* data,const unsigned int* masks,
+                             size_t count,size_t width,uint32_t* state,
+                             uint32_t* codep) {
+	for (size_t i = 0; i < count; i++, data += width) {
+		const unsigned char* begin = data;
+
+		if (*state == utf8_validator::UTF8_ACCEPT) {
+			if (masks[i] == 0) {
+				continue;
+			}
+			begin += first_set_bit(masks[i]);
+		}
+
+		if (!run_dfa(begin,data+width,state,codep)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+simd::utf8_kernel select_utf8_kernel();
+
+bool utf8_resolve(const unsigned char* data,size_t len,uint32_t* state,
+                  uint32_t* codep);
+
+// Same lazy resolution scheme as the masking kernels.
+boost::atomic<simd::utf8_kernel> g_utf8_kernel(&utf8_resolve);
+
+bool utf8_resolve(const unsigned char* data,size_t len,uint32_t* state,
+                  uint32_t* codep) {
+	simd::utf8_kernel k = select_utf8_kernel();
+	g_utf8_kernel.store(k,boost::memory_order_relaxed);
+	return k(data,len,state,codep);
+}
+
+simd::utf8_kernel select_utf8_kernel() {
+#if defined(WEBSOCKETPP_SIMD_X86)
+	const simd::cpu_features& f = simd::get_cpu_features();
+
+	if (f.avx2) {
+		return &simd::validate_utf8_avx2;
+	}
+	if (f.sse2) {
+		return &simd::validate_utf8_sse2;
+	}
+#endif
+	return &simd::validate_utf8_word;
+}
+
+simd::unmask_utf8_kernel select_unmask_utf8_kernel();
+
+bool unmask_utf8_resolve(const unsigned char* src,unsigned char* dst,size_t len,
+                         const char* key,size_t* key_index,uint32_t* state,
+                         uint32_t* codep);
+
+boost::atomic<simd::unmask_utf8_kernel> g_unmask_utf8_kernel(
+	&unmask_utf8_resolve
+);
+
+bool unmask_utf8_resolve(const unsigned char* src,unsigned char* dst,size_t len,
+                         const char* key,size_t* key_index,uint32_t* state,
+                         uint32_t* codep) {
+	simd::unmask_utf8_kernel k = select_unmask_utf8_kernel();
+	g_unmask_utf8_kernel.store(k,boost::memory_order_relaxed);
+	return k(src,dst,len,key,key_index,state,codep);
+}
+
+simd::unmask_utf8_kernel select_unmask_utf8_kernel() {
+#if defined(WEBSOCKETPP_SIMD_X86)
+	const simd::cpu_features& f = simd::get_cpu_features();
+
+	if (f.avx2) {
+		return &simd::unmask_validate_utf8_avx2;
+	}
+	if (f.sse2) {
+		return &simd::unmask_validate_utf8_sse2;
+	}
+#endif
+	return &simd::unmask_validate_utf8_word;
+}
+
+}
+
+bool simd::validate_utf8(const unsigned char* data,size_t len,uint32_t* state,
+                         uint32_t* codep) {
+	utf8_kernel k = g_utf8_kernel.load(boost::memory_order_relaxed);
+	return k(data,len,state,codep);
+}
+
+const char* simd::get_utf8_kernel_name() {
+	utf8_kernel k = select_utf8_kernel();
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (k == &validate_utf8_avx2) {
+		return "avx2";
+	}
+	if (k == &validate_utf8_sse2) {
+		return "sse2";
+	}
+#endif
+	if (k == &validate_utf8_word) {
+		return "word";
+	}
+	return "dfa";
+}
+
+bool simd::unmask_validate_utf8(const unsigned char* src,unsigned char* dst,
+                                size_t len,const char* key,size_t* key_index,
+                                uint32_t* state,uint32_t* codep) {
+	*key_index &= 3;
+	unmask_utf8_kernel k = g_unmask_utf8_kernel.load(boost::memory_order_relaxed);
+	return k(src,dst,len,key,key_index,state,codep);
+}
+
+const char* simd::get_unmask_utf8_kernel_name() {
+	unmask_utf8_kernel k = select_unmask_utf8_kernel();
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (k == &unmask_validate_utf8_avx2) {
+		return "avx2";
+	}
+	if (k == &unmask_validate_utf8_sse2) {
+		return "sse2";
+	}
+#endif
+	if (k == &unmask_validate_utf8_word) {
+		return "word";
+	}
+	return "reference";
+}
+
+bool simd::validate_utf8_dfa(const unsigned char* data,size_t len,
+                             uint32_t* state,uint32_t* codep) {
+	for (size_t i = 0; i < len; i++) {
+		if (utf8_validator::decode(state,codep,data[i]) == utf8_validator::UTF8_REJECT) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool simd::validate_utf8_word(const unsigned char* data,size_t len,
+                              uint32_t* state,uint32_t* codep) {
+	const unsigned char* end = data+len;
+
+	while (end-data >= 8) {
+		if (*state == utf8_validator::UTF8_ACCEPT && is_ascii_word(data)) {
+			data += 8;
+			continue;
+		}
+
+		// Run the DFA over this word. It may leave a sequence open, which
+		// the next word picks up.
+		if (!run_dfa(data,data+8,state,codep)) {
+			return false;
+		}
+		data += 8;
+	}
+
+	return run_dfa(data,end,state,codep);
+}
+
+bool simd::unmask_validate_utf8_reference(const unsigned char* src,
+                                          unsigned char* dst,size_t len,
+                                          const char* key,size_t* key_index,
+                                          uint32_t* state,uint32_t* codep) {
+	*key_index = mask_scalar(src,dst,len,key,*key_index);
+	return validate_utf8_dfa(dst,len,state,codep);
+}
+
+bool simd::unmask_validate_utf8_word(const unsigned char* src,
+                                     unsigned char* dst,size_t len,
+                                     const char* key,size_t* key_index,
+                                     uint32_t* state,uint32_t* codep) {
+	const uint64_t high = 0x8080808080808080ULL;
+	const uint64_t k32 = rotate_key(key,*key_index);
+	const uint64_t k = (k32 << 32) | k32;
+
+	// Whole words leave *key_index where it was, only the tail moves it.
+	while (len >= 4*sizeof(uint64_t)) {
+		uint64_t w[4];
+		std::memcpy(w,src,sizeof(w));
+		w[0] ^= k;
+		w[1] ^= k;
+		w[2] ^= k;
+		w[3] ^= k;
+		std::memcpy(dst,w,sizeof(w));
+
+		if (*state != utf8_validator::UTF8_ACCEPT ||
+		    ((w[0] | w[1] | w[2] | w[3]) & high) != 0) {
+			if (!run_dfa(dst,dst+sizeof(w),state,codep)) {
+				return false;
+			}
+		}
+
+		src += sizeof(w);
+		dst += sizeof(w);
+		len -= sizeof(w);
+	}
+
+	while (len >= sizeof(uint64_t)) {
+		uint64_t w;
+		std::memcpy(&w,src,sizeof(w));
+		w ^= k;
+		std::memcpy(dst,&w,sizeof(w));
+
+		if (*state != utf8_validator::UTF8_ACCEPT || (w & high) != 0) {
+			if (!run_dfa(dst,dst+sizeof(w),state,codep)) {
+				return false;
+			}
+		}
+
+		src += sizeof(w);
+		dst += sizeof(w);
+		len -= sizeof(w);
+	}
+
+	// Small frames are mostly tail, so skip the DFA for it when it is ASCII
+	// too.
+	*key_index = mask_word(src,dst,len,key,*key_index);
+
+	unsigned char any = 0;
+	for (size_t i = 0; i < len; i++) {
+		any |= dst[i];
+	}
+	if (*state == utf8_validator::UTF8_ACCEPT && (any & 0x80) == 0) {
+		return true;
+	}
+	return run_dfa(dst,dst+len,state,codep);
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+
+WEBSOCKETPP_TARGET_SSE2
+bool simd::validate_utf8_sse2(const unsigned char* data,size_t len,
+                              uint32_t* state,uint32_t* codep) {
+	const unsigned char* end = data+len;
+
+	if (!finish_sequence(data,end,state,codep)) {
+		return false;
+	}
+
+	while (end-data >= 16) {
+		// Invariant: *state is ACCEPT at the top of the loop.
+
+		// Check four vectors at once while the text stays ASCII. OR-ing
+		// them keeps every high bit that is set in any of them.
+		while (end-data >= 64) {
+			const __m128i* p = reinterpret_cast<const __m128i*>(data);
+			__m128i v = _mm_or_si128(
+				_mm_or_si128(_mm_loadu_si128(p),_mm_loadu_si128(p+1)),
+				_mm_or_si128(_mm_loadu_si128(p+2),_mm_loadu_si128(p+3)));
+			if (_mm_movemask_epi8(v) != 0) {
+				break;
+			}
+			data += 64;
+		}
+
+		if (end-data < 16) {
+			break;
+		}
+
+		int m = _mm_movemask_epi8(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+
+		if (m == 0) {
+			data += 16;
+			continue;
+		}
+
+		// Everything before the first high bit is ASCII. Hand the rest of
+		// the block to the DFA, then finish any sequence that straddles the
+		// end of the block.
+		const unsigned char* block_end = data+16;
+		data += first_set_bit(m);
+
+		if (!run_dfa(data,block_end,state,codep)) {
+			return false;
+		}
+		data = block_end;
+
+		if (!finish_sequence(data,end,state,codep)) {
+			return false;
+		}
+	}
+
+	return run_dfa(data,end,state,codep);
+}
+
+WEBSOCKETPP_TARGET_AVX2
+bool simd::validate_utf8_avx2(const unsigned char* data,size_t len,
+                              uint32_t* state,uint32_t* codep) {
+	const unsigned char* end = data+len;
+	bool valid = finish_sequence(data,end,state,codep);
+
+	while (valid && end-data >= 32) {
+		// Invariant: *state is ACCEPT at the top of the loop.
+
+		while (end-data >= 128) {
+			const __m256i* p = reinterpret_cast<const __m256i*>(data);
+			__m256i v = _mm256_or_si256(
+				_mm256_or_si256(_mm256_loadu_si256(p),_mm256_loadu_si256(p+1)),
+				_mm256_or_si256(_mm256_loadu_si256(p+2),_mm256_loadu_si256(p+3)));
+			if (_mm256_movemask_epi8(v) != 0) {
+				break;
+			}
+			data += 128;
+		}
+
+		if (end-data < 32) {
+			break;
+		}
+
+		unsigned int m = static_cast<unsigned int>(_mm256_movemask_epi8(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data))));
+
+		if (m == 0) {
+			data += 32;
+			continue;
+		}
+
+		const unsigned char* block_end = data+32;
+		data += first_set_bit(m);
+
+		valid = run_dfa(data,block_end,state,codep);
+		data = block_end;
+
+		if (valid) {
+			valid = finish_sequence(data,end,state,codep);
+		}
+	}
+
+	// Leave the upper halves of the ymm registers clean for whatever legacy
+	// SSE code runs next.
+	_mm256_zeroupper();
+
+	return valid && run_dfa(data,end,state,codep);
+}
+
+WEBSOCKETPP_TARGET_SSE2
+bool simd::unmask_validate_utf8_sse2(const unsigned char* src,
+                                     unsigned char* dst,size_t len,
+                                     const char* key,size_t* key_index,
+                                     uint32_t* state,uint32_t* codep) {
+	const __m128i k = _mm_set1_epi32(static_cast<int>(rotate_key(key,*key_index)));
+
+	// The decoder state is copied into locals. Through the pointers it would
+	// have to be reloaded after every store to dst, which might alias it.
+	uint32_t st = *state;
+	uint32_t cp = *codep;
+
+	while (len >= 64) {
+		const __m128i* in = reinterpret_cast<const __m128i*>(src);
+		__m128i* d = reinterpret_cast<__m128i*>(dst);
+
+		__m128i a = _mm_xor_si128(_mm_loadu_si128(in),k);
+		__m128i b = _mm_xor_si128(_mm_loadu_si128(in+1),k);
+		__m128i c = _mm_xor_si128(_mm_loadu_si128(in+2),k);
+		__m128i e = _mm_xor_si128(_mm_loadu_si128(in+3),k);
+		_mm_storeu_si128(d,a);
+		_mm_storeu_si128(d+1,b);
+		_mm_storeu_si128(d+2,c);
+		_mm_storeu_si128(d+3,e);
+
+		// The unmasked vectors are still in registers, so the ASCII check
+		// costs nothing extra. Only blocks that hold multibyte sequences
+		// are read back from dst by the DFA.
+		__m128i any = _mm_or_si128(_mm_or_si128(a,b),_mm_or_si128(c,e));
+		if (_mm_movemask_epi8(any) != 0 ||
+		    st != utf8_validator::UTF8_ACCEPT) {
+			unsigned int masks[4];
+			masks[0] = _mm_movemask_epi8(a);
+			masks[1] = _mm_movemask_epi8(b);
+			masks[2] = _mm_movemask_epi8(c);
+			masks[3] = _mm_movemask_epi8(e);
+
+			if (!validate_vectors(dst,masks,4,16,&st,&cp)) {
+				*state = st;
+				return false;
+			}
+		}
+
+		src += 64;
+		dst += 64;
+		len -= 64;
+	}
+
+	while (len >= 16) {
+		__m128i a = _mm_xor_si128(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)),k);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst),a);
+
+		unsigned int m = _mm_movemask_epi8(a);
+		if (!validate_vectors(dst,&m,1,16,&st,&cp)) {
+			*state = st;
+			return false;
+		}
+
+		src += 16;
+		dst += 16;
+		len -= 16;
+	}
+
+	*state = st;
+	*codep = cp;
+	return unmask_validate_utf8_word(src,dst,len,key,key_index,state,codep);
+}
+
+WEBSOCKETPP_TARGET_AVX2
+bool simd::unmask_validate_utf8_avx2(const unsigned char* src,
+                                     unsigned char* dst,size_t len,
+                                     const char* key,size_t* key_index,
+                                     uint32_t* state,uint32_t* codep) {
+	const __m256i k = _mm256_set1_epi32(static_cast<int>(rotate_key(key,*key_index)));
+	uint32_t st = *state;
+	uint32_t cp = *codep;
+	bool valid = true;
+
+	while (valid && len >= 128) {
+		const __m256i* in = reinterpret_cast<const __m256i*>(src);
+		__m256i* d = reinterpret_cast<__m256i*>(dst);
+
+		__m256i a = _mm256_xor_si256(_mm256_loadu_si256(in),k);
+		__m256i b = _mm256_xor_si256(_mm256_loadu_si256(in+1),k);
+		__m256i c = _mm256_xor_si256(_mm256_loadu_si256(in+2),k);
+		__m256i e = _mm256_xor_si256(_mm256_loadu_si256(in+3),k);
+		_mm256_storeu_si256(d,a);
+		_mm256_storeu_si256(d+1,b);
+		_mm256_storeu_si256(d+2,c);
+		_mm256_storeu_si256(d+3,e);
+
+		__m256i any = _mm256_or_si256(_mm256_or_si256(a,b),_mm256_or_si256(c,e));
+		if (_mm256_movemask_epi8(any) != 0 ||
+		    st != utf8_validator::UTF8_ACCEPT) {
+			unsigned int masks[4];
+			masks[0] = static_cast<unsigned int>(_mm256_movemask_epi8(a));
+			masks[1] = static_cast<unsigned int>(_mm256_movemask_epi8(b));
+			masks[2] = static_cast<unsigned int>(_mm256_movemask_epi8(c));
+			masks[3] = static_cast<unsigned int>(_mm256_movemask_epi8(e));
+
+			valid = validate_vectors(dst,masks,4,32,&st,&cp);
+		}
+
+		src += 128;
+		dst += 128;
+		len -= 128;
+	}
+
+	while (valid && len >= 32) {
+		__m256i a = _mm256_xor_si256(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)),k);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),a);
+
+		unsigned int m = static_cast<unsigned int>(_mm256_movemask_epi8(a));
+		valid = validate_vectors(dst,&m,1,32,&st,&cp);
+
+		src += 32;
+		dst += 32;
+		len -= 32;
+	}
+
+	_mm256_zeroupper();
+
+	*state = st;
+	*codep = cp;
+
+	return valid &&
+	       unmask_validate_utf8_word(src,dst,len,key,key_index,state,codep);
+}
+
+#endif // WEBSOCKETPP_SIMD_X86
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_SIMD_UTF8_HPP
+#define WEBSOCKETPP_SIMD_UTF8_HPP
+
+#include "cpu_features.hpp"
+
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace websocketpp {
+namespace simd {
+
+// A UTF-8 validation kernel feeds len bytes of data through the streaming
+// validator in utf8_validator.hpp. state and codep carry the decoder state
+// between calls so a message may be validated fragment by fragment, exactly
+// as utf8_validator::decode would. Returns false as soon as the data is known
+// to be invalid, in which case *state is UTF8_REJECT.
+//
+// A true return only means no invalid sequence has been seen yet. The caller
+// must still check that *state is UTF8_ACCEPT at the end of the message.
+//
+// The accelerated kernels skip over runs of ASCII a word or vector at a time
+// and fall back to the byte at a time DFA only around multibyte sequences.
+typedef bool (*utf8_kernel)(const unsigned char* data,
+                            size_t len,
+                            uint32_t* state,
+                            uint32_t* codep);
+
+// Validates using the fastest kernel the running processor supports. The
+// kernel is chosen by CPUID the first time this is called.
+bool validate_utf8(const unsigned char* data,
+                   size_t len,
+                   uint32_t* state,
+                   uint32_t* codep);
+
+// Name of the kernel that validate_utf8() dispatches to ("dfa", "word",
+// "sse2" or "avx2").
+const char* get_utf8_kernel_name();
+
+// Individual kernels. These are exposed for testing and benchmarking, the
+// frame code should always call validate_utf8().
+
+// Byte at a time DFA, the reference implementation.
+bool validate_utf8_dfa(const unsigned char* data,size_t len,
+                       uint32_t* state,uint32_t* codep);
+
+// Portable version that skips ASCII 8 bytes at a time.
+bool validate_utf8_word(const unsigned char* data,size_t len,
+                        uint32_t* state,uint32_t* codep);
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+bool validate_utf8_sse2(const unsigned char* data,size_t len,
+                        uint32_t* state,uint32_t* codep);
+
+// Only valid when get_cpu_features().avx2 is true.
+bool validate_utf8_avx2(const unsigned char* data,size_t len,
+                        uint32_t* state,uint32_t* codep);
+#endif
+
+// A fused kernel unmasks len bytes of a text payload from src into dst and
+// validates the unmasked bytes in the same pass, so a large message is only
+// brought through the cache once. key and *key_index have the meaning they
+// have for a masking kernel, *key_index is advanced past the bytes that were
+// processed. state and codep are as for a validation kernel.
+//
+// src and dst may be the same buffer. If the return value is false the data
+// is invalid and the contents of dst and *key_index are unspecified.
+typedef bool (*unmask_utf8_kernel)(const unsigned char* src,
+                                   unsigned char* dst,
+                                   size_t len,
+                                   const char* key,
+                                   size_t* key_index,
+                                   uint32_t* state,
+                                   uint32_t* codep);
+
+// Unmasks and validates using the fastest fused kernel the running processor
+// supports. The kernel is chosen by CPUID the first time this is called.
+bool unmask_validate_utf8(const unsigned char* src,
+                          unsigned char* dst,
+                          size_t len,
+                          const char* key,
+                          size_t* key_index,
+                          uint32_t* state,
+                          uint32_t* codep);
+
+// Name of the kernel that unmask_validate_utf8() dispatches to ("reference",
+// "word", "sse2" or "avx2").
+const char* get_unmask_utf8_kernel_name();
+
+// Two passes, mask_scalar followed by validate_utf8_dfa. The reference the
+// fused kernels are tested against.
+bool unmask_validate_utf8_reference(const unsigned char* src,unsigned char* dst,
+                                    size_t len,const char* key,
+                                    size_t* key_index,uint32_t* state,
+                                    uint32_t* codep);
+
+bool unmask_validate_utf8_word(const unsigned char* src,unsigned char* dst,
+                               size_t len,const char* key,size_t* key_index,
+                               uint32_t* state,uint32_t* codep);
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+bool unmask_validate_utf8_sse2(const unsigned char* src,unsigned char* dst,
+                               size_t len,const char* key,size_t* key_index,
+                               uint32_t* state,uint32_t* codep);
+
+// Only valid when get_cpu_features().avx2 is true.
+bool unmask_validate_utf8_avx2(const unsigned char* src,unsigned char* dst,
+                               size_t len,const char* key,size_t* key_index,
+                               uint32_t* state,uint32_t* codep);
+#endif
+
+} // namespace simd
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_SIMD_UTF8_HPP
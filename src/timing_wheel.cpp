@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "timing_wheel.hpp"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using websocketpp::timing_wheel;
+
+boost::asio::io_service::id timing_wheel::id;
+
+const uint32_t timing_wheel::TICK_MS;
+const uint64_t timing_wheel::MAX_TICKS;
+const size_t timing_wheel::LEVEL0_BITS;
+const size_t timing_wheel::LEVEL_BITS;
+const size_t timing_wheel::LEVELS;
+const size_t timing_wheel::LEVEL0_SLOTS;
+const size_t timing_wheel::LEVEL_SLOTS;
+const size_t timing_wheel::SLOTS;
+
+timing_wheel::timer::timer(boost::asio::io_service& io_service)
+ : m_wheel(boost::asio::use_service<timing_wheel>(io_service)),
+   m_expiry(0) {}
+
+timing_wheel::timer::~timer() {
+	cancel();
+}
+
+void timing_wheel::timer::start(uint32_t ms,
+                                const boost::function<void()>& handler) {
+	cancel();
+	m_handler = handler;
+	m_wheel.add(*this,ms);
+}
+
+void timing_wheel::timer::cancel() {
+	if (!pending()) {
+		return;
+	}
+	
+	m_wheel.remove(*this);
+	
+	// The handler may hold the last reference to whatever owns this timer,
+	// so it goes last.
+	boost::function<void()> handler;
+	handler.swap(m_handler);
+}
+
+timing_wheel::timing_wheel(boost::asio::io_service& io_service)
+ : boost::asio::io_service::service(io_service),
+   m_size(0),
+   m_now(1),
+   m_start(boost::posix_time::microsec_clock::universal_time()),
+   m_tick_timer(io_service),
+   m_ticking(false)
+{
+	for (size_t i = 0; i < SLOTS; i++) {
+		m_slots[i].init();
+	}
+}
+
+timing_wheel::~timing_wheel() {}
+
+void timing_wheel::shutdown() {
+	// Handlers hold references to sessions, whose timers cancel themselves
+	// as they are destroyed. Take every timer off the wheel before letting go
+	// of any handler.
+	std::vector< boost::function<void()> > handlers(m_size);
+	size_t n = 0;
+	
+	for (size_t i = 0; i < SLOTS; i++) {
+		while (!m_slots[i].empty()) {
+			timer* t = static_cast<timer*>(m_slots[i].next);
+			t->unlink();
+			handlers[n++].swap(t->m_handler);
+		}
+	}
+	
+	m_size = 0;
+}
+
+void timing_wheel::advance_to(uint64_t tick) {
+	while (m_now <= tick) {
+		if (m_size == 0) {
+			m_now = tick+1;
+			break;
+		}
+		run_tick();
+	}
+}
+
+uint64_t timing_wheel::get_tick() const {
+	return m_now-1;
+}
+
+size_t timing_wheel::size() const {
+	return m_size;
+}
+
+void timing_wheel::add(timer& t,uint32_t ms) {
+	// An empty wheel stops ticking, so catch up with the clock first.
+	if (m_size == 0) {
+		m_now = std::max(m_now,current_tick()+1);
+	}
+	
+	// Tick m_now runs as it starts, so the timer waits at least ms.
+	t.m_expiry = m_now + (ms + TICK_MS - 1)/TICK_MS;
+	insert(t);
+	m_size++;
+	
+	if (!m_ticking) {
+		schedule(m_now);
+	}
+}
+
+void timing_wheel::remove(timer& t) {
+	t.unlink();
+	m_size--;
+}
+
+void timing_wheel::insert(timer& t) {
+	if (t.m_expiry < m_now) {
+		t.m_expiry = m_now;
+	}
+	
+	uint64_t delta = t.m_expiry - m_now;
+	
+	if (delta < LEVEL0_SLOTS) {
+		m_slots[t.m_expiry & (LEVEL0_SLOTS-1)].push_back(&t);
+		return;
+	}
+	
+	if (delta > MAX_TICKS) {
+		t.m_expiry = m_now + MAX_TICKS;
+		delta = MAX_TICKS;
+	}
+	
+	size_t level = 1;
+	size_t shift = LEVEL0_BITS;
+	
+	while (level < LEVELS-1 && delta >> (shift+LEVEL_BITS) != 0) {
+		level++;
+		shift += LEVEL_BITS;
+	}
+	
+	size_t i = (t.m_expiry >> shift) & (LEVEL_SLOTS-1);
+	m_slots[LEVEL0_SLOTS + (level-1)*LEVEL_SLOTS + i].push_back(&t);
+}
+
+size_t timing_wheel::cascade(size_t level) {
+	size_t shift = LEVEL0_BITS + (level-1)*LEVEL_BITS;
+	size_t i = (m_now >> shift) & (LEVEL_SLOTS-1);
+	
+	link moving;
+	moving.take(m_slots[LEVEL0_SLOTS + (level-1)*LEVEL_SLOTS + i]);
+	
+	while (!moving.empty()) {
+		timer* t = static_cast<timer*>(moving.next);
+		t->unlink();
+		insert(*t);
+	}
+	
+	return i;
+}
+
+void timing_wheel::run_tick() {
+	size_t i = m_now & (LEVEL0_SLOTS-1);
+	
+	// Once the first level comes round again, bring down the timers of the
+	// next slot above it, and so on up while those levels come round too.
+	if (i == 0) {
+		for (size_t level = 1; level < LEVELS && cascade(level) == 0; level++) {}
+	}
+	
+	// Handlers may start and cancel timers, including those expiring now.
+	link expired;
+	expired.take(m_slots[i]);
+	m_now++;
+	
+	try {
+		while (!expired.empty()) {
+			timer* t = static_cast<timer*>(expired.next);
+			t->unlink();
+			m_size--;
+			
+			boost::function<void()> handler;
+			handler.swap(t->m_handler);
+			handler();
+		}
+	} catch (...) {
+		// what didn't run goes in the next tick
+		while (!expired.empty()) {
+			link* l = expired.next;
+			l->unlink();
+			m_slots[m_now & (LEVEL0_SLOTS-1)].push_back(l);
+		}
+		throw;
+	}
+}
+
+uint64_t timing_wheel::current_tick() const {
+	boost::posix_time::time_duration d;
+	d = boost::posix_time::microsec_clock::universal_time() - m_start;
+	
+	if (d.is_negative()) {
+		return 0;
+	}
+	return d.total_milliseconds() / TICK_MS;
+}
+
+void timing_wheel::schedule(uint64_t tick) {
+	m_ticking = true;
+	m_tick_timer.expires_at(
+		m_start + boost::posix_time::milliseconds(tick*TICK_MS)
+	);
+	m_tick_timer.async_wait(
+		boost::bind(
+			&timing_wheel::handle_tick,
+			this,
+			boost::asio::placeholders::error
+		)
+	);
+}
+
+void timing_wheel::handle_tick(const boost::system::error_code& error) {
+	m_ticking = false;
+	
+	if (error || m_size == 0) {
+		return;
+	}
+	
+	uint64_t tick = current_tick();
+	
+	// set up the next tick first, in case a handler throws
+	schedule(std::max(tick+1,m_now));
+	advance_to(tick);
+}
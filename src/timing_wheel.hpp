@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Hierarchical timing wheel that holds the timeouts of every session on an
+// io_service, driven by a single coarse timer.
+//
+// Time is counted in ticks of TICK_MS milliseconds. The first level has a 
+// slot for each of the next 256 ticks. Each further level has 64 slots that
+// cover 64 times as long as a slot of the level below, and as time reaches a
+// slot its timers are moved down a level. Starting, restarting and 
+// cancelling a timer take constant time, and the io_service has at most one
+// wait pending for all of them, once per tick while any timer is set.
+//
+// There is one wheel per io_service, created on first use. Like the sessions
+// that use it, it must only be used from a thread running the io_service.
+class timing_wheel : public boost::asio::io_service::service {
+public:
+	static boost::asio::io_service::id id;
+	
+	static const uint32_t TICK_MS = 100;
+	
+	// Longest timeout the levels cover, about 77 days. Longer timeouts are
+	// cut to this.
+	static const uint64_t MAX_TICKS = (uint64_t(1) << 26) - 1;
+	
+	// Doubly linked list hook. Each slot is the head of a circular list.
+	struct link {
+		link() : prev(NULL),next(NULL) {}
+		
+		// makes this the head of an empty list
+		void init() {
+			prev = this;
+			next = this;
+		}
+		
+		bool empty() const {
+			return next == this;
+		}
+		
+		void push_back(link* l) {
+			l->prev = prev;
+			l->next = this;
+			prev->next = l;
+			prev = l;
+		}
+		
+		void unlink() {
+			prev->next = next;
+			next->prev = prev;
+			prev = NULL;
+			next = NULL;
+		}
+		
+		// Moves the list headed by from to this, leaving from empty.
+		void take(link& from) {
+			if (from.empty()) {
+				init();
+				return;
+			}
+			
+			next = from.next;
+			prev = from.prev;
+			next->prev = this;
+			prev->next = this;
+			from.init();
+		}
+		
+		link*	prev;
+		link*	next;
+	};
+	
+	// A timeout that calls its handler once on the io_service's thread. It
+	// is cancelled when destroyed.
+	class timer : private link, boost::noncopyable {
+	public:
+		explicit timer(boost::asio::io_service& io_service);
+		~timer();
+		
+		// Calls handler once ms milliseconds have passed, or up to a tick 
+		// later. Replaces any timeout already set.
+		void start(uint32_t ms,const boost::function<void()>& handler);
+		
+		// Forgets the timeout without calling the handler. Does nothing if 
+		// no timeout is set.
+		void cancel();
+		
+		bool pending() const {
+			return next != NULL;
+		}
+	private:
+		friend class timing_wheel;
+		
+		timing_wheel&			m_wheel;
+		uint64_t				m_expiry;
+		boost::function<void()>	m_handler;
+	};
+	
+	explicit timing_wheel(boost::asio::io_service& io_service);
+	~timing_wheel();
+	
+	// Runs every tick up to and including tick, calling the handlers of the
+	// timers that expire. Driven by the wheel's own timer, and by tests.
+	void advance_to(uint64_t tick);
+	
+	// The last tick that has run.
+	uint64_t get_tick() const;
+	
+	// number of timers set
+	size_t size() const;
+private:
+	static const size_t LEVEL0_BITS = 8;
+	static const size_t LEVEL_BITS = 6;
+	static const size_t LEVELS = 4;
+	static const size_t LEVEL0_SLOTS = size_t(1) << LEVEL0_BITS;
+	static const size_t LEVEL_SLOTS = size_t(1) << LEVEL_BITS;
+	static const size_t SLOTS = LEVEL0_SLOTS + (LEVELS-1)*LEVEL_SLOTS;
+	
+	void shutdown();
+	
+	void add(timer& t,uint32_t ms);
+	void remove(timer& t);
+	
+	// puts t in the slot for its expiry
+	void insert(timer& t);
+	
+	// Moves the timers in the current slot of level down a level and returns
+	// the index of that slot.
+	size_t cascade(size_t level);
+	
+	// runs tick m_now
+	void run_tick();
+	
+	// tick that the clock is in now
+	uint64_t current_tick() const;
+	
+	void schedule(uint64_t tick);
+	void handle_tick(const boost::system::error_code& error);
+	
+	link						m_slots[SLOTS];
+	size_t						m_size;
+	
+	// next tick to run
+	uint64_t					m_now;
+	
+	boost::posix_time::ptime	m_start;
+	boost::asio::deadline_timer	m_tick_timer;
+	bool						m_ticking;
+};
+
+}
+
+#endif // TIMING_WHEEL_HPP
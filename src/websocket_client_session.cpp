@@ -90,7 +90,7 @@ uint16_t client_session::get_port() const {
 
 void client_session::set_header(const std::string &key,const std::string &val) {
 	// TODO: prevent use of reserved headers
-	m_client_headers[key] = val;
+	handshake().client_headers[key] = val;
 }
 
 void client_session::set_origin(const std::string& val) {
@@ -100,19 +100,20 @@ void client_session::set_origin(const std::string& val) {
 
 void client_session::add_subprotocol(const std::string &val) {
 	// TODO: input validation
-	m_client_subprotocols.push_back(val);
+	handshake().client_subprotocols.push_back(val);
 }
 
 void client_session::add_extension(const std::string& val) {
 	// TODO: input validation
-	m_client_extensions.push_back(val);
+	handshake().client_extensions.push_back(val);
 }
 
 void client_session::read_handshake() {
-	boost::asio::async_read_until(
-		m_socket,
-		m_buf,
-			"\r\n\r\n",
+	http_head& head = handshake().head;
+	unsigned char* space = head.prepare();
+	
+	m_socket.async_read_some(
+		boost::asio::buffer(space,head.space()),
 		boost::bind(
 			&session::handle_read_handshake,
 			shared_from_this(),
@@ -131,49 +132,26 @@ void client_session::handle_read_handshake(const boost::system::error_code& e,
 		return;
 	}
 	
-	// parse server handshake
-	std::istream response_stream(&m_buf);
-	std::string header;
-	std::string::size_type end;
-	
-	// get status line
-	std::getline(response_stream, header);
-	if (header[header.size()-1] == '\r') {
-		header.erase(header.end()-1);
-		m_server_http_request = header;
-		m_raw_server_handshake += header+"\n";
-	}
+	http_head& head = handshake().head;
+	http_head::state state = head.commit(bytes_transferred);
 	
-	// get headers
-	while (std::getline(response_stream, header) && header != "\r") {
-		if (header[header.size()-1] != '\r') {
-			continue; // ignore malformed header lines?
-		} else {
-			header.erase(header.end()-1);
-		}
-		
-		end = header.find(": ",0);
-		
-		if (end != std::string::npos) {			
-			std::string h = header.substr(0,end);
-			if (get_server_header(h) == "") {
-				m_server_headers[h] = header.substr(end+2);
-			} else {
-				m_server_headers[h] += ", " + header.substr(end+2);
-			}
-		}
-		
-		m_raw_server_handshake += header+"\n";
+	if (state == http_head::READING) {
+		read_handshake();
+		return;
+	} else if (state == http_head::FAILED) {
+		m_client->log("Server handshake is malformed or too large",LOG_ERROR);
+		drop_tcp();
+		return;
 	}
 	
-	// temporary debugging
-	if (m_buf.size() > 0) {
-		std::stringstream foo;
-		foo << "bytes left over: " << m_buf.size();
-		access_log(foo.str(), ALOG_HANDSHAKE);
-	}
+	// anything after the head, such as the first frame, is read from there
+	http_head::span excess = head.excess();
+	m_read_buf.append(reinterpret_cast<const unsigned char*>(excess.data),
+	                  excess.size);
 	
-	m_client->access_log(m_raw_server_handshake,ALOG_HANDSHAKE);
+	handshake().raw_server_handshake = head.raw().str();
+	
+	m_client->access_log(handshake().raw_server_handshake,ALOG_HANDSHAKE);
 	
 	// handshake error checking
 	try {
@@ -181,17 +159,18 @@ void client_session::handle_read_handshake(const boost::system::error_code& e,
 		std::string h;
 		
 		// TODO: allow versions greater than 1.1
-		if (m_server_http_request.substr(0,9) != "HTTP/1.1 ") {
+		if (head.start_part(0).str() != "HTTP/1.1") {
 			err << "Websocket handshake has invalid HTTP version: "
-				<< m_server_http_request.substr(0,9);
+				<< head.start_part(0).str();
 			
 			throw(handshake_error(err.str(),400));
 		}
 		
-		// check the HTTP version
-		if (m_server_http_request.substr(9,3) != "101") {
+		// check the status code
+		if (head.start_part(1).str() != "101") {
 			err << "Websocket handshake ended with status "
-			    << m_server_http_request.substr(9);
+			    << head.start_part(1).str() << " "
+			    << head.start_part(2).str();
 			
 			// TODO: check version header for other supported versions.
 			
@@ -219,36 +198,54 @@ void client_session::handle_read_handshake(const boost::system::error_code& e,
 		if (get_server_header("Sec-WebSocket-Accept") == "") {
 			throw(handshake_error("Required Sec-WebSocket-Key header is missing",400));
 		} else {
-			// TODO: make a helper function for this.
-			std::string server_key = m_client_key;
-			server_key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-			
-			SHA1		sha;
-			uint32_t	message_digest[5];
+			char accept[ACCEPT_KEY_SIZE];
+			make_accept_key(m_client_key.data(),m_client_key.size(),accept);
 			
-			sha.Reset();
-			sha << server_key.c_str();
-	
-			if (!sha.Result(message_digest)) {
-				m_client->log("Error computing handshake sha1 hash.",LOG_ERROR);
-				// TODO: close behavior
-				return;
-			}
-	
-			// convert sha1 hash bytes to network byte order because this sha1
-			//  library works on ints rather than bytes
-			for (int i = 0; i < 5; i++) {
-				message_digest[i] = htonl(message_digest[i]);
-			}
-	
-			server_key = base64_encode(
-					reinterpret_cast<const unsigned char*>(message_digest),20);
-			if (server_key != get_server_header("Sec-WebSocket-Accept")) {
+			if (std::string(accept,ACCEPT_KEY_SIZE) != 
+			    get_server_header("Sec-WebSocket-Accept")) {
 				m_client->log("Server key does not match",LOG_ERROR);
 				// TODO: close behavior
 				return;
 			}
 		}
+		
+		// the server may only use extensions that we offered
+		h = get_server_header("Sec-WebSocket-Extensions");
+		if (h != "") {
+			split_header_list(h,m_server_extensions);
+		}
+		
+		for (size_t i = 0; i < m_server_extensions.size(); i++) {
+			const std::string& e = m_server_extensions[i];
+			
+			if (permessage_deflate::is_permessage_deflate(e)) {
+				if (!m_deflate_settings.enabled || m_deflate.is_active() ||
+				    !m_deflate.accept_response(m_deflate_settings,e)) 
+				{
+					err << "Invalid permessage-deflate response: " << e;
+					throw(handshake_error(err.str(),400));
+				}
+			} else {
+				std::string name = boost::trim_copy(e.substr(0,e.find(';')));
+				bool offered = false;
+				
+				const std::vector<std::string>& offers = 
+					handshake().client_extensions;
+				
+				for (size_t j = 0; j < offers.size(); j++) {
+					const std::string& o = offers[j];
+					
+					if (boost::trim_copy(o.substr(0,o.find(';'))) == name) {
+						offered = true;
+					}
+				}
+				
+				if (!offered) {
+					err << "Server used an extension that wasn't offered: " << e;
+					throw(handshake_error(err.str(),400));
+				}
+			}
+		}
 	} catch (const handshake_error& e) {
 		std::stringstream err;
 		err << "Caught handshake exception: " << e.what();
@@ -263,6 +260,7 @@ void client_session::handle_read_handshake(const boost::system::error_code& e,
 	log_open_result();
 
 	m_state = STATE_OPEN;
+	start_extensions();
 
 	if (m_local_interface) {
 		m_local_interface->on_open(shared_from_this());
@@ -310,23 +308,35 @@ void client_session::write_handshake() {
 	
 	set_header("Sec-WebSocket-Key",m_client_key);
 	
+	if (m_deflate_settings.enabled) {
+		handshake().client_extensions.push_back(
+			permessage_deflate::generate_offer(m_deflate_settings)
+		);
+	}
+	
+	if (!handshake().client_extensions.empty()) {
+		set_header("Sec-WebSocket-Extensions",
+		           boost::algorithm::join(handshake().client_extensions,", "));
+	}
+	
 	
 
 	set_header("User Agent","WebSocket++/2011-09-25");
 
 	header_list::iterator it;
-	for (it = m_client_headers.begin(); it != m_client_headers.end(); it++) {
+	header_list& headers = handshake().client_headers;
+	for (it = headers.begin(); it != headers.end(); it++) {
 		client_handshake += it->first + ": " + it->second + "\r\n";
 	}
 	
 	client_handshake += "\r\n";
 	
-	m_raw_client_handshake = client_handshake;
+	handshake().raw_client_handshake = client_handshake;
 
 	// start async write to handle_write_handshake
 	boost::asio::async_write(
 		m_socket,
-		boost::asio::buffer(m_raw_client_handshake),
+		boost::asio::buffer(handshake().raw_client_handshake),
 		boost::bind(
 			&session::handle_write_handshake,
 			shared_from_this(),
@@ -352,3 +362,11 @@ void client_session::log(const std::string& msg, uint16_t level) const {
 void client_session::access_log(const std::string& msg, uint16_t level) const {
 	m_client->access_log(msg,level);
 }
+
+bool client_session::test_elog_level(uint16_t level) const {
+	return m_client->test_elog_level(level);
+}
+
+bool client_session::test_alog_level(uint16_t level) const {
+	return m_client->test_alog_level(level);
+}
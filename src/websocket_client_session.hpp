@@ -104,6 +104,8 @@ public:
 
 	void log(const std::string& msg, uint16_t level) const;
 	void access_log(const std::string& msg, uint16_t level) const;
+	bool test_elog_level(uint16_t level) const;
+	bool test_alog_level(uint16_t level) const;
 protected:
 	// Opening handshake processors and callbacks.
 	virtual void write_handshake();
@@ -108,7 +108,14 @@ public:
 	// should either save the session_ptr somewhere or copy the data out.
 	virtual void on_fail(session_ptr session) {};
 	
-	// experimental
+	// on_drain is called when a session that refused a send, or reported 
+	// SEND_BLOCKED, has written enough of its queued data to fall to its low
+	// watermark. Producers that stopped sending to this session can resume.
+	virtual void on_drain(session_ptr session) {}
+	
+	// on_ping_timeout is called when a session with keepalive on has gone
+	// without receiving anything for its keepalive interval and timeout, 
+	// just before the connection is dropped. on_close follows.
 	virtual void on_ping_timeout(session_ptr session) {}
 };
 
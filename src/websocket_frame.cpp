@@ -29,6 +29,9 @@
 
 #include "websocket_server.hpp"
 #include "utf8_validator/utf8_validator.hpp"
+#include "simd/masking.hpp"
+#include "simd/utf8.hpp"
+#include "buffer_pool.hpp"
 
 #include <iostream>
 #include <algorithm>
@@ -54,94 +57,133 @@ void frame::reset() {
 	m_state = STATE_BASIC_HEADER;
 	m_bytes_needed = BASIC_HEADER_LENGTH;
 	m_degraded = false;
-	m_payload.empty();
+	buffer_pool::local().release(m_payload);
+	m_payload_data = NULL;
+	m_payload_size = 0;
+	m_payload_processed = 0;
+	m_key_index = 0;
+	m_validate_utf8 = false;
 	memset(m_header,0,MAX_HEADER_LENGTH);
 }
 
+void frame::set_message_context(bool fragmented,opcode message_opcode,
+                                uint32_t* state,uint32_t* codep) {
+	m_message_fragmented = fragmented;
+	m_message_opcode = message_opcode;
+	m_utf8_state = state;
+	m_utf8_codep = codep;
+}
+
+bool frame::is_utf8_validated() const {
+	return m_validate_utf8;
+}
+
+void frame::set_extension_bits(uint8_t bits) {
+	m_extension_bits = bits;
+}
+
 // Method invariant: One of the following must always be true even in the case 
 // of exceptions.
 // - m_bytes_needed > 0
 // - m-state = STATE_READY
-void frame::consume(std::istream &s) {
+void frame::consume(receive_buffer& buf) {
 	try {
-		switch (m_state) {
-			case STATE_BASIC_HEADER:
-				s.read(&m_header[BASIC_HEADER_LENGTH-m_bytes_needed],m_bytes_needed);
-		
-				m_bytes_needed -= s.gcount();
-				
-				if (m_bytes_needed == 0) {
-					process_basic_header();
+		// Keep going until the frame is complete or buf runs out so a small
+		// frame is parsed in one call.
+		while (!buf.empty() && m_state != STATE_READY) {
+			unsigned char* data = buf.data();
+			size_t n = std::min(static_cast<uint64_t>(buf.size()),m_bytes_needed);
+			
+			switch (m_state) {
+				case STATE_BASIC_HEADER:
+					std::memcpy(&m_header[BASIC_HEADER_LENGTH-m_bytes_needed],data,n);
+					buf.consume(n);
 					
-					validate_basic_header();
+					m_bytes_needed -= n;
 					
-					if (m_bytes_needed > 0) {
-						m_state = STATE_EXTENDED_HEADER;
-					} else {
-						process_extended_header();
+					if (m_bytes_needed == 0) {
+						process_basic_header();
+						
+						validate_basic_header();
 						
+						if (m_bytes_needed > 0) {
+							m_state = STATE_EXTENDED_HEADER;
+						} else {
+							process_extended_header();
+							
+							if (m_bytes_needed == 0) {
+								m_state = STATE_READY;
+								process_payload();
+								
+							} else {
+								m_state = STATE_PAYLOAD;
+							}
+						}
+					}
+					break;
+				case STATE_EXTENDED_HEADER:
+					std::memcpy(&m_header[get_header_len()-m_bytes_needed],data,n);
+					buf.consume(n);
+					
+					m_bytes_needed -= n;
+					
+					if (m_bytes_needed == 0) {
+						process_extended_header();
 						if (m_bytes_needed == 0) {
 							m_state = STATE_READY;
 							process_payload();
-							
 						} else {
 							m_state = STATE_PAYLOAD;
 						}
 					}
-				}
-				break;
-			case STATE_EXTENDED_HEADER:
-				s.read(&m_header[get_header_len()-m_bytes_needed],m_bytes_needed);
-				
-				m_bytes_needed -= s.gcount();
-				
-				if (m_bytes_needed == 0) {
-					process_extended_header();
+					break;
+				case STATE_PAYLOAD:
+					if (m_payload_data == NULL && n == m_payload_size) {
+						// The whole payload has already been read. Use it 
+						// where it is.
+						m_payload_data = data;
+					} else {
+						if (m_payload_data == NULL) {
+							buffer_pool::local().acquire(m_payload,m_payload_size);
+							m_payload.resize(m_payload_size);
+							m_payload_data = &m_payload[0];
+						}
+						std::memcpy(&m_payload_data[m_payload_size-m_bytes_needed],data,n);
+					}
+					buf.consume(n);
+					
+					m_bytes_needed -= n;
+					
 					if (m_bytes_needed == 0) {
 						m_state = STATE_READY;
-						process_payload();
-					} else {
-						m_state = STATE_PAYLOAD;
 					}
-				}
-				break;
-			case STATE_PAYLOAD:
-				s.read(reinterpret_cast<char *>(&m_payload[m_payload.size()-m_bytes_needed]),
-					   m_bytes_needed);
-				
-				m_bytes_needed -= s.gcount();
-				
-				if (m_bytes_needed == 0) {
-					m_state = STATE_READY;
-					process_payload();
-				}
-				break;
-			case STATE_RECOVERY:
-				// Recovery state discards all bytes that are not the first byte
-				// of a close frame.
-				do {
-					s.read(reinterpret_cast<char *>(&m_header[0]),1);
 					
-					//std::cout << std::hex << int(static_cast<unsigned char>(m_header[0])) << " ";
+					// Unmask while the new bytes are still in cache rather 
+					// than in one pass over the whole payload at the end.
+					process_payload();
+					break;
+				case STATE_RECOVERY: {
+					// Recovery state discards all bytes that are not the first
+					// byte of a close frame.
+					// (BPB0_FIN && CONNECTION_CLOSE)
+					const void* p = std::memchr(data,0x88,buf.size());
 					
-					if (int(static_cast<unsigned char>(m_header[0])) == 0x88) {
-						//(BPB0_FIN && CONNECTION_CLOSE)
-						m_bytes_needed--;
-						m_state = STATE_BASIC_HEADER;
+					if (p == NULL) {
+						buf.consume(buf.size());
 						break;
 					}
-				} while (s.gcount() > 0);
-				
-				//std::cout << std::endl;
-				
-				break;
-			default:
-				break;
+					
+					buf.consume(static_cast<const unsigned char*>(p)-data+1);
+					
+					m_header[0] = static_cast<char>(0x88);
+					m_bytes_needed--;
+					m_state = STATE_BASIC_HEADER;
+					break;
+				}
+				default:
+					break;
+			}
 		}
-		
-		/*if (s.gcount() == 0) {
-			throw frame_error("consume read zero bytes",FERR_FATAL_SESSION_ERROR);
-		}*/
 	} catch (const frame_error& e) {
 		// After this point all non-close frames must be considered garbage, 
 		// including the current one. Reset it and put the reading frame into
@@ -281,7 +323,7 @@ size_t frame::get_payload_size() const {
 		throw frame_error("attempted to get payload size before reading full header");
 	}
 	
-	return m_payload.size();
+	return m_payload_size;
 }
 
 uint16_t frame::get_close_status() const {
@@ -290,8 +332,8 @@ uint16_t frame::get_close_status() const {
 	} else if (get_payload_size() >= 2) {
 		char val[2];
 		
-		val[0] = m_payload[0];
-		val[1] = m_payload[1];
+		val[0] = m_payload_data[0];
+		val[1] = m_payload_data[1];
 		
 		uint16_t code = ntohs(*(
 			reinterpret_cast<uint16_t*>(&val[0])
@@ -317,32 +359,69 @@ std::string frame::get_close_msg() const {
 			throw frame_error("Invalid UTF-8 Data",
 							  frame::FERR_PAYLOAD_VIOLATION);
 		}
-		return std::string(m_payload.begin()+2,m_payload.end());
+		return std::string(reinterpret_cast<const char*>(m_payload_data)+2,
+		                   m_payload_size-2);
 	} else {
 		return std::string();
 	}
 }
 
 std::vector<unsigned char> &frame::get_payload() {
+	if (m_payload.size() != m_payload_size) {
+		buffer_pool::local().acquire(m_payload,m_payload_size);
+		m_payload.assign(m_payload_data,m_payload_data+m_payload_size);
+		m_payload_data = m_payload.empty() ? NULL : &m_payload[0];
+	}
 	return m_payload;
 }
 
-void frame::set_payload(const std::vector<unsigned char> source) {
+const unsigned char* frame::get_payload_data() const {
+	return m_payload_data;
+}
+
+void frame::set_payload(const std::vector<unsigned char>& source) {
 	set_payload_helper(source.size());
 	
 	std::copy(source.begin(),source.end(),m_payload.begin());
 }
-void frame::set_payload(const std::string source) {
+void frame::set_payload(const std::string& source) {
 	set_payload_helper(source.size());
 	
 	std::copy(source.begin(),source.end(),m_payload.begin());
 }
+void frame::set_payload(const unsigned char* source,size_t len) {
+	set_payload_helper(len);
+	
+	std::copy(source,source+len,m_payload.begin());
+}
+
+void frame::swap_payload(std::vector<unsigned char>& v) {
+	m_payload.swap(v);
+	set_payload_length(m_payload.size());
+	m_payload_data = m_payload.empty() ? NULL : &m_payload[0];
+	m_payload_size = m_payload.size();
+	m_payload_processed = 0;
+	m_key_index = 0;
+}
 
 bool frame::is_control() const {
 	return (get_opcode() > MAX_FRAME_OPCODE);
 }
 
 void frame::set_payload_helper(size_t s) {
+	set_payload_length(s);
+	
+	if (m_payload.capacity() < s) {
+		buffer_pool::local().acquire(m_payload,s);
+	}
+	m_payload.resize(s);
+	m_payload_data = s > 0 ? &m_payload[0] : NULL;
+	m_payload_size = s;
+	m_payload_processed = 0;
+	m_key_index = 0;
+}
+
+void frame::set_payload_length(size_t s) {
 	if (s > max_payload_size) {
 		throw frame_error("requested payload is over implimentation defined limit",FERR_MSG_TOO_BIG);
 	}
@@ -368,8 +447,26 @@ void frame::set_payload_helper(size_t s) {
 	} else {
 		throw frame_error("payload size limit is 63 bits",FERR_PROTOCOL_VIOLATION);
 	}
+}
+
+unsigned int frame::write_header(char* header,bool fin,opcode op,
+                                 uint64_t payload_size,bool rsv1) {
+	header[0] = (fin ? BPB0_FIN : 0) | (rsv1 ? BPB0_RSV1 : 0) | op;
 	
-	m_payload.resize(s);
+	if (payload_size <= BASIC_PAYLOAD_LIMIT) {
+		header[1] = payload_size;
+		return BASIC_HEADER_LENGTH;
+	} else if (payload_size <= PAYLOAD_16BIT_LIMIT) {
+		header[1] = BASIC_PAYLOAD_16BIT_CODE;
+		uint16_t s = htons(payload_size);
+		std::memcpy(&header[BASIC_HEADER_LENGTH],&s,sizeof(s));
+		return BASIC_HEADER_LENGTH+sizeof(s);
+	} else {
+		header[1] = BASIC_PAYLOAD_64BIT_CODE;
+		uint64_t s = htonll(payload_size);
+		std::memcpy(&header[BASIC_HEADER_LENGTH],&s,sizeof(s));
+		return BASIC_HEADER_LENGTH+sizeof(s);
+	}
 }
 
 void frame::set_status(uint16_t status,const std::string message) {
@@ -386,7 +483,12 @@ void frame::set_status(uint16_t status,const std::string message) {
 		throw frame_error(err.str());
 	}
 	
+	if (m_payload.capacity() < 2+message.size()) {
+		buffer_pool::local().acquire(m_payload,2+message.size());
+	}
 	m_payload.resize(2+message.size());
+	m_payload_data = &m_payload[0];
+	m_payload_size = m_payload.size();
 	
 	char val[2];
 	
@@ -411,12 +513,11 @@ std::string frame::print_frame() const {
 		f << std::hex << (unsigned short)m_header[i] << " ";
 	}
 	// print message
-	if (m_payload.size() > 50) {
-		f << "[payload of " << m_payload.size() << " bytes]";
+	if (m_payload_size > 50) {
+		f << "[payload of " << m_payload_size << " bytes]";
 	} else {
-		std::vector<unsigned char>::const_iterator it;
-		for (it = m_payload.begin(); it != m_payload.end(); it++) {
-			f << *it;
+		for (size_t i = 0; i < m_payload_size; i++) {
+			f << m_payload_data[i];
 		}
 	}
 	return f.str();
@@ -483,54 +584,74 @@ void frame::process_extended_header() {
 		// TODO: frame/message size limits
 		throw server_error("got frame with payload greater than maximum frame buffer size.");
 	}
-	m_payload.resize(payload_size);
+	// Storage is decided once the payload starts to arrive.
+	m_payload.clear();
+	m_payload_data = NULL;
+	m_payload_size = payload_size;
 	m_bytes_needed = payload_size;
+	
+	// Text frames, and continuations of text messages, are validated as they
+	// are unmasked. A text frame that arrives in the middle of another
+	// message is left for the session to reject as a protocol error. 
+	// Compressed (RSV1) payloads are validated once they are inflated.
+	opcode op = get_opcode();
+	
+	m_validate_utf8 = m_utf8_state != NULL && (
+		(op == TEXT_FRAME && !m_message_fragmented && !get_rsv1()) ||
+		(op == CONTINUATION_FRAME && m_message_fragmented && 
+		 m_message_opcode == TEXT_FRAME));
 }
 
+// Unmasks, and if needed validates, the payload bytes that have been read
+// since the last call. Frames being written have no bytes outstanding so the
+// whole payload is processed.
 void frame::process_payload() {
-	if (get_masked()) {
-		char *masking_key = &m_header[get_header_len()-4];
-		
-		for (uint64_t i = 0; i < m_payload.size(); i++) {
-			m_payload[i] = (m_payload[i] ^ masking_key[i%4]);
-		}
-	}
-}
-
-void frame::process_payload2() {
-	// unmask payload one byte at a time
-	
-	//uint64_t key = (*((uint32_t*)m_masking_key;)) << 32;
-	//key += *((uint32_t*)m_masking_key);
-	
-	// might need to switch byte order
-	uint32_t key = *((uint32_t*)m_masking_key);
+	size_t end = m_payload_size;
 	
-	// 4
+	if (m_state == STATE_PAYLOAD) {
+		end -= m_bytes_needed;
+	}
 	
-	uint64_t i = 0;
-	uint64_t s = (m_payload.size() / 4);
+	if (end <= m_payload_processed) {
+		return;
+	}
 	
-	std::cout << "s: " << s << std::endl;
+	unsigned char* p = m_payload_data+m_payload_processed;
+	size_t len = end-m_payload_processed;
+	char *masking_key = &m_header[get_header_len()-4];
 	
-	// chunks of 4
-	for (i = 0; i < s; i+=4) {
-		((uint32_t*)(&m_payload[0]))[i] = (((uint32_t*)(&m_payload[0]))[i] ^ key);
+	if (m_validate_utf8) {
+		bool valid;
+		
+		if (get_masked()) {
+			valid = websocketpp::simd::unmask_validate_utf8(p,p,len,masking_key,
+			                                               &m_key_index,
+			                                               m_utf8_state,
+			                                               m_utf8_codep);
+		} else {
+			valid = websocketpp::simd::validate_utf8(p,len,m_utf8_state,
+			                                         m_utf8_codep);
+		}
+		
+		if (!valid) {
+			throw frame_error("Invalid UTF-8 Data",FERR_PAYLOAD_VIOLATION);
+		}
+	} else if (get_masked()) {
+		m_key_index = websocketpp::simd::mask(p,p,len,masking_key,m_key_index);
 	}
 	
-	// finish the last few
-	for (i = s; i < m_payload.size(); i++) {
-		m_payload[i] = (m_payload[i] ^ m_masking_key[i%4]);
-	}
+	m_payload_processed = end;
 }
 
 void frame::validate_utf8(uint32_t* state,uint32_t* codep, size_t offset) const {
-	for (size_t i = offset; i < m_payload.size(); i++) {
-		using utf8_validator::decode;
-		
-		if (decode(state,codep,m_payload[i]) == utf8_validator::UTF8_REJECT) {
-			throw frame_error("Invalid UTF-8 Data",FERR_PAYLOAD_VIOLATION);
-		}
+	if (offset >= m_payload_size) {
+		return;
+	}
+	
+	if (!websocketpp::simd::validate_utf8(m_payload_data+offset,
+	                                      m_payload_size-offset,
+	                                      state,codep)) {
+		throw frame_error("Invalid UTF-8 Data",FERR_PAYLOAD_VIOLATION);
 	}
 }
 
@@ -540,8 +661,8 @@ void frame::validate_basic_header() const {
 		throw frame_error("Control Frame is too large",FERR_PROTOCOL_VIOLATION);
 	}
 	
-	// check for reserved opcodes
-	if (get_rsv1() || get_rsv2() || get_rsv3()) {
+	// check for reserved bits
+	if (m_header[0] & (BPB0_RSV1|BPB0_RSV2|BPB0_RSV3) & ~m_extension_bits) {
 		throw frame_error("Reserved bit used",FERR_PROTOCOL_VIOLATION);
 	}
 	
@@ -29,6 +29,7 @@
 #define WEBSOCKET_FRAME_HPP
 
 #include "network_utilities.hpp"
+#include "receive_buffer.hpp"
 
 #include <string>
 #include <vector>
@@ -100,7 +101,14 @@ public:
 	 m_gen(m_rng, 
 	          boost::random::uniform_int_distribution<>(INT32_MIN,INT32_MAX)),
 #endif
-	m_degraded(false)
+	m_degraded(false),
+	m_payload_data(NULL),
+	m_payload_size(0),
+	m_message_fragmented(false),
+	m_message_opcode(CONTINUATION_FRAME),
+	m_extension_bits(0),
+	m_utf8_state(NULL),
+	m_utf8_codep(NULL)
 	{
 		reset();
 	}
@@ -109,7 +117,26 @@ public:
 	uint64_t get_bytes_needed() const;
 	void reset();
 	
-	void consume(std::istream &s);
+	// Parses as much of the frame as is available from the front of buf and
+	// removes the bytes it used. A payload that is entirely in buf when it is
+	// reached is unmasked and used where it is rather than copied out, so buf
+	// must not be written to again until this frame has been reset.
+	void consume(receive_buffer& buf);
+	
+	// Tells a read frame about the message it may be part of so that text
+	// payloads can be unmasked and validated in one pass as they arrive.
+	// state and codep are the running UTF-8 state of that message. Passing
+	// NULL turns validation off.
+	void set_message_context(bool fragmented,opcode message_opcode,
+	                         uint32_t* state,uint32_t* codep);
+	
+	// true if the payload was validated as UTF-8 while it was read
+	bool is_utf8_validated() const;
+	
+	// Sets the RSV bits (BPB0_RSV1 etc) that negotiated extensions use. A 
+	// read frame with any other RSV bit set is a protocol error. The bits 
+	// are kept across reset.
+	void set_extension_bits(uint8_t bits);
 	
 	// get pointers to underlying buffers
 	char* get_header();
@@ -143,12 +170,32 @@ public:
 	uint16_t get_close_status() const;
 	std::string get_close_msg() const;
 	
+	// The payload as a vector. A payload that was used in place is copied
+	// into the vector by the first call.
 	std::vector<unsigned char> &get_payload();
 	
-	void set_payload(const std::vector<unsigned char> source);
-	void set_payload(const std::string source);
+	// The payload wherever it is. Valid until the frame is reset.
+	const unsigned char* get_payload_data() const;
+	
+	void set_payload(const std::vector<unsigned char>& source);
+	void set_payload(const std::string& source);
+	void set_payload(const unsigned char* source,size_t len);
 	void set_payload_helper(size_t s);
 	
+	// writes the payload length into the header
+	void set_payload_length(size_t s);
+	
+	// Swaps the payload vector with v, leaving the frame with the contents
+	// of v as its payload and a header to match. Lets a written payload be 
+	// handed off, or a new one handed in, without a copy.
+	void swap_payload(std::vector<unsigned char>& v);
+	
+	// Writes the header of an unmasked frame to header, which must have room
+	// for MAX_HEADER_LENGTH bytes. Returns the length of the header. The
+	// payload size is not checked against any limits.
+	static unsigned int write_header(char* header,bool fin,opcode op,
+	                                 uint64_t payload_size,bool rsv1 = false);
+	
 	void set_status(uint16_t status,const std::string message = "");
 	
 	bool is_control() const;
@@ -159,7 +206,6 @@ public:
 	void process_basic_header();
 	void process_extended_header();
 	void process_payload();
-	void process_payload2(); // experiment with more efficient masking code.
 	
 	void validate_utf8(uint32_t* state,uint32_t* codep,size_t offset = 0) const;
 	void validate_basic_header() const;
@@ -175,6 +221,22 @@ private:
 	char m_header[MAX_HEADER_LENGTH];
 	std::vector<unsigned char> m_payload;
 	
+	// The payload being read or written. Points into m_payload, or into the
+	// receive buffer for a payload that is being used in place.
+	unsigned char*	m_payload_data;
+	size_t			m_payload_size;
+	
+	// payload bytes that have already been unmasked (and validated)
+	size_t		m_payload_processed;
+	size_t		m_key_index;
+	bool		m_validate_utf8;
+	
+	bool		m_message_fragmented;
+	opcode		m_message_opcode;
+	uint8_t		m_extension_bits;
+	uint32_t*	m_utf8_state;
+	uint32_t*	m_utf8_codep;
+	
 	char m_masking_key[4];	
 	
 	#ifdef USE_BOOST_RANDOM
@@ -35,20 +35,51 @@
 
 #include <iostream>
 
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
 using websocketpp::server;
 
 #ifdef _WIN32
 typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_EXCLUSIVEADDRUSE> win_exclusive;
 #endif
 
+#ifdef TCP_NOTSENT_LOWAT
+typedef boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT> tcp_notsent_lowat;
+#endif
+
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
 server::server(boost::asio::io_service& io_service, 
 			   const tcp::endpoint& endpoint,
 			   websocketpp::connection_handler_ptr defc)
 	: m_elog_level(LOG_ERROR),
 	  m_alog_level(ALOG_CONTROL),
 	  m_max_message_size(DEFAULT_MAX_MESSAGE_SIZE),
+	  m_slow_consumer_policy(session::SLOW_CONSUMER_REFUSE),
+	  m_send_stall_timeout(DEFAULT_SEND_STALL_TIMEOUT),
+	  m_tcp_notsent_lowat(0),
+	  m_max_frame_size(DEFAULT_MAX_FRAME_SIZE),
+	  m_keepalive_interval(0),
+	  m_keepalive_timeout(0),
+	  m_rtt_histogram(new rtt_histogram()),
 	  m_io_service(io_service), 
 	  m_acceptor(io_service), 
+	  m_num_io_threads(0),
+	  m_distribution(DISTRIBUTE_ROUND_ROBIN),
+	  m_next_io_thread(0),
+	  m_reuseport(false),
+	  m_steer_by_cpu(false),
 	  m_def_con_handler(defc)
 #ifdef USE_PROGRAM_OPTIONS
 	  ,m_desc("websocketpp::server") {
@@ -60,14 +91,24 @@ server::server(boost::asio::io_service& io_service,
 #else
 	{
 #endif
-	m_acceptor.open(endpoint.protocol());
+	listen(m_acceptor,endpoint,false);
+}
+
+void server::listen(tcp::acceptor& acceptor,const tcp::endpoint& endpoint,
+                    bool share_port) {
+	acceptor.open(endpoint.protocol());
 	#ifdef _WIN32
-	m_acceptor.set_option(win_exclusive(true));
+	acceptor.set_option(win_exclusive(true));
 	#else
-	m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+	acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+	#endif
+	#ifdef SO_REUSEPORT
+	if (share_port) {
+		acceptor.set_option(reuse_port(true));
+	}
 	#endif
-	m_acceptor.bind(endpoint);
-	m_acceptor.listen(); 
+	acceptor.bind(endpoint);
+	acceptor.listen(); 
 }
 
 void server::parse_command_line(int ac, char* av[]) {
@@ -169,29 +210,334 @@ void server::access_log(std::string msg,uint16_t level) {
               << " " << msg << std::endl;
 }
 
-void server::start_accept() {
+void server::set_slow_consumer_policy(session::slow_consumer_policy policy) {
+	m_slow_consumer_policy = policy;
+}
+
+void server::set_send_stall_timeout(uint32_t ms) {
+	m_send_stall_timeout = ms;
+}
+
+void server::set_keepalive(uint32_t interval,uint32_t timeout) {
+	m_keepalive_interval = interval;
+	m_keepalive_timeout = timeout;
+}
+
+const websocketpp::rtt_histogram& server::get_rtt_histogram() const {
+	return *m_rtt_histogram;
+}
+
+void server::set_tcp_notsent_lowat(int bytes) {
+	m_tcp_notsent_lowat = bytes;
+}
+
+void server::set_max_frame_size(size_t size) {
+	m_max_frame_size = size;
+}
+
+void server::set_permessage_deflate(const permessage_deflate::settings& s) {
+	m_deflate_settings = s;
+}
+
+void server::set_permessage_deflate_memory_limit(size_t bytes) {
+	if (bytes == 0) {
+		m_deflate_budget.reset();
+	} else {
+		m_deflate_budget.reset(new zlib_budget(bytes));
+	}
+}
+
+server::~server() {
+	stop_io_threads();
+}
+
+void server::set_io_threads(size_t threads,connection_distribution d) {
+	if (!m_io_threads.empty()) {
+		throw server_error("io threads can't be changed once started");
+	}
+	m_num_io_threads = threads;
+	m_distribution = d;
+}
+
+void server::stop_io_threads() {
+	m_accept_work.reset();
+	
+	for (size_t i = 0; i < m_io_threads.size(); i++) {
+		m_io_threads[i]->work.reset();
+		m_io_threads[i]->io_service.stop();
+	}
+	
+	// The last reference to the server can be dropped by a session on one 
+	// of its own threads, which can't wait for itself.
+	for (size_t i = 0; i < m_io_threads.size(); i++) {
+		boost::thread& t = *m_io_threads[i]->thread;
+		
+		if (!t.joinable()) {
+			continue;
+		} else if (t.get_id() == boost::this_thread::get_id()) {
+			t.detach();
+		} else {
+			t.join();
+		}
+	}
+}
+
+void server::set_reuseport_acceptors(bool enabled,bool steer_by_cpu) {
+	if (!m_io_threads.empty()) {
+		throw server_error("acceptors can't be changed once started");
+	}
+	m_reuseport = enabled;
+	m_steer_by_cpu = enabled && steer_by_cpu;
+}
+
+std::vector<size_t> server::get_io_thread_sessions() const {
+	std::vector<size_t> sessions;
+	
+	for (size_t i = 0; i < m_io_threads.size(); i++) {
+		sessions.push_back(m_io_threads[i]->sessions);
+	}
+	return sessions;
+}
+
+void server::start_io_threads() {
+	for (size_t i = 0; i < m_num_io_threads; i++) {
+		io_thread_ptr t(new io_thread());
+		
+		// keeps run from returning while the thread has no sessions
+		t->work.reset(new boost::asio::io_service::work(t->io_service));
+		t->thread.reset(new boost::thread(&server::run_io_thread,t));
+		
+		m_io_threads.push_back(t);
+	}
+	
+#if defined(__linux__)
+	unsigned int cpus = boost::thread::hardware_concurrency();
+	
+	if (m_steer_by_cpu && m_io_threads.size() != cpus) {
+		// The steering program sends CPU c to thread c % threads, which is
+		// only the thread pinned to c when there is one thread per CPU.
+		log("CPU steering needs an io thread for each CPU, not steering",
+		    LOG_WARN);
+		m_steer_by_cpu = false;
+	}
+	
+	if (m_steer_by_cpu) {
+		// thread i on CPU i, which is what the steering program assumes
+		for (size_t i = 0; i < m_io_threads.size(); i++) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i,&set);
+			
+			if (pthread_setaffinity_np(m_io_threads[i]->thread->native_handle(),
+			                           sizeof(set),&set) != 0) 
+			{
+				log("Could not pin io thread to a CPU",LOG_WARN);
+			}
+		}
+	}
+#endif
+}
+
+bool server::open_reuseport_acceptors() {
+#ifdef SO_REUSEPORT
+	// Sockets can only share the port if they all ask to, so the acceptor
+	// opened by the constructor makes way. Its port is kept in case it was
+	// chosen by the system.
+	tcp::endpoint endpoint = m_acceptor.local_endpoint();
+	m_acceptor.close();
+	
+	try {
+		for (size_t i = 0; i < m_io_threads.size(); i++) {
+			io_thread& t = *m_io_threads[i];
+			
+			t.acceptor.reset(new tcp::acceptor(t.io_service));
+			listen(*t.acceptor,endpoint,true);
+		}
+	} catch (const boost::system::system_error& e) {
+		log(std::string("Could not open SO_REUSEPORT acceptors: ")+e.what(),
+		    LOG_WARN);
+		
+		for (size_t i = 0; i < m_io_threads.size(); i++) {
+			m_io_threads[i]->acceptor.reset();
+		}
+		
+		listen(m_acceptor,endpoint,false);
+		return false;
+	}
+	
+	m_accept_work.reset(new boost::asio::io_service::work(m_io_service));
+	
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (m_steer_by_cpu) {
+		// Picks the socket at index cpu % threads in the group, which with a
+		// thread for each CPU is the one opened by the thread pinned to it.
+		struct sock_filter code[] = {
+			{BPF_LD | BPF_W | BPF_ABS,0,0,uint32_t(SKF_AD_OFF + SKF_AD_CPU)},
+			{BPF_ALU | BPF_MOD | BPF_K,0,0,uint32_t(m_io_threads.size())},
+			{BPF_RET | BPF_A,0,0,0}
+		};
+		struct sock_fprog program;
+		program.len = sizeof(code)/sizeof(code[0]);
+		program.filter = code;
+		
+		if (setsockopt(m_io_threads[0]->acceptor->native_handle(),SOL_SOCKET,
+		               SO_ATTACH_REUSEPORT_CBPF,&program,sizeof(program)) != 0)
+		{
+			log("Could not attach the CPU steering program",LOG_WARN);
+		}
+	}
+#endif
+	
+	return true;
+#else
+	log("SO_REUSEPORT isn't available, using a single acceptor",LOG_WARN);
+	return false;
+#endif
+}
+
+server::io_thread& server::next_io_thread() {
+	size_t n = m_next_io_thread;
+	
+	if (m_distribution == DISTRIBUTE_LEAST_LOADED) {
+		for (size_t i = 1; i < m_io_threads.size(); i++) {
+			size_t j = (m_next_io_thread+i) % m_io_threads.size();
+			
+			if (m_io_threads[j]->sessions < m_io_threads[n]->sessions) {
+				n = j;
+			}
+		}
+	}
+	
+	// ties go round robin
+	m_next_io_thread = (n+1) % m_io_threads.size();
+	
+	return *m_io_threads[n];
+}
+
+websocketpp::server_session_ptr server::make_session(
+	boost::asio::io_service& io_service,io_thread* t) 
+{
 	// TODO: sanity check whether the session buffer size bound could be reduced
 	server_session_ptr new_session(new server_session(shared_from_this(),
-	                                                  m_io_service,
+	                                                  io_service,
 	                                                  m_def_con_handler,
 													  m_max_message_size*2));
 	
+	if (t != NULL) {
+		// counts against the thread's load for as long as the session lives
+		++t->sessions;
+		new_session->set_server_token(
+			boost::shared_ptr<void>(t,&server::release_io_thread)
+		);
+	}
+	
+	new_session->set_slow_consumer_policy(m_slow_consumer_policy);
+	new_session->set_send_stall_timeout(m_send_stall_timeout);
+	new_session->set_max_frame_size(m_max_frame_size);
+	new_session->set_keepalive(m_keepalive_interval,m_keepalive_timeout);
+	new_session->set_rtt_histogram(m_rtt_histogram);
+	
+	permessage_deflate::settings deflate_settings = m_deflate_settings;
+	if (m_deflate_budget) {
+		deflate_settings.budget = m_deflate_budget;
+	}
+	new_session->set_permessage_deflate(deflate_settings);
+	
+	return new_session;
+}
+
+void server::run_io_thread(io_thread_ptr t) {
+	t->io_service.run();
+}
+
+void server::release_io_thread(io_thread* t) {
+	--t->sessions;
+}
+
+void server::start_accept() {
+	if (m_io_threads.empty() && m_num_io_threads > 0) {
+		start_io_threads();
+		
+		if (m_reuseport && open_reuseport_acceptors()) {
+			for (size_t i = 0; i < m_io_threads.size(); i++) {
+				m_io_threads[i]->io_service.post(boost::bind(
+					&server::start_thread_accept,
+					this,
+					m_io_threads[i].get()
+				));
+			}
+			return;
+		}
+	}
+	
+	server_session_ptr new_session;
+	
+	if (m_io_threads.empty()) {
+		new_session = make_session(m_io_service,NULL);
+	} else {
+		io_thread& t = next_io_thread();
+		new_session = make_session(t.io_service,&t);
+	}
+	
 	m_acceptor.async_accept(
 		new_session->socket(),
 		boost::bind(
 			&server::handle_accept,
 			this,
 			new_session,
+			static_cast<io_thread*>(NULL),
+			boost::asio::placeholders::error
+		)
+	);
+}
+
+void server::start_thread_accept(io_thread* t) {
+	server_session_ptr new_session = make_session(t->io_service,t);
+	
+	t->acceptor->async_accept(
+		new_session->socket(),
+		boost::bind(
+			&server::handle_accept,
+			this,
+			new_session,
+			t,
 			boost::asio::placeholders::error
 		)
 	);
 }
 
 void server::handle_accept(websocketpp::server_session_ptr session,
-	const boost::system::error_code& error) {
+	io_thread* t,const boost::system::error_code& error) {
 	
 	if (!error) {
-		session->on_connect();
+#ifdef TCP_NOTSENT_LOWAT
+		if (m_tcp_notsent_lowat > 0) {
+			boost::system::error_code ec;
+			session->socket().set_option(tcp_notsent_lowat(m_tcp_notsent_lowat),ec);
+			
+			if (ec) {
+				log("Could not set TCP_NOTSENT_LOWAT: "+ec.message(),LOG_WARN);
+			}
+		}
+#endif
+		if (m_io_threads.empty() || t != NULL) {
+			session->on_connect();
+		} else {
+			// the session's handlers all run on its own thread
+			session->io_service().post(
+				boost::bind(&server_session::on_connect,session)
+			);
+		}
+	} else if (t != NULL) {
+		// An exception would end the io thread, so the thread's acceptor 
+		// logs the error and carries on.
+		if (error == boost::asio::error::operation_aborted) {
+			return;
+		}
+		
+		std::stringstream err;
+		err << "Error accepting socket connection: " << error;
+		log(err.str(),LOG_ERROR);
 	} else {
 		std::stringstream err;
 		err << "Error accepting socket connection: " << error;
@@ -200,5 +546,9 @@ void server::handle_accept(websocketpp::server_session_ptr session,
 		throw server_error(err.str());
 	}
 	
-	this->start_accept();
+	if (t != NULL) {
+		start_thread_accept(t);
+	} else {
+		this->start_accept();
+	}
 }
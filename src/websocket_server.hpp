@@ -29,7 +29,10 @@
 #define WEBSOCKET_SERVER_HPP
 
 #include <boost/asio.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #ifdef USE_PROGRAM_OPTIONS
 #include <boost/program_options.hpp>
@@ -37,6 +40,7 @@ namespace po = boost::program_options;
 #endif
 
 #include <set>
+#include <vector>
 
 namespace websocketpp {
 	class server;
@@ -66,18 +70,93 @@ private:
 
 class server : public boost::enable_shared_from_this<server> {
 public:
+	// How accepted connections are spread over io threads.
+	enum connection_distribution {
+		// each thread in turn
+		DISTRIBUTE_ROUND_ROBIN = 0,
+		// the thread with the fewest sessions
+		DISTRIBUTE_LEAST_LOADED = 1
+	};
+	
 	server(boost::asio::io_service& io_service, 
 		   const tcp::endpoint& endpoint,
 		   connection_handler_ptr defc);
 	
+	~server();
+	
 	// creates a new session object and connects the next websocket
 	// connection to it.
 	void start_accept();
 	
+	// Runs sessions on threads of the server's own, each with its own 
+	// io_service, leaving the io_service the server was constructed with to
+	// accept connections. Each session stays on the thread it is given for
+	// its whole life, so its handlers never run at the same time as each 
+	// other, but handlers of different sessions do. The connection handler
+	// must be safe to call from several threads at once. 0, the default, 
+	// runs everything on the server's io_service. The threads are started by
+	// the first start_accept and the setting can't be changed after that.
+	void set_io_threads(size_t threads,
+	                    connection_distribution d = DISTRIBUTE_ROUND_ROBIN);
+	
+	// Opens a listening socket for each io thread with SO_REUSEPORT, so that
+	// the kernel spreads incoming connections over the threads and each 
+	// thread accepts its own, rather than one acceptor handing them all out.
+	// The connection distribution doesn't apply then. If steer_by_cpu is set
+	// io thread i is pinned to CPU i and a classic BPF program 
+	// (SO_ATTACH_REUSEPORT_CBPF, Linux 4.5 and later) gives each connection
+	// to the thread on the CPU that received it. Steering needs exactly one
+	// io thread for each CPU; with any other count it is skipped with a 
+	// warning. Needs io threads and must be set before start_accept. The 
+	// server's io_service is left with nothing to do but is kept from 
+	// running out of work until the io threads are stopped.
+	// Where SO_REUSEPORT isn't available the server's single acceptor is 
+	// used.
+	void set_reuseport_acceptors(bool enabled,bool steer_by_cpu = false);
+	
+	// Stops the io threads, abandoning their sessions, and waits for them to
+	// exit.
+	void stop_io_threads();
+	
+	// sessions open on each io thread
+	std::vector<size_t> get_io_thread_sessions() const;
+	
 	// INTERFACE FOR LOCAL APPLICATIONS
 
 	void set_max_message_size(uint64_t val);
 	
+	// How new sessions treat clients that don't read their data fast enough.
+	// See session::slow_consumer_policy. The default is to refuse sends.
+	void set_slow_consumer_policy(session::slow_consumer_policy policy);
+	void set_send_stall_timeout(uint32_t ms);
+	
+	// Keepalive pings for new sessions, in milliseconds. See 
+	// session::set_keepalive. Off by default.
+	void set_keepalive(uint32_t interval,uint32_t timeout);
+	
+	// Round trip times measured by the keepalive pings of all of this 
+	// server's sessions. See session::get_rtt.
+	const rtt_histogram& get_rtt_histogram() const;
+	
+	// Limits how much written data the kernel holds unsent for each 
+	// connection, so that data stays in the session's send queue where 
+	// control frames can still get ahead of it. 0, the default, leaves the
+	// system setting alone. Ignored where TCP_NOTSENT_LOWAT isn't available.
+	void set_tcp_notsent_lowat(int bytes);
+	
+	// Largest payload of an outgoing frame for new sessions. See 
+	// session::set_max_frame_size.
+	void set_max_frame_size(size_t size);
+	
+	// permessage-deflate settings for new sessions. See 
+	// session::set_permessage_deflate.
+	void set_permessage_deflate(const permessage_deflate::settings& s);
+	
+	// Limits the memory that the zlib streams of all of this server's 
+	// sessions hold at once. See permessage_deflate::settings::budget. 0, the
+	// default, is no limit.
+	void set_permessage_deflate_memory_limit(size_t bytes);
+	
 	// Test methods determine if a message of the given level should be 
 	// written. elog shows all values above the level set. alog shows only
 	// the values explicitly set.
@@ -99,18 +178,78 @@ public:
 		void log(std::string msg,uint16_t level = LOG_ERROR);
 		void access_log(std::string msg,uint16_t level);
 	private:
+		// An io_service with a thread of its own to run it. The session count
+		// comes first so that it outlives sessions destroyed along with the
+		// io_service.
+		struct io_thread {
+			io_thread() : sessions(0) {}
+			
+			boost::detail::atomic_count							sessions;
+			boost::asio::io_service								io_service;
+			boost::scoped_ptr<boost::asio::io_service::work>	work;
+			boost::scoped_ptr<boost::thread>					thread;
+			
+			// the thread's own listening socket, if it has one
+			boost::scoped_ptr<tcp::acceptor>					acceptor;
+		};
+		typedef boost::shared_ptr<io_thread> io_thread_ptr;
+		
+		static void listen(tcp::acceptor& acceptor,const tcp::endpoint& endpoint,
+		                   bool share_port);
+		
+		void start_io_threads();
+		
+		// Moves listening from the server's acceptor to one for each io 
+		// thread. Returns false, leaving the server's acceptor in place, if
+		// that can't be done.
+		bool open_reuseport_acceptors();
+		
+		// the io thread for the next connection from the server's acceptor
+		io_thread& next_io_thread();
+		
+		// A session on io_service, and on io thread t if that isn't NULL.
+		server_session_ptr make_session(boost::asio::io_service& io_service,
+		                                io_thread* t);
+		
+		// accepts the next connection on t's own acceptor
+		void start_thread_accept(io_thread* t);
+		
 		// if no errors starts the session's read loop and returns to the
-		// start_accept phase.
-		void handle_accept(server_session_ptr session,
+		// start_accept phase, or for t's acceptor to start_thread_accept.
+		void handle_accept(server_session_ptr session,io_thread* t,
 			const boost::system::error_code& error);
 		
+		// The thread keeps its io_thread until run returns, in case the 
+		// server is destroyed by one of its handlers.
+		static void run_io_thread(io_thread_ptr t);
+		static void release_io_thread(io_thread* t);
+		
 	private:
 		uint16_t					m_elog_level;
 		uint16_t					m_alog_level;
 
 	uint64_t					m_max_message_size;
+	session::slow_consumer_policy	m_slow_consumer_policy;
+	uint32_t					m_send_stall_timeout;
+	int							m_tcp_notsent_lowat;
+	size_t						m_max_frame_size;
+	uint32_t					m_keepalive_interval;
+	uint32_t					m_keepalive_timeout;
+	rtt_histogram_ptr			m_rtt_histogram;
+	permessage_deflate::settings	m_deflate_settings;
+	zlib_budget_ptr				m_deflate_budget;
 	boost::asio::io_service&	m_io_service;
 	tcp::acceptor				m_acceptor;
+	
+	size_t						m_num_io_threads;
+	connection_distribution		m_distribution;
+	std::vector<io_thread_ptr>	m_io_threads;
+	size_t						m_next_io_thread;
+	bool						m_reuseport;
+	bool						m_steer_by_cpu;
+	
+	// keeps the server's io_service running while the io threads accept
+	boost::scoped_ptr<boost::asio::io_service::work>	m_accept_work;
 	connection_handler_ptr		m_def_con_handler;
 
 #ifdef USE_PROGRAM_OPTIONS
@@ -59,17 +59,16 @@ void server_session::on_connect() {
 
 void server_session::set_header(const std::string &key,const std::string &val) {
 	// TODO: prevent use of reserved headers;
-	m_server_headers[key] = val;
+	handshake().server_headers[key] = val;
 }
 
 void server_session::select_subprotocol(const std::string& val) {
-	std::vector<std::string>::iterator it;
+	const std::vector<std::string>& offered = handshake().client_subprotocols;
+	std::vector<std::string>::const_iterator it;
 
-	it = std::find(m_client_subprotocols.begin(),
-	               m_client_subprotocols.end(),
-				   val);
+	it = std::find(offered.begin(),offered.end(),val);
 	
-	if (val != "" && it == m_client_subprotocols.end()) {
+	if (val != "" && it == offered.end()) {
 		throw server_error("Attempted to choose a subprotocol not proposed by the client");
 	}
 
@@ -81,13 +80,12 @@ void server_session::select_extension(const std::string& val) {
 		return;
 	}
 
-	std::vector<std::string>::iterator it;
+	const std::vector<std::string>& offered = handshake().client_extensions;
+	std::vector<std::string>::const_iterator it;
 
-	it = std::find(m_client_extensions.begin(),
-	               m_client_extensions.end(),
-				   val);
+	it = std::find(offered.begin(),offered.end(),val);
 
-	if (it == m_client_extensions.end()) {
+	if (it == offered.end()) {
 		throw server_error("Attempted to choose an extension not proposed by the client");
 	}
 
@@ -95,20 +93,20 @@ void server_session::select_extension(const std::string& val) {
 }
 
 void server_session::read_handshake() {
-	m_timer.expires_from_now(boost::posix_time::seconds(5));
-	
-	m_timer.async_wait(
-		boost::bind(
-			&session::handle_handshake_expired,
-			shared_from_this(),
-			boost::asio::placeholders::error
-		)
+	m_timer.start(
+		5000,
+		boost::bind(&session::handle_handshake_expired,shared_from_this())
 	);
 	
-	boost::asio::async_read_until(
-		m_socket,
-		m_buf,
-			"\r\n\r\n",
+	read_request();
+}
+
+void server_session::read_request() {
+	http_head& head = handshake().head;
+	unsigned char* space = head.prepare();
+	
+	m_socket.async_read_some(
+		boost::asio::buffer(space,head.space()),
 		boost::bind(
 			&session::handle_read_handshake,
 			shared_from_this(),
@@ -120,57 +118,40 @@ void server_session::read_handshake() {
 
 void server_session::handle_read_handshake(const boost::system::error_code& e,
 	                                       std::size_t bytes_transferred) {
+	if (e) {
+		if (e != boost::asio::error::operation_aborted) {
+			log_error("Error reading handshake",e);
+			drop_tcp();
+		}
+		return;
+	}
 	
-	std::istream istr( &m_buf );
-	m_raw_client_handshake.reserve(bytes_transferred);
-	copy_n(std::istreambuf_iterator<char>(istr), bytes_transferred, std::back_inserter(m_raw_client_handshake));
-	
-	access_log(m_raw_client_handshake,ALOG_HANDSHAKE);
+	http_head& head = handshake().head;
+	http_head::state state = head.commit(bytes_transferred);
 	
-	std::vector<std::string> tokens;
-	std::string::size_type start = 0;
-	std::string::size_type end;
+	if (state == http_head::READING) {
+		read_request();
+		return;
+	}
 	
-	// Get request and parse headers
-	end = m_raw_client_handshake.find("\r\n",start);
+	WEBSOCKETPP_ALOG(ALOG_HANDSHAKE,head.raw().str());
 	
-	while(end != std::string::npos) {
-		tokens.push_back(m_raw_client_handshake.substr(start, end - start));
-		
-		start = end + 2;
-		
-		end = m_raw_client_handshake.find("\r\n",start);
-	}
-
-	for (size_t i = 0; i < tokens.size(); i++) {
-		if (i == 0) {
-			m_client_http_request = tokens[i];
-		}
-		
-		end = tokens[i].find(": ",0);
-		
-		if (end != std::string::npos) {
-			std::string h = tokens[i].substr(0,end);
-
-			if (get_client_header(h) == "") {
-				m_client_headers[h] = tokens[i].substr(end+2);
-			} else {
-				m_client_headers[h] += ", " + tokens[i].substr(end+2);
-			}
-		}
+	if (state == http_head::FAILED) {
+		log("Handshake request is malformed or too large",LOG_ERROR);
+		m_server_http_code = 400;
+		handshake().server_http_string = "";
+		write_handshake();
+		return;
 	}
-
-	start = 0;
-	end = m_client_http_request.find(" ", start);
-	m_http_method = m_client_http_request.substr(start, end-start);
-	start = end+1;
-
-	end = m_client_http_request.find(" ", start);
-	m_resource = m_client_http_request.substr(start, end-start);
-	start = end+1;
-
-	end = m_client_http_request.find(" ", start);
-	m_http_version = m_client_http_request.substr(start, end-start);
+	
+	// bytes after the head, such as the first frame, are read from there
+	http_head::span excess = head.excess();
+	m_read_buf.append(reinterpret_cast<const unsigned char*>(excess.data),
+	                  excess.size);
+	
+	m_http_method = head.start_part(0).str();
+	m_resource = head.start_part(1).str();
+	handshake().http_version = head.start_part(2).str();
 
 	if (m_local_interface) {
 		m_local_interface->on_client_connect(shared_from_this());
@@ -181,20 +162,22 @@ void server_session::handle_read_handshake(const boost::system::error_code& e,
 
 void server_session::start_http(int http_code, const std::string& http_body, bool done){
 	m_server_http_code = http_code;
-	m_server_http_string = "";
+	handshake().server_http_string = "";
 	
 	process_response_headers();
 
-	http_write(m_raw_server_handshake + http_body, done);
+	http_write(handshake().raw_server_handshake + http_body, done);
 
 	m_timer.cancel();
 	
 	if (!done){
 		m_state = STATE_OPEN;
-	
+		
+		unsigned char* space = m_read_buf.prepare(receive_buffer::MIN_READ_SIZE);
+		
 		boost::asio::async_read(
 			m_socket,
-			m_buf,
+			boost::asio::buffer(space,m_read_buf.space()),
 			boost::bind(
 				&session::handle_http_read_for_eof,
 				shared_from_this(),
@@ -211,12 +194,8 @@ void server_session::handle_http_read_for_eof(const boost::system::error_code& e
 
 void server_session::http_write(const std::string& body, bool done){
 
-	if (!m_pending_send_data){
-		m_pending_send_data = boost::shared_ptr<std::vector<unsigned char> >(new std::vector<unsigned char>());
-	}
-
-	m_pending_send_data->reserve(m_pending_send_data->size() + body.size());
-	m_pending_send_data->insert(m_pending_send_data->end(), body.begin(), body.end());
+	m_send_queue.begin_message(false);
+	m_send_queue.append(body.data(), body.size());
 
 	m_http_done = done;
 	http_write_async_send();
@@ -225,42 +204,44 @@ void server_session::http_write(const std::string& body, bool done){
 void server_session::http_write_async_send(){
 	if (m_writing) return; // will be handled on next call
 
-	if (m_pending_send_data){
-		m_writing = true;
-		
+	if (prepare_write()){
 		boost::asio::async_write(
 			m_socket,
-			boost::asio::buffer(*m_pending_send_data),
+			m_send_queue.prepare_write(),
 			boost::bind(
 				&session::handle_write_http_response,
 				shared_from_this(),
-				boost::asio::placeholders::error,
-				m_pending_send_data
+				boost::asio::placeholders::error
 			)
 		);
-
-		m_pending_send_data.reset();
 	}else if(m_http_done){
 		m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
 	}
 }
 
-void server_session::handle_write_http_response(const boost::system::error_code& error, boost::shared_ptr<std::vector<unsigned char> > buf){
+void server_session::handle_write_http_response(const boost::system::error_code& error){
+	finish_write();
+	
 	if (error) {
 		log("Error writing HTTP response ",LOG_ERROR);
 		return;
 	}
 
-	m_writing = false;
 	http_write_async_send();
 }
 
 void server_session::read_http_post_body(boost::function<void(std::string)> callback){
 	int length = boost::lexical_cast<int>(get_client_header("Content-Length"));
 	
-	// The async_read_until for the headers can read past the delimeter. See how
-	// much data is already in the buffer and adjust the requested read size.
-	length -= boost::asio::buffer_size(m_buf.data());
+	if (length < 0 || static_cast<uint64_t>(length) > m_buf_size) {
+		log("HTTP request body is too large",LOG_ERROR);
+		drop_tcp();
+		return;
+	}
+	
+	// The read of the head can read past it. See how much of the body is 
+	// already in the buffer and adjust the requested read size.
+	length -= m_read_buf.size();
 	
 	if (length <= 0){
 		// If it's already all read, just call the callback
@@ -269,10 +250,11 @@ void server_session::read_http_post_body(boost::function<void(std::string)> call
 		return;
 	}
 	
+	unsigned char* space = m_read_buf.prepare(length);
+	
 	boost::asio::async_read(
 		m_socket,
-		m_buf,
-		boost::asio::transfer_at_least(length),
+		boost::asio::buffer(space,length),
 		boost::bind(
 			&session::handle_read_http_post_body,
 			shared_from_this(),
@@ -285,10 +267,17 @@ void server_session::read_http_post_body(boost::function<void(std::string)> call
 
 void server_session::handle_read_http_post_body(const boost::system::error_code& e,
 	                                       std::size_t bytes_transferred, boost::function<void(std::string)> callback){
-	                                       
-	std::ostringstream d;
-	d << &m_buf;
-	callback(d.str());
+	m_read_buf.commit(bytes_transferred);
+	
+	std::string body;
+	
+	if (!m_read_buf.empty()) {
+		body.assign(reinterpret_cast<const char*>(m_read_buf.data()),
+		            m_read_buf.size());
+		m_read_buf.consume(m_read_buf.size());
+	}
+	
+	callback(body);
 }
 
 void server_session::start_websocket(){
@@ -305,7 +294,7 @@ void server_session::start_websocket(){
 			throw(handshake_error(err.str(),400));
 		}
 		
-		if (m_http_version != "HTTP/1.1") {
+		if (handshake().http_version != "HTTP/1.1") {
 			err << "Websocket handshake has invalid HTTP version";
 			throw(handshake_error(err.str(),400));
 		}
@@ -361,15 +350,27 @@ void server_session::start_websocket(){
 		}
 
 		// TODO: extract subprotocols
-		// TODO: extract extensions
+		
+		h = get_client_header("Sec-WebSocket-Extensions");
+		if (h != "") {
+			split_header_list(h,handshake().client_extensions);
+		}
 
 		// optional headers (delegated to the local interface)
 		if (m_local_interface) {
 			m_local_interface->validate(shared_from_this());
 		}
 		
+		if (m_deflate_settings.enabled) {
+			h = m_deflate.negotiate(m_deflate_settings,handshake().client_extensions);
+			
+			if (h != "") {
+				m_server_extensions.push_back(h);
+			}
+		}
+		
 		m_server_http_code = 101;
-		m_server_http_string = "Switching Protocols";
+		handshake().server_http_string = "Switching Protocols";
 	} catch (const handshake_error& e) {
 		std::stringstream err;
 		err << "Caught handshake exception: " << e.what();
@@ -378,7 +379,7 @@ void server_session::start_websocket(){
 		log(err.str(),LOG_ERROR);
 		
 		m_server_http_code = e.m_http_error_code;
-		m_server_http_string = e.m_http_error_msg;
+		handshake().server_http_string = e.m_http_error_msg;
 	}
 	
 	write_handshake();
@@ -386,33 +387,19 @@ void server_session::start_websocket(){
 
 void server_session::write_handshake() {
 	if (m_server_http_code == 101) {
-		std::string server_key = get_client_header("Sec-WebSocket-Key");
-		server_key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-
-		SHA1		sha;
-		uint32_t	message_digest[5];
+		http_head::span key = handshake().head.header("Sec-WebSocket-Key");
+		char accept[ACCEPT_KEY_SIZE];
 		
-		sha.Reset();
-		sha << server_key.c_str();
-	
-		if (sha.Result(message_digest)){
-			// convert sha1 hash bytes to network byte order because this sha1
-			//  library works on ints rather than bytes
-			for (int i = 0; i < 5; i++) {
-				message_digest[i] = htonl(message_digest[i]);
-			}
-	
-			server_key = base64_encode(
-					reinterpret_cast<const unsigned char*>(message_digest),20);
-			
-			// set handshake accept headers
-			set_header("Sec-WebSocket-Accept",server_key);
-			set_header("Upgrade","websocket");
-			set_header("Connection","Upgrade");
-		} else {
-			log("Error computing handshake sha1 hash.",LOG_ERROR);
-			m_server_http_code = 500;
-			m_server_http_string = "";
+		make_accept_key(key.data,key.size,accept);
+		
+		// set handshake accept headers
+		set_header("Sec-WebSocket-Accept",std::string(accept,ACCEPT_KEY_SIZE));
+		set_header("Upgrade","websocket");
+		set_header("Connection","Upgrade");
+		
+		if (!m_server_extensions.empty()) {
+			set_header("Sec-WebSocket-Extensions",
+			           boost::algorithm::join(m_server_extensions,", "));
 		}
 	}
 	
@@ -421,7 +408,7 @@ void server_session::write_handshake() {
 	// start async write to handle_write_handshake
 	boost::asio::async_write(
 		m_socket,
-		boost::asio::buffer(m_raw_server_handshake),
+		boost::asio::buffer(handshake().raw_server_handshake),
 		boost::bind(
 			&session::handle_write_handshake,
 			shared_from_this(),
@@ -432,23 +419,24 @@ void server_session::write_handshake() {
 
 void server_session::process_response_headers(){
 	std::stringstream h;
+	handshake_state& hs = handshake();
 
 	// hardcoded server headers
 	set_header("Server","WebSocket++/2011-09-25");
 
 	h << "HTTP/1.1 " << m_server_http_code << " "
-	  << (m_server_http_string != "" ? m_server_http_string : 
+	  << (hs.server_http_string != "" ? hs.server_http_string : 
 	                         lookup_http_error_string(m_server_http_code))
 	  << "\r\n";
 	
 	header_list::iterator it;
-	for (it = m_server_headers.begin(); it != m_server_headers.end(); it++) {
+	for (it = hs.server_headers.begin(); it != hs.server_headers.end(); it++) {
 		h << it->first << ": " << it->second << "\r\n";
 	}
 
 	h << "\r\n";
 	
-	m_raw_server_handshake = h.str();
+	hs.raw_server_handshake = h.str();
 }
 
 void server_session::handle_write_handshake(const boost::system::error_code& error) {
@@ -463,7 +451,9 @@ void server_session::handle_write_handshake(const boost::system::error_code& err
 	if (m_server_http_code != 101) {
 		std::stringstream err;
 		err << "Handshake ended with HTTP error: " << m_server_http_code << " "
-		    << (m_server_http_string != "" ? m_server_http_string : lookup_http_error_string(m_server_http_code));
+		    << (handshake().server_http_string != "" ? 
+		        handshake().server_http_string : 
+		        lookup_http_error_string(m_server_http_code));
 		log(err.str(),LOG_ERROR);
 		drop_tcp();
 		// TODO: tell client that connection failed.
@@ -471,6 +461,8 @@ void server_session::handle_write_handshake(const boost::system::error_code& err
 	}
 	
 	m_state = STATE_OPEN;
+	start_extensions();
+	start_keepalive();
 	
 	// stop the handshake timer
 	m_timer.cancel();
@@ -490,3 +482,15 @@ void server_session::log(const std::string& msg, uint16_t level) const {
 void server_session::access_log(const std::string& msg, uint16_t level) const {
 	m_server->access_log(msg,level);
 }
+
+bool server_session::test_elog_level(uint16_t level) const {
+	return m_server->test_elog_level(level);
+}
+
+bool server_session::test_alog_level(uint16_t level) const {
+	return m_server->test_alog_level(level);
+}
+
+void server_session::set_server_token(boost::shared_ptr<void> token) {
+	m_server_token = token;
+}
@@ -109,6 +109,12 @@ public:
 
 	void log(const std::string& msg, uint16_t level) const;
 	void access_log(const std::string& msg, uint16_t level) const;
+	bool test_elog_level(uint16_t level) const;
+	bool test_alog_level(uint16_t level) const;
+	
+	// Something the server wants kept until the session is destroyed, such
+	// as its count against the load of the thread it runs on.
+	void set_server_token(boost::shared_ptr<void> token);
 protected:
 	// Opening handshake processors and callbacks. These need to be defined in
 	virtual void write_handshake();
@@ -116,8 +122,11 @@ protected:
 	virtual void read_handshake();
 	virtual void handle_read_handshake(const boost::system::error_code& e,
 	                                   std::size_t bytes_transferred);
+	
+	// reads more of the request head into the handshake state
+	void read_request();
 	void process_response_headers();
-	virtual void handle_write_http_response(const boost::system::error_code& error, boost::shared_ptr<std::vector<unsigned char> > buf);
+	virtual void handle_write_http_response(const boost::system::error_code& error);
 	virtual void handle_read_http_post_body(const boost::system::error_code& e,
 	                 std::size_t bytes_transferred, boost::function<void(std::string)> callback);
 	virtual void handle_http_read_for_eof(const boost::system::error_code& e);
@@ -125,7 +134,8 @@ private:
 	
 protected:
 	// connection resources
-	server_ptr	m_server;	
+	server_ptr	m_server;
+	boost::shared_ptr<void>	m_server_token;
 private:
 	
 };
@@ -30,12 +30,14 @@
 
 #include "websocket_frame.hpp"
 #include "utf8_validator/utf8_validator.hpp"
+#include "simd/utf8.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/algorithm/string.hpp>
 
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
@@ -43,11 +45,33 @@
 
 using websocketpp::session;
 
+namespace {
+
+// microseconds since the epoch
+uint64_t now_us() {
+	static const boost::posix_time::ptime epoch(
+		boost::gregorian::date(1970,1,1)
+	);
+	
+	return (boost::posix_time::microsec_clock::universal_time() - epoch)
+	       .total_microseconds();
+}
+
+}
+
 session::session (boost::asio::io_service& io_service,
 				  websocketpp::connection_handler_ptr defc,
 				  uint64_t buf_size)
-	: m_state(STATE_CONNECTING),
+	: m_handshake(new handshake_state()),
+	  m_retain_handshake(false),
+	  m_state(STATE_CONNECTING),
 	  m_writing(false),
+	  m_send_low_watermark(DEFAULT_SEND_LOW_WATERMARK),
+	  m_send_high_watermark(DEFAULT_SEND_HIGH_WATERMARK),
+	  m_send_blocked(false),
+	  m_slow_consumer_policy(SLOW_CONSUMER_REFUSE),
+	  m_send_stall_timeout(DEFAULT_SEND_STALL_TIMEOUT),
+	  m_max_frame_size(DEFAULT_MAX_FRAME_SIZE),
 	  m_local_close_code(CLOSE_STATUS_NO_STATUS),
 	  m_remote_close_code(CLOSE_STATUS_NO_STATUS),
 	  m_was_clean(false),
@@ -56,10 +80,26 @@ session::session (boost::asio::io_service& io_service,
 	  m_socket(io_service),
 	  m_io_service(io_service),
 	  m_local_interface(defc),
-	  m_timer(io_service,boost::posix_time::seconds(0)),
-	  m_buf(buf_size), // maximum buffered (unconsumed) bytes from network
+	  m_timer(io_service),
+	  m_stall_timer(io_service),
+	  m_keepalive_interval(0),
+	  m_keepalive_timeout(0),
+	  m_keepalive(io_service),
+	  m_ping_sent(0),
+	  m_buf_size(buf_size),
 	  m_utf8_state(utf8_validator::UTF8_ACCEPT),
-	  m_utf8_codepoint(0) {}
+	  m_utf8_codepoint(0),
+	  m_compressed(false) {}
+
+session::~session() {
+	pending_send* p = m_pending_sends.pop_all();
+	
+	while (p != NULL) {
+		pending_send* next = p->next;
+		delete p;
+		p = next;
+	}
+}
 
 tcp::socket& session::socket() {
 	return m_socket;
@@ -99,11 +139,25 @@ const std::string& session::get_method() const {
 }
 
 std::string session::get_client_header(const std::string& key) const {
-	return get_header(key,m_client_headers);
+	if (!m_handshake) {
+		return "";
+	} else if (is_server()) {
+		return m_handshake->head.header(key).str();
+	}
+	return get_header(key,m_handshake->client_headers);
 }
 
 std::string session::get_server_header(const std::string& key) const {
-	return get_header(key,m_server_headers);
+	if (!m_handshake) {
+		return "";
+	} else if (!is_server()) {
+		return m_handshake->head.header(key).str();
+	}
+	return get_header(key,m_handshake->server_headers);
+}
+
+void session::retain_handshake() {
+	m_retain_handshake = true;
 }
 
 std::string session::get_header(const std::string& key,
@@ -125,28 +179,222 @@ unsigned int session::get_version() const {
 	return m_version;
 }
 
-void session::send(const std::string &msg) {
-	if (m_state != STATE_OPEN) {
-		log("Tried to send a message from a session that wasn't open",LOG_WARN);
-		return;
+session::send_status session::send(const std::string &msg) {
+	if (!in_session_thread()) {
+		pending_send* p = new pending_send();
+		p->op = frame::TEXT_FRAME;
+		p->data.assign(msg.begin(),msg.end());
+		return post_send(p);
 	}
-	m_write_frame.set_fin(true);
-	m_write_frame.set_opcode(frame::TEXT_FRAME);
-	m_write_frame.set_payload(msg);
 	
-	write_frame();
+	return send_data(frame::TEXT_FRAME,
+	                 reinterpret_cast<const unsigned char*>(msg.data()),
+	                 msg.size());
 }
 
-void session::send(const std::vector<unsigned char> &data) {
-	if (m_state != STATE_OPEN) {
-		log("Tried to send a message from a session that wasn't open",LOG_WARN);
-		return;
+session::send_status session::send(const std::vector<unsigned char> &data) {
+	if (!in_session_thread()) {
+		pending_send* p = new pending_send();
+		p->op = frame::BINARY_FRAME;
+		p->data = data;
+		return post_send(p);
+	}
+	
+	return send_data(frame::BINARY_FRAME,data.empty() ? NULL : &data[0],
+	                 data.size());
+}
+
+session::send_status session::send(const prepared_message& msg) {
+	if (!in_session_thread()) {
+		pending_send* p = new pending_send();
+		p->is_prepared = true;
+		p->prepared = msg;
+		return post_send(p);
+	}
+	
+	return send_prepared(msg,NULL);
+}
+
+session::send_status session::send(const prepared_message& msg,
+                                   const std::string& key) {
+	if (!in_session_thread()) {
+		pending_send* p = new pending_send();
+		p->is_prepared = true;
+		p->prepared = msg;
+		p->has_key = true;
+		p->key = key;
+		return post_send(p);
+	}
+	
+	return send_prepared(msg,&key);
+}
+
+session::send_status session::send_data(frame::opcode op,
+                                        const unsigned char* data,
+                                        size_t len) {
+	if (!admit_send(false)) {
+		return SEND_REJECTED;
 	}
 	m_write_frame.set_fin(true);
-	m_write_frame.set_opcode(frame::BINARY_FRAME);
-	m_write_frame.set_payload(data);
+	m_write_frame.set_opcode(op);
+	set_write_payload(data,len);
 	
 	write_frame();
+	
+	return get_send_status();
+}
+
+session::send_status session::send_prepared(const prepared_message& msg,
+                                            const std::string* key) {
+	if (!admit_send(key != NULL)) {
+		return SEND_REJECTED;
+	}
+	
+	if (msg.empty()) {
+		return get_send_status();
+	}
+	
+	// Client frames are masked separately for each session, and messages
+	// compressed with context from earlier ones are compressed separately
+	// too.
+	bool compress = m_deflate.is_active() && !msg.is_compressed() &&
+	                msg.get_opcode() <= frame::MAX_FRAME_OPCODE;
+	
+	if (!is_server() || (compress && m_deflate.get_shared_key() == 0)) {
+		m_write_frame.set_fin(true);
+		m_write_frame.set_opcode(msg.get_opcode());
+		
+		if (compress) {
+			set_write_payload(msg.get_payload_data(),msg.get_payload_size());
+		} else {
+			m_write_frame.set_payload(msg.get_payload_data(),
+			                          msg.get_payload_size());
+		}
+		
+		write_frame(key);
+		return get_send_status();
+	}
+	
+	const prepared_message& m = compress ? msg.get_compressed(m_deflate) : msg;
+	
+	uint64_t id = m_send_queue.begin_message(true);
+	
+	if (should_fragment(m.get_payload_size())) {
+		m_send_queue.push_fragmented(m.get_buffer(),m.get_payload_data(),
+		                             m.get_payload_size(),m.get_opcode(),
+		                             m.is_compressed(),m_max_frame_size);
+	} else {
+		m_send_queue.push(m.get_buffer());
+	}
+	
+	enforce_send_policy(id,key);
+	
+	write_frame_async_send();
+	
+	return get_send_status();
+}
+
+bool session::in_session_thread() const {
+	return m_io_service.get_executor().running_in_this_thread();
+}
+
+session::send_status session::post_send(pending_send* p) {
+	// Only the push that finds the queue empty posts. The handler takes 
+	// everything pushed until it runs.
+	if (m_pending_sends.push(p)) {
+		m_io_service.post(
+			boost::bind(&session::handle_pending_sends,shared_from_this())
+		);
+	}
+	return SEND_QUEUED;
+}
+
+void session::handle_pending_sends() {
+	pending_send* p = m_pending_sends.pop_all();
+	
+	while (p != NULL) {
+		if (p->is_prepared) {
+			send_prepared(p->prepared,p->has_key ? &p->key : NULL);
+		} else {
+			send_data(p->op,p->data.empty() ? NULL : &p->data[0],
+			          p->data.size());
+		}
+		
+		pending_send* next = p->next;
+		delete p;
+		p = next;
+	}
+}
+
+size_t session::get_buffered_amount() const {
+	return m_send_queue.size() + m_send_queue.in_flight_size();
+}
+
+void session::set_send_watermarks(size_t low,size_t high) {
+	m_send_low_watermark = std::min(low,high);
+	m_send_high_watermark = high;
+}
+
+size_t session::get_send_low_watermark() const {
+	return m_send_low_watermark;
+}
+
+size_t session::get_send_high_watermark() const {
+	return m_send_high_watermark;
+}
+
+void session::set_slow_consumer_policy(slow_consumer_policy policy) {
+	m_slow_consumer_policy = policy;
+}
+
+session::slow_consumer_policy session::get_slow_consumer_policy() const {
+	return m_slow_consumer_policy;
+}
+
+void session::set_send_stall_timeout(uint32_t ms) {
+	m_send_stall_timeout = ms;
+}
+
+void session::set_keepalive(uint32_t interval,uint32_t timeout) {
+	m_keepalive_interval = interval;
+	m_keepalive_timeout = timeout;
+	
+	if (m_state == STATE_OPEN) {
+		start_keepalive();
+	}
+}
+
+const session::rtt_stats& session::get_rtt() const {
+	return m_rtt;
+}
+
+void session::set_rtt_histogram(rtt_histogram_ptr histogram) {
+	m_rtt_histogram = histogram;
+}
+
+void session::set_max_frame_size(size_t size) {
+	m_max_frame_size = size;
+}
+
+size_t session::get_max_frame_size() const {
+	return m_max_frame_size;
+}
+
+void session::set_permessage_deflate(const permessage_deflate::settings& s) {
+	m_deflate_settings = s;
+}
+
+bool session::is_compressed() const {
+	return m_deflate.is_active();
+}
+
+const websocketpp::permessage_deflate::counters&
+session::get_compression_counters() const {
+	return m_deflate.get_counters();
+}
+
+const session::send_counters& session::get_send_counters() const {
+	return m_send_counters;
 }
 
 // end user interface to close the connection
@@ -163,22 +411,27 @@ void session::close(uint16_t status,const std::string& msg) {
 
 // called by process_close when an initiate close method is received.
 
-void session::send_close(uint16_t status,const std::string &message) {
+void session::send_close(uint16_t status,const std::string &message,
+                         bool drop_queued) {
 	if (m_state != STATE_OPEN) {
 		log("Tried to disconnect a session that wasn't open",LOG_WARN);
 		return;
 	}
+	
+	// The close frame goes after any queued data. If nobody is going to 
+	// read that data get it out of the way first.
+	if (drop_queued) {
+		while (m_send_queue.drop_oldest(0)) {
+			m_send_counters.dropped++;
+		}
+	}
 
 	m_state = STATE_CLOSING;
+	m_keepalive.stop();
 	
-	m_timer.expires_from_now(boost::posix_time::milliseconds(1000));
-	
-	m_timer.async_wait(
-		boost::bind(
-			&session::handle_close_expired,
-			shared_from_this(),
-			boost::asio::placeholders::error
-		)
+	m_timer.start(
+		1000,
+		boost::bind(&session::handle_close_expired,shared_from_this())
 	);
 	
 	m_local_close_code = status;
@@ -228,16 +481,54 @@ void session::pong(const std::string &msg) {
 	write_frame();
 }
 
+session::handshake_state& session::handshake() {
+	if (!m_handshake) {
+		m_handshake.reset(new handshake_state());
+	}
+	return *m_handshake;
+}
+
+void session::release_handshake() {
+	if (!m_retain_handshake) {
+		m_handshake.reset();
+	}
+}
+
 void session::read_frame() {
-	// the initial read in the handshake may have read in the first frame.
-	// handle it (if it exists) before we read anything else.
-	handle_read_frame(boost::system::error_code());
+	// Anything read past the handshake, such as the first frame, is already
+	// in m_read_buf and is handled before reading anything else.
+	release_handshake();
+	
+	// Reads after a wait for readability must not block if the data turns
+	// out not to be there.
+	boost::system::error_code ec;
+	m_socket.non_blocking(true,ec);
+	
+	handle_read_frame(boost::system::error_code(),0);
 }
 
 // handle_read_frame reads and processes all socket read commands for the 
 // session by consuming the read buffer and then starting an async read with
 // itself as the callback. The connection is over when this method returns.
-void session::handle_read_frame(const boost::system::error_code& error) {
+void session::handle_read_frame(const boost::system::error_code& error,
+                                std::size_t bytes_transferred) {
+	// A read that didn't fill the buffer took everything the socket had.
+	bool drained = bytes_transferred == 0 || 
+	               bytes_transferred < m_read_buf.space();
+	
+	m_read_buf.commit(bytes_transferred);
+	
+	if (bytes_transferred > 0) {
+		m_keepalive.touch();
+	}
+	
+	// Some other part of the session closed the socket, after a write error
+	// or an unanswered ping, and the session is usually closed already. 
+	// Everything has been logged and dropped so there is nothing to do.
+	if (error == boost::asio::error::operation_aborted) {
+		return;
+	}
+	
 	if (m_state != STATE_OPEN && m_state != STATE_CLOSING) {
 		log("handle_read_frame called in invalid state",LOG_ERROR);
 		return;
@@ -250,11 +541,6 @@ void session::handle_read_frame(const boost::system::error_code& error) {
 			log_error("Recieved EOF",error);
 			//drop_tcp(false);
 			//m_state = STATE_CLOSED;
-		} else if (error == boost::asio::error::operation_aborted) {
-			// some other part of our client called shutdown on our socket.
-			// This is usually due to a write error. Everything should have 
-			// already been logged and dropped so we just return here
-			return;
 		} else {
 			log_error("Error reading frame",error);
 			//drop_tcp(false);
@@ -262,34 +548,37 @@ void session::handle_read_frame(const boost::system::error_code& error) {
 		}
 	}
 	
-	std::istream s(&m_buf);
-	
-	while (m_buf.size() > 0 && m_state != STATE_CLOSED) {
+	while (!m_read_buf.empty() && m_state != STATE_CLOSED) {
 		try {
 			if (m_read_frame.get_bytes_needed() == 0) {
 				throw frame_error("have bytes that no frame needs",frame::FERR_FATAL_SESSION_ERROR);
 			}
 			
-			// Consume will read bytes from s
+			// Consume will read bytes from m_read_buf
 			// will throw a frame_error on error.
 			
-			std::stringstream err;
+			WEBSOCKETPP_LOG(LOG_DEBUG,"consuming. have: " << m_read_buf.size() << " bytes. Need: " << m_read_frame.get_bytes_needed() << " state: " << (int)m_read_frame.get_state());
 			
-			err << "consuming. have: " << m_buf.size() << " bytes. Need: " << m_read_frame.get_bytes_needed() << " state: " << (int)m_read_frame.get_state();
-			log(err.str(),LOG_DEBUG);
-			m_read_frame.consume(s);
+			// Text payloads are validated as they are read. Frames that the
+			// session is going to ignore anyway are not, and neither are 
+			// compressed ones.
+			if (m_state == STATE_OPEN && !(m_fragmented && m_compressed)) {
+				m_read_frame.set_message_context(m_fragmented,m_current_opcode,
+				                                 &m_utf8_state,&m_utf8_codepoint);
+			} else {
+				m_read_frame.set_message_context(m_fragmented,m_current_opcode,
+				                                 NULL,NULL);
+			}
+			
+			m_read_frame.consume(m_read_buf);
 			
-			err.str("");
-			err << "consume complete, " << m_buf.size() << " bytes left, " << m_read_frame.get_bytes_needed() << " still needed, state: " << (int)m_read_frame.get_state();
-			log(err.str(),LOG_DEBUG);
+			WEBSOCKETPP_LOG(LOG_DEBUG,"consume complete, " << m_read_buf.size() << " bytes left, " << m_read_frame.get_bytes_needed() << " still needed, state: " << (int)m_read_frame.get_state());
 			
 			if (m_read_frame.get_state() == frame::STATE_READY) {
 				// process frame and reset frame state for the next frame.
 				// will throw a frame_error on error. May set m_state to CLOSED,
 				// if so no more frames should be processed.
-				err.str("");
-				err << "processing frame " << m_buf.size();
-				log(err.str(),LOG_DEBUG);
+				WEBSOCKETPP_LOG(LOG_DEBUG,"processing frame " << m_read_buf.size());
 				m_timer.cancel();
 				process_frame();
 			}
@@ -310,17 +599,19 @@ void session::handle_read_frame(const boost::system::error_code& error) {
 			// process different types of frame errors
 			// 
 			if (e.code() == frame::FERR_PROTOCOL_VIOLATION) {
-				send_close(CLOSE_STATUS_PROTOCOL_ERROR, e.what());
+				send_close(CLOSE_STATUS_PROTOCOL_ERROR, e.what(), true);
 			} else if (e.code() == frame::FERR_PAYLOAD_VIOLATION) {
-				send_close(CLOSE_STATUS_INVALID_PAYLOAD, e.what());
+				send_close(CLOSE_STATUS_INVALID_PAYLOAD, e.what(), true);
 			} else if (e.code() == frame::FERR_INTERNAL_SERVER_ERROR) {
-				send_close(CLOSE_STATUS_ABNORMAL_CLOSE, e.what());
+				send_close(CLOSE_STATUS_ABNORMAL_CLOSE, e.what(), true);
+			} else if (e.code() == frame::FERR_MSG_TOO_BIG) {
+				send_close(CLOSE_STATUS_MESSAGE_TOO_BIG, e.what(), true);
 			} else if (e.code() == frame::FERR_SOFT_SESSION_ERROR) {
 				// ignore and continue processing frames
 				continue;
 			} else {
 				// Fatal error, forcibly end connection immediately.
-				log("Dropping TCP due to unrecoverable exception",LOG_DEBUG);
+				WEBSOCKETPP_LOG(LOG_DEBUG,"Dropping TCP due to unrecoverable exception");
 				drop_tcp(true);
 			}
 			
@@ -334,23 +625,30 @@ void session::handle_read_frame(const boost::system::error_code& error) {
 	
 	// we have read everything, check if we should read more
 	
-	if ((m_state == STATE_OPEN || m_state == STATE_CLOSING) && m_read_frame.get_bytes_needed() > 0) {
-		std::stringstream msg;
-		msg << "starting async read for " << m_read_frame.get_bytes_needed() << " bytes.";
-		
-		log(msg.str(),LOG_DEBUG);
+	if ((m_state == STATE_OPEN || m_state == STATE_CLOSING) && m_read_frame.get_bytes_needed() > 0 &&
+	    drained && m_read_buf.empty())
+	{
+		// Nothing is waiting to be read, which for most sessions most of the
+		// time means nothing will be for a while. Give the buffer back until
+		// there is.
+		wait_read();
+	} else if ((m_state == STATE_OPEN || m_state == STATE_CLOSING) && m_read_frame.get_bytes_needed() > 0) {
+		WEBSOCKETPP_LOG(LOG_DEBUG,"starting async read for " << m_read_frame.get_bytes_needed() << " bytes.");
 		
 		// TODO: set a timer here in case we don't want to read forever. 
 		// Ex: when the frame is in a degraded state.
 		
-		boost::asio::async_read(
-			m_socket,
-			m_buf,
-			boost::asio::transfer_at_least(m_read_frame.get_bytes_needed()),
+		// Read whatever has arrived, up to the free space in the buffer. A
+		// frame bigger than that is copied out of the buffer as it comes in.
+		unsigned char* space = m_read_buf.prepare(receive_buffer::MIN_READ_SIZE);
+		
+		m_socket.async_read_some(
+			boost::asio::buffer(space,m_read_buf.space()),
 			boost::bind(
 				&session::handle_read_frame,
 				shared_from_this(),
-				boost::asio::placeholders::error
+				boost::asio::placeholders::error,
+				boost::asio::placeholders::bytes_transferred
 			)
 		);
 	} else if (m_state == STATE_CLOSED) {
@@ -367,8 +665,48 @@ void session::handle_read_frame(const boost::system::error_code& error) {
 	}
 }
 
+void session::wait_read() {
+	m_read_buf.release();
+	
+	m_socket.async_wait(
+		tcp::socket::wait_read,
+		boost::bind(
+			&session::handle_read_ready,
+			shared_from_this(),
+			boost::asio::placeholders::error
+		)
+	);
+}
+
+void session::handle_read_ready(const boost::system::error_code& error) {
+	if (error) {
+		handle_read_frame(error,0);
+		return;
+	}
+	
+	boost::system::error_code ec;
+	unsigned char* space = m_read_buf.prepare(receive_buffer::MIN_READ_SIZE);
+	size_t n = m_socket.read_some(boost::asio::buffer(space,m_read_buf.space()),ec);
+	
+	if (ec == boost::asio::error::would_block) {
+		wait_read();
+		return;
+	}
+	
+	handle_read_frame(ec,n);
+}
+
 void session::process_frame () {
-	log("process_frame",LOG_DEBUG);
+	WEBSOCKETPP_LOG(LOG_DEBUG,"process_frame");
+	
+	// RSV1 can only be set if permessage-deflate was negotiated, and marks
+	// the first frame of a compressed message
+	if (m_read_frame.get_rsv1() && 
+	    (m_read_frame.is_control() || 
+	     m_read_frame.get_opcode() == frame::CONTINUATION_FRAME))
+	{
+		throw frame_error("Reserved bit used",frame::FERR_PROTOCOL_VIOLATION);
+	}
 	
 	if (m_state == STATE_OPEN) {
 		switch (m_read_frame.get_opcode()) {
@@ -382,7 +720,7 @@ void session::process_frame () {
 				process_binary();
 				break;
 			case frame::CONNECTION_CLOSE:
-				log("process_close",LOG_DEBUG);
+				WEBSOCKETPP_LOG(LOG_DEBUG,"process_close");
 				process_close();
 				break;
 			case frame::PING:
@@ -401,7 +739,7 @@ void session::process_frame () {
 			process_close();
 		} else {
 			// Ignore all other frames in closing state
-			log("ignoring this frame",LOG_DEBUG);
+			WEBSOCKETPP_LOG(LOG_DEBUG,"ignoring this frame");
 		}
 	} else {
 		// Recieved message before or after connection was opened/closed
@@ -411,45 +749,133 @@ void session::process_frame () {
 	m_read_frame.reset();
 }
 
-void session::handle_write_frame (const boost::system::error_code& error, boost::shared_ptr<std::vector<unsigned char> > data) {
+void session::handle_write_frame (const boost::system::error_code& error) {
+	finish_write();
+	
 	if (error) {
 		log_error("Error writing frame data",error);
 		drop_tcp(false);
+		
+		// the socket is gone, nothing queued will ever be written
+		m_send_queue.clear();
+		m_conflation_ids.clear();
+		m_send_blocked = false;
+		return;
 	}
 	
-	access_log("handle_write_frame complete",ALOG_FRAME);
-	m_writing = false;
+	WEBSOCKETPP_ALOG(ALOG_FRAME,"handle_write_frame complete");
+
+	if (m_send_queue.empty()) {
+		// nothing left that could be conflated with
+		m_conflation_ids.clear();
+	}
 
 	write_frame_async_send();
+	
+	if (m_send_blocked && get_buffered_amount() <= m_send_low_watermark) {
+		m_send_blocked = false;
+		
+		m_stall_timer.cancel();
+		
+		if (m_state == STATE_OPEN && m_local_interface) {
+			m_local_interface->on_drain(shared_from_this());
+		}
+	}
 }
 
+bool session::admit_send(bool keyed) {
+	if (m_state != STATE_OPEN) {
+		log("Tried to send a message from a session that wasn't open",LOG_WARN);
+		return false;
+	}
+	
+	if (get_buffered_amount() <= m_send_high_watermark) {
+		return true;
+	}
+	
+	// These policies make room after the message has been queued.
+	if (m_slow_consumer_policy == SLOW_CONSUMER_DROP_OLDEST ||
+	    (m_slow_consumer_policy == SLOW_CONSUMER_CONFLATE && keyed))
+	{
+		return true;
+	}
+	
+	m_send_blocked = true;
+	m_send_counters.refused++;
+	return false;
+}
 
-void session::handle_timer_expired (const boost::system::error_code& error) {
-	if (error) {
-		if (error == boost::asio::error::operation_aborted) {
-			log("timer was aborted",LOG_DEBUG);
-			//drop_tcp(false);
+void session::enforce_send_policy(uint64_t id,const std::string* key) {
+	if (m_slow_consumer_policy == SLOW_CONSUMER_CONFLATE && key != NULL) {
+		std::map<std::string,uint64_t>::iterator it;
+		it = m_conflation_ids.find(*key);
+		
+		if (it == m_conflation_ids.end()) {
+			m_conflation_ids.insert(std::make_pair(*key,id));
 		} else {
-			log("timer ended with error",LOG_DEBUG);
+			if (m_send_queue.drop_message(it->second)) {
+				m_send_counters.conflated++;
+			}
+			it->second = id;
 		}
-		return;
+	} else if (m_slow_consumer_policy == SLOW_CONSUMER_DROP_OLDEST) {
+		while (get_buffered_amount() > m_send_high_watermark &&
+		       m_send_queue.drop_oldest(id))
+		{
+			m_send_counters.dropped++;
+		}
+	}
+}
+
+session::send_status session::get_send_status() {
+	if (get_buffered_amount() <= m_send_high_watermark) {
+		return SEND_OK;
+	}
+	
+	// the handler is told when it may send again
+	m_send_blocked = true;
+	
+	if (m_slow_consumer_policy == SLOW_CONSUMER_DISCONNECT && 
+	    !m_stall_timer.pending()) 
+	{
+		m_stall_timer.start(
+			m_send_stall_timeout,
+			boost::bind(&session::handle_send_stall_expired,shared_from_this())
+		);
 	}
 	
-	log("timer ended without error",LOG_DEBUG);
+	return SEND_BLOCKED;
+}
+
+void session::handle_send_stall_expired() {
+	if (m_state != STATE_OPEN || !m_send_blocked) {
+		return;
+	}
 	
+	log("Closing session that did not drain its send buffer in time",LOG_WARN);
 	
+	send_close(CLOSE_STATUS_POLICY_VIOLATION,"Slow consumer",true);
 }
 
-void session::handle_handshake_expired (const boost::system::error_code& error) {
+
+void session::handle_timer_expired (const boost::system::error_code& error) {
 	if (error) {
-		if (error != boost::asio::error::operation_aborted) {
-			log("Unexpected handshake timer error.",LOG_DEBUG);
-			drop_tcp(true);
+		if (error == boost::asio::error::operation_aborted) {
+			WEBSOCKETPP_LOG(LOG_DEBUG,"timer was aborted");
+			//drop_tcp(false);
+		} else {
+			WEBSOCKETPP_LOG(LOG_DEBUG,"timer ended with error");
 		}
 		return;
 	}
 	
-	log("Handshake timed out",LOG_DEBUG);
+	WEBSOCKETPP_LOG(LOG_DEBUG,"timer ended without error");
+	
+	
+}
+
+void session::handle_handshake_expired() {
+	WEBSOCKETPP_LOG(LOG_DEBUG,"Handshake timed out");
 	drop_tcp(true);
 }
 
@@ -461,57 +887,91 @@ void session::handle_handshake_expired (const boost::system::error_code& error)
 void session::handle_error_timer_expired (const boost::system::error_code& error) {
 	if (error) {
 		if (error == boost::asio::error::operation_aborted) {
-			log("error timer was aborted",LOG_DEBUG);
+			WEBSOCKETPP_LOG(LOG_DEBUG,"error timer was aborted");
 			//drop_tcp(false);
 		} else {
-			log("error timer ended with error",LOG_DEBUG);
+			WEBSOCKETPP_LOG(LOG_DEBUG,"error timer ended with error");
 			drop_tcp(true);
 		}
 		return;
 	}
 	
-	log("error timer ended without error",LOG_DEBUG);
+	WEBSOCKETPP_LOG(LOG_DEBUG,"error timer ended without error");
 	drop_tcp(true);
 }
 
-void session::handle_close_expired (const boost::system::error_code& error) {
-	if (error) {
-		if (error == boost::asio::error::operation_aborted) {
-			log("timer was aborted",LOG_DEBUG);
-			//drop_tcp(false);
-		} else {
-			log("Unexpected close timer error.",LOG_DEBUG);
-			drop_tcp(false);
-		}
-		return;
-	}
-	
+void session::handle_close_expired() {
 	if (m_state != STATE_CLOSED) {
-		log("close timed out",LOG_DEBUG);
+		WEBSOCKETPP_LOG(LOG_DEBUG,"close timed out");
 		drop_tcp(false);
 	}
 }
 
 void session::process_ping() {
-	access_log("Ping",ALOG_MISC_CONTROL);
+	WEBSOCKETPP_ALOG(ALOG_MISC_CONTROL,"Ping");
 	// TODO: on_ping
 
 	// send pong
 	m_write_frame.set_fin(true);
 	m_write_frame.set_opcode(frame::PONG);
-	m_write_frame.set_payload(m_read_frame.get_payload());
+	m_write_frame.set_payload(m_read_frame.get_payload_data(),
+	                          m_read_frame.get_payload_size());
 	
 	write_frame();
 }
 
 void session::process_pong() {
-	access_log("Pong",ALOG_MISC_CONTROL);
+	WEBSOCKETPP_ALOG(ALOG_MISC_CONTROL,"Pong");
 	// TODO: on_pong
+	
+	if (m_ping_sent == 0 || m_read_frame.get_payload_size() != 8) {
+		return;
+	}
+	
+	// only the pong for the latest keepalive ping counts
+	const unsigned char* p = m_read_frame.get_payload_data();
+	uint64_t sent = 0;
+	
+	for (int i = 0; i < 8; i++) {
+		sent = (sent << 8) | p[i];
+	}
+	
+	if (sent != m_ping_sent) {
+		return;
+	}
+	
+	m_ping_sent = 0;
+	
+	uint64_t now = now_us();
+	if (now < sent) {
+		// the clock went back
+		return;
+	}
+	
+	uint64_t rtt = now - sent;
+	
+	if (m_rtt.samples == 0) {
+		m_rtt.smoothed = rtt;
+		m_rtt.min = rtt;
+		m_rtt.max = rtt;
+	} else {
+		m_rtt.smoothed = m_rtt.smoothed - m_rtt.smoothed/8 + rtt/8;
+		m_rtt.min = std::min(m_rtt.min,rtt);
+		m_rtt.max = std::max(m_rtt.max,rtt);
+	}
+	m_rtt.last = rtt;
+	m_rtt.samples++;
+	
+	if (m_rtt_histogram) {
+		m_rtt_histogram->record(rtt);
+	}
 }
 
 void session::process_text() {
 	// this will throw an exception if validation fails at any point
-	m_read_frame.validate_utf8(&m_utf8_state,&m_utf8_codepoint);
+	if (!m_read_frame.get_rsv1() && !m_read_frame.is_utf8_validated()) {
+		m_read_frame.validate_utf8(&m_utf8_state,&m_utf8_codepoint);
+	}
 	
 	// otherwise, treat as binary
 	process_binary();
@@ -524,13 +984,21 @@ void session::process_binary() {
 	}
 	
 	m_current_opcode = m_read_frame.get_opcode();
+	m_compressed = m_read_frame.get_rsv1();
+	
+	if (m_compressed) {
+		inflate_payload();
+	}
 	
 	if (m_read_frame.get_fin()) {
 		deliver_message();
 		reset_message();
 	} else {
 		m_fragmented = true;
-		extract_payload();
+		
+		if (!m_compressed) {
+			extract_payload();
+		}
 	}
 }
 
@@ -540,12 +1008,17 @@ void session::process_continuation() {
 						  frame::FERR_PROTOCOL_VIOLATION);
 	}
 	
-	if (m_current_opcode == frame::TEXT_FRAME) {
-		// this will throw an exception if validation fails at any point
-		m_read_frame.validate_utf8(&m_utf8_state,&m_utf8_codepoint);
+	if (m_compressed) {
+		inflate_payload();
+	} else {
+		if (m_current_opcode == frame::TEXT_FRAME && 
+			!m_read_frame.is_utf8_validated()) {
+			// this will throw an exception if validation fails at any point
+			m_read_frame.validate_utf8(&m_utf8_state,&m_utf8_codepoint);
+		}
+		
+		extract_payload();
 	}
-
-	extract_payload();
 	
 	// check if we are done
 	if (m_read_frame.get_fin()) {
@@ -559,23 +1032,23 @@ void session::process_close() {
 	m_remote_close_msg = m_read_frame.get_close_msg();
 
 	if (m_state == STATE_OPEN) {
-		log("process_close sending ack",LOG_DEBUG);
+		WEBSOCKETPP_LOG(LOG_DEBUG,"process_close sending ack");
 		// This is the case where the remote initiated the close.
 		m_closed_by_me = false;
 		// send acknowledgement
 		
 		// check if the remote close code
 		if (m_remote_close_code == close::status::NO_STATUS) {
-			send_close(close::status::NORMAL,"");
+			send_close(close::status::NORMAL,"",true);
 		} else if (close::status::invalid(m_remote_close_code)) {
-			send_close(close::status::PROTOCOL_ERROR,"Invalid status code");
+			send_close(close::status::PROTOCOL_ERROR,"Invalid status code",true);
 		} else if (close::status::reserved(m_remote_close_code)) {
-			send_close(close::status::PROTOCOL_ERROR,"Reserved status code");
+			send_close(close::status::PROTOCOL_ERROR,"Reserved status code",true);
 		} else {
-			send_close(m_remote_close_code,m_remote_close_msg);
+			send_close(m_remote_close_code,m_remote_close_msg,true);
 		}
 	} else if (m_state == STATE_CLOSING) {
-		log("process_close got ack",LOG_DEBUG);
+		WEBSOCKETPP_LOG(LOG_DEBUG,"process_close got ack");
 		// this is an ack of our close message
 		m_closed_by_me = true;
 	} else {
@@ -593,7 +1066,7 @@ void session::deliver_message() {
 	
 	if (m_current_opcode == frame::BINARY_FRAME) {
 		//log("Dispatching Binary Message",LOG_DEBUG);
-		if (m_fragmented) {
+		if (m_fragmented || m_compressed) {
 			m_local_interface->on_message(shared_from_this(),m_current_message);
 		} else {
 			m_local_interface->on_message(shared_from_this(),
@@ -611,12 +1084,12 @@ void session::deliver_message() {
 							  frame::FERR_PAYLOAD_VIOLATION);
 		}
 
-		if (m_fragmented) {
+		if (m_fragmented || m_compressed) {
 			msg.append(m_current_message.begin(),m_current_message.end());
 		} else {
 			msg.append(
-				m_read_frame.get_payload().begin(),
-				m_read_frame.get_payload().end()
+				reinterpret_cast<const char*>(m_read_frame.get_payload_data()),
+				m_read_frame.get_payload_size()
 			);
 		}
 		
@@ -632,59 +1105,213 @@ void session::deliver_message() {
 }
 
 void session::extract_payload() {
-	std::vector<unsigned char> &msg = m_read_frame.get_payload();
-	m_current_message.resize(m_current_message.size()+msg.size());
-	std::copy(msg.begin(),msg.end(),m_current_message.end()-msg.size());
+	const unsigned char* data = m_read_frame.get_payload_data();
+	buffer_pool::local().reserve(m_current_message,m_current_message.size()+
+	                             m_read_frame.get_payload_size());
+	m_current_message.insert(m_current_message.end(),data,
+	                         data+m_read_frame.get_payload_size());
 }
 
-void session::write_frame() {
+void session::inflate_payload() {
+	size_t offset = m_current_message.size();
+	
+	// A small frame can inflate to a huge message, so stop at the size the
+	// endpoint would accept uncompressed.
+	size_t limit = static_cast<size_t>(
+		std::min(m_buf_size,static_cast<uint64_t>(frame::max_payload_size))
+	);
+	
+	m_deflate.decompress(m_read_frame.get_payload_data(),
+	                     m_read_frame.get_payload_size(),
+	                     m_read_frame.get_fin(),
+	                     m_current_message,
+	                     limit);
+	
+	if (m_current_opcode == frame::TEXT_FRAME && 
+	    offset < m_current_message.size() &&
+	    !websocketpp::simd::validate_utf8(&m_current_message[offset],
+	                                      m_current_message.size()-offset,
+	                                      &m_utf8_state,&m_utf8_codepoint))
+	{
+		throw frame_error("Invalid UTF-8 Data",frame::FERR_PAYLOAD_VIOLATION);
+	}
+}
+
+void session::set_write_payload(const unsigned char* data,size_t len) {
+	frame::opcode op = m_write_frame.get_opcode();
+	
+	if (!m_deflate.is_active() || !m_deflate.should_compress(op,len) ||
+	    !m_deflate.compress(data,len,m_deflate_buffer)) 
+	{
+		m_write_frame.set_payload(data,len);
+		return;
+	}
+	
+	m_deflate.record(op,len,m_deflate_buffer.size());
+	
+	// Without context takeover nothing depends on this message having been
+	// compressed, so it can go as it is if compressing didn't pay.
+	if (m_deflate_buffer.size() >= len && m_deflate.get_shared_key() != 0) {
+		m_write_frame.set_payload(data,len);
+		return;
+	}
+	
+	m_write_frame.swap_payload(m_deflate_buffer);
+	m_write_frame.set_rsv1(true);
+}
+
+void session::start_extensions() {
+	if (m_deflate.is_active()) {
+		m_read_frame.set_extension_bits(frame::BPB0_RSV1);
+	}
+}
+
+void session::start_keepalive() {
+	if (m_keepalive_interval == 0) {
+		m_keepalive.stop();
+		return;
+	}
+	
+	// The scheduler doesn't hold a reference. The session stops it before
+	// it goes away.
+	m_keepalive.start(
+		m_keepalive_interval,
+		m_keepalive_timeout,
+		boost::bind(&session::handle_keepalive_idle,this),
+		boost::bind(&session::handle_ping_timeout,this)
+	);
+}
+
+void session::handle_keepalive_idle() {
+	if (m_state != STATE_OPEN) {
+		m_keepalive.stop();
+		return;
+	}
+	
+	// The payload is the send time, big endian, which the pong brings back.
+	m_ping_sent = now_us();
+	
+	char payload[8];
+	for (int i = 0; i < 8; i++) {
+		payload[i] = static_cast<char>(m_ping_sent >> (56 - 8*i));
+	}
+	
+	ping(std::string(payload,sizeof(payload)));
+}
+
+void session::handle_ping_timeout() {
+	session_ptr self = shared_from_this();
+	
+	log("Dropping session that did not answer a ping in time",LOG_WARN);
+	
+	if (m_local_interface) {
+		m_local_interface->on_ping_timeout(self);
+	}
+	
+	drop_tcp(true);
+	log_close_result();
+	
+	if (m_local_interface) {
+		m_local_interface->on_close(self);
+	}
+}
+
+void session::write_frame(const std::string* key) {
+	// pings and pongs skip ahead of queued data. Close frames have to stay
+	// behind it.
+	frame::opcode op = m_write_frame.get_opcode();
+	uint64_t id = m_send_queue.begin_message(
+		!m_write_frame.is_control(),
+		op == frame::PING || op == frame::PONG
+	);
+	
 	if (!is_server()) {
 		m_write_frame.set_masked(true); // client must mask frames
 	}
 	
 	m_write_frame.process_payload();
 
+	WEBSOCKETPP_LOG(LOG_DEBUG,"Write Frame: " << m_write_frame.print_frame());
+	
 	std::vector<unsigned char>& payload = m_write_frame.get_payload();
-	const char* header = m_write_frame.get_header();
-
-	if (!m_pending_send_data){
-		m_pending_send_data = boost::shared_ptr<std::vector<unsigned char> >(new std::vector<unsigned char>());
+	
+	if (!m_write_frame.is_control() && should_fragment(payload.size())) {
+		// the queue writes the headers of the fragments itself
+		shared_buffer_ptr buf = buffer_pool::local().make_shared_buffer(0);
+		m_write_frame.swap_payload(buf->get_data());
+		m_send_queue.push_fragmented(buf,&buf->get_data()[0],
+		                             buf->get_data().size(),
+		                             m_write_frame.get_opcode(),
+		                             m_write_frame.get_rsv1(),
+		                             m_max_frame_size);
+		m_write_frame.set_rsv1(false);
+		
+		enforce_send_policy(id,key);
+		write_frame_async_send();
+		return;
 	}
-
-	m_pending_send_data->reserve(m_pending_send_data->size() + m_write_frame.get_header_len() + payload.size());
-
-	m_pending_send_data->insert(m_pending_send_data->end(), header, header + m_write_frame.get_header_len());
-	m_pending_send_data->insert(m_pending_send_data->end(), payload.begin(), payload.end());
 	
-	log("Write Frame: "+m_write_frame.print_frame(),LOG_DEBUG);
+	m_send_queue.append(m_write_frame.get_header(),m_write_frame.get_header_len());
+	
+	// only set_write_payload marks a frame as compressed
+	m_write_frame.set_rsv1(false);
+	
+	if (payload.size() < send_queue::COPY_THRESHOLD) {
+		m_send_queue.append(m_write_frame.get_payload_data(),payload.size());
+	} else {
+		// hand the payload's storage to the queue rather than copying it
+		shared_buffer_ptr buf = buffer_pool::local().make_shared_buffer(0);
+		m_write_frame.swap_payload(buf->get_data());
+		m_send_queue.push(buf);
+	}
+	
+	if (!m_write_frame.is_control()) {
+		enforce_send_policy(id,key);
+	}
 
 	write_frame_async_send();
 }
 
 
+bool session::should_fragment(uint64_t payload_size) const {
+	// client frames are masked as a whole when they are queued
+	return is_server() && m_max_frame_size != 0 && 
+	       payload_size > m_max_frame_size;
+}
+
 void session::write_frame_async_send(){
-	if (!m_writing && m_pending_send_data){
-		m_writing = true;
-		
+	if (prepare_write()){
 		boost::asio::async_write(
 			m_socket,
-			boost::asio::buffer(*m_pending_send_data),
+			m_send_queue.prepare_write(),
 			boost::bind(
 				&session::handle_write_frame,
 				shared_from_this(),
-				boost::asio::placeholders::error,
-				m_pending_send_data
+				boost::asio::placeholders::error
 			)
 		);
+	}
+}
 
-		m_pending_send_data.reset();
+bool session::prepare_write() {
+	if (m_writing || m_send_queue.empty()) {
+		return false;
 	}
+	
+	m_writing = true;
+	return true;
+}
+
+void session::finish_write() {
+	m_writing = false;
+	m_send_queue.finish_write();
 }
 
 void session::reset_message() {
 	m_error = false;
 	m_fragmented = false;
-	m_current_message.clear();
+	m_compressed = false;
+	buffer_pool::local().release(m_current_message);
 
 	m_utf8_state = utf8_validator::UTF8_ACCEPT;
 	m_utf8_codepoint = 0;
@@ -739,6 +1366,8 @@ bool session::validate_app_close_status(uint16_t status) {
 
 void session::drop_tcp(bool dropped_by_me) {
 	m_timer.cancel();
+	m_stall_timer.cancel();
+	m_keepalive.stop();
 	try {
 		if (m_socket.is_open()) {
 			m_socket.shutdown(tcp::socket::shutdown_both);
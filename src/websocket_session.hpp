@@ -79,6 +79,7 @@
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
@@ -107,6 +108,16 @@ namespace websocketpp {
 #include "websocketpp.hpp"
 #include "websocket_frame.hpp"
 #include "websocket_connection_handler.hpp"
+#include "receive_buffer.hpp"
+#include "http_head.hpp"
+#include "buffer_pool.hpp"
+#include "prepared_message.hpp"
+#include "send_queue.hpp"
+#include "mpsc_queue.hpp"
+#include "timing_wheel.hpp"
+#include "keepalive.hpp"
+#include "rtt_histogram.hpp"
+#include "permessage_deflate.hpp"
 
 #include "base64/base64.h"
 #include "sha1/sha1.h"
@@ -126,6 +137,57 @@ public:
 	static const uint8_t STATE_CLOSING = 2;
 	static const uint8_t STATE_CLOSED = 3;
 	
+	// What a session does with data messages once it has more than its high
+	// watermark of outgoing data buffered.
+	enum slow_consumer_policy {
+		// refuse new messages (send returns SEND_REJECTED)
+		SLOW_CONSUMER_REFUSE = 0,
+		// refuse new messages, and close with 1008 (policy violation) if the
+		// buffer hasn't drained to the low watermark within the stall timeout
+		// of going over the high watermark
+		SLOW_CONSUMER_DISCONNECT = 1,
+		// accept new messages and discard the oldest queued data messages
+		// that haven't started to be written until back under the high 
+		// watermark. Control frames are never discarded.
+		SLOW_CONSUMER_DROP_OLDEST = 2,
+		// Messages sent with a conflation key replace any queued message with
+		// the same key that hasn't started to be written, whatever the 
+		// watermark. Keyed messages are always accepted, others are refused
+		// above the high watermark.
+		SLOW_CONSUMER_CONFLATE = 3
+	};
+	
+	struct send_counters {
+		send_counters() : refused(0),dropped(0),conflated(0) {}
+		
+		uint64_t	refused;	// sends that returned SEND_REJECTED
+		uint64_t	dropped;	// queued messages discarded
+		uint64_t	conflated;	// queued messages replaced by a newer one
+	};
+	
+	// Round trip times measured with keepalive pings, in microseconds. 
+	// smoothed moves an eighth of the way to each new sample.
+	struct rtt_stats {
+		rtt_stats() : samples(0),smoothed(0),min(0),max(0),last(0) {}
+		
+		uint64_t	samples;
+		uint64_t	smoothed;
+		uint64_t	min;
+		uint64_t	max;
+		uint64_t	last;
+	};
+	
+	// results of send()
+	enum send_status {
+		SEND_OK = 0,		// queued, the queue is below its high watermark
+		SEND_BLOCKED = 1,	// queued, but the queue is now above its high
+							// watermark. Wait for on_drain before sending more.
+		SEND_REJECTED = 2,	// not queued, the queue was already above its high
+							// watermark or the session isn't open
+		SEND_QUEUED = 3		// handed to the session's thread, which applies
+							// the watermarks when it queues the message
+	};
+	
 	static const uint16_t CLOSE_STATUS_NORMAL = 1000;
 	static const uint16_t CLOSE_STATUS_GOING_AWAY = 1001;
 	static const uint16_t CLOSE_STATUS_PROTOCOL_ERROR = 1002;
@@ -141,6 +203,7 @@ public:
 	session (boost::asio::io_service& io_service,
 			 connection_handler_ptr defc,
 			 uint64_t buf_size);
+	virtual ~session();
 	
 	tcp::socket& socket();
 	boost::asio::io_service& io_service();
@@ -185,19 +248,89 @@ public:
 	const std::string& get_origin() const;
 	std::string get_client_header(const std::string& key) const;
 	std::string get_server_header(const std::string& key) const;
+	
+	// The headers of the opening handshake are freed when the session 
+	// opens, after which get_client_header and get_server_header return "".
+	// The other values here stay valid. Calling this before then, from
+	// validate or on_open, keeps the headers for the life of the session.
+	void retain_handshake();
 	const std::vector<std::string>& get_extensions() const;
 	unsigned int get_version() const;
 	
 	/*** SESSION INTERFACE ***/
 	
 	// send basic frame types
-	void send(const std::string &msg); // text
-	void send(const std::vector<unsigned char> &data); // binary
+	//
+	// These may be called from any thread. From a thread other than the one
+	// running the session's io_service the message is passed to that thread
+	// through a lock free queue and SEND_QUEUED is returned. The session's
+	// thread is woken once for all the messages queued until it gets to 
+	// them. Messages refused there are counted in get_send_counters(), and
+	// on_drain is called as usual once there is room again.
+	send_status send(const std::string &msg); // text
+	send_status send(const std::vector<unsigned char> &data); // binary
+	send_status send(const prepared_message& msg); // shared, not copied
+	
+	// Under SLOW_CONSUMER_CONFLATE replaces any queued message with the same 
+	// key. Otherwise the same as send(msg).
+	send_status send(const prepared_message& msg,const std::string& key);
 	void ping(const std::string &msg);
 	void pong(const std::string &msg);
 	
 	// initiate a connection close
 	void close(uint16_t status,const std::string &reason);
+	
+	// Outgoing bytes queued or being written.
+	size_t get_buffered_amount() const;
+	
+	// Once more than high bytes are buffered further sends are refused until
+	// the buffer falls to low, at which point the handler's on_drain is 
+	// called. Control frames are never refused.
+	void set_send_watermarks(size_t low,size_t high);
+	size_t get_send_low_watermark() const;
+	size_t get_send_high_watermark() const;
+	
+	void set_slow_consumer_policy(slow_consumer_policy policy);
+	slow_consumer_policy get_slow_consumer_policy() const;
+	
+	// how long SLOW_CONSUMER_DISCONNECT gives the buffer to drain to the low
+	// watermark once it has gone over the high watermark, in milliseconds
+	void set_send_stall_timeout(uint32_t ms);
+	
+	// Pings the other endpoint once nothing has been received from it for
+	// interval milliseconds. If nothing arrives within timeout milliseconds 
+	// after that the connection is dropped, and the handler's 
+	// on_ping_timeout and then on_close are called. An interval of 0 turns
+	// keepalive off, which is the default. Takes effect when the session
+	// opens, or straight away if it is open.
+	void set_keepalive(uint32_t interval,uint32_t timeout);
+	
+	// Keepalive pings carry the time they were sent, and the pong that 
+	// answers the latest of them gives a round trip time. 
+	const rtt_stats& get_rtt() const;
+	
+	// Also records round trip times into histogram, which may be shared
+	// with other sessions.
+	void set_rtt_histogram(rtt_histogram_ptr histogram);
+	
+	// Messages with payloads bigger than this are sent as several frames of
+	// at most this size, so that pings and pongs can go out in between. 0
+	// turns fragmentation off. Only server sessions fragment messages.
+	void set_max_frame_size(size_t size);
+	size_t get_max_frame_size() const;
+	
+	// What permessage-deflate to offer (clients) or accept (servers) in the
+	// opening handshake. Off by default. Has no effect once the handshake 
+	// is done.
+	void set_permessage_deflate(const permessage_deflate::settings& s);
+	
+	// true if permessage-deflate was negotiated
+	bool is_compressed() const;
+	
+	// which outgoing messages were compressed, and how well
+	const permessage_deflate::counters& get_compression_counters() const;
+	
+	const send_counters& get_send_counters() const;
 
 	virtual bool is_server() const = 0;
 
@@ -206,7 +339,7 @@ public:
 	virtual void handle_write_handshake(const boost::system::error_code& e) = 0;
 	virtual void handle_read_handshake(const boost::system::error_code& e,
 	                                   std::size_t bytes_transferred) = 0;
-	virtual void handle_write_http_response(const boost::system::error_code& error, boost::shared_ptr<std::vector<unsigned char> >) = 0;
+	virtual void handle_write_http_response(const boost::system::error_code& error) = 0;
 	virtual void handle_read_http_post_body(const boost::system::error_code& e,
 	                 std::size_t bytes_transferred, boost::function<void(std::string)> callback) = 0;
 	virtual void handle_http_read_for_eof(const boost::system::error_code& e) = 0;
@@ -215,16 +348,74 @@ public: //protected:
 	virtual void read_handshake() = 0;
 	
 	void read_frame();
-	void handle_read_frame (const boost::system::error_code& error);
+	void handle_read_frame (const boost::system::error_code& error,
+	                        std::size_t bytes_transferred);
 	
-	// write m_write_frame out to the socket.
-	void write_frame();
+	// Waits for the socket to become readable without holding a receive 
+	// buffer, then reads what has arrived.
+	void wait_read();
+	void handle_read_ready(const boost::system::error_code& error);
+	
+	// write m_write_frame out to the socket. key is the conflation key of a
+	// data frame, if it has one.
+	void write_frame(const std::string* key = NULL);
 	void write_frame_async_send();
-	void handle_write_frame (const boost::system::error_code& error, boost::shared_ptr<std::vector<unsigned char> > data);
+	
+	// true if a data frame with this much payload is sent as fragments
+	bool should_fragment(uint64_t payload_size) const;
+	
+	void handle_write_frame (const boost::system::error_code& error);
+	
+	send_status send_data(frame::opcode op,const unsigned char* data,size_t len);
+	send_status send_prepared(const prepared_message& msg,const std::string* key);
+	
+	// A message sent from another thread, waiting for the session's thread.
+	// Text and binary messages are copied into data.
+	struct pending_send {
+		pending_send() : next(NULL),is_prepared(false),has_key(false) {}
+		
+		pending_send*				next;
+		frame::opcode				op;
+		std::vector<unsigned char>	data;
+		bool						is_prepared;
+		prepared_message			prepared;
+		bool						has_key;
+		std::string					key;
+	};
+	
+	// true if this thread is running the session's io_service
+	bool in_session_thread() const;
+	
+	// Queues p for the session's thread and wakes it if it isn't already
+	// due to look at the queue.
+	send_status post_send(pending_send* p);
+	
+	// Sends everything queued by other threads.
+	void handle_pending_sends();
+	
+	// Checks whether a data message may be sent given the state of the 
+	// session and its send queue.
+	bool admit_send(bool keyed);
+	
+	// Applies the slow consumer policy after data message id was queued.
+	void enforce_send_policy(uint64_t id,const std::string* key);
+	
+	send_status get_send_status();
+	void handle_send_stall_expired();
+	
+	// Returns false if a write is already in progress or there is nothing
+	// to write. Otherwise the next write should be started with the buffers
+	// from m_send_queue.prepare_write().
+	bool prepare_write();
+	void finish_write();
 	
 	void handle_timer_expired(const boost::system::error_code& error);
-	void handle_handshake_expired(const boost::system::error_code& error);
-	void handle_close_expired(const boost::system::error_code& error);
+	void handle_handshake_expired();
+	void handle_close_expired();
+	
+	void start_keepalive();
+	void handle_keepalive_idle();
+	void handle_ping_timeout();
 	void handle_error_timer_expired (const boost::system::error_code& error);
 	
 	// helper functions for processing each opcode
@@ -244,12 +435,25 @@ public: //protected:
 	// messages are recieved.
 	void extract_payload();
 	
+	// inflates the current read frame payload onto the end of the message.
+	// This is done for every frame of a compressed message.
+	void inflate_payload();
+	
+	// sets the payload of the write frame for a data message, compressing it
+	// if permessage-deflate is in use
+	void set_write_payload(const unsigned char* data,size_t len);
+	
+	// called once the handshake has settled on the extensions in use
+	void start_extensions();
+	
 	// reset session for a new message
 	void reset_message();
 	
 	// logging
 	virtual void log(const std::string& msg, uint16_t level) const = 0;
 	virtual void access_log(const std::string& msg, uint16_t level) const = 0;
+	virtual bool test_elog_level(uint16_t level) const = 0;
+	virtual bool test_alog_level(uint16_t level) const = 0;
 	
 	void log_close_result();
 	void log_open_result();
@@ -257,40 +461,79 @@ public: //protected:
 	
 	// misc helpers
 	bool validate_app_close_status(uint16_t status);
-	void send_close(uint16_t status,const std::string& reason);
+	// drop_queued discards queued data that hasn't started to be written
+	// rather than sending it ahead of the close frame.
+	void send_close(uint16_t status,const std::string& reason,
+	                bool drop_queued = false);
 	void drop_tcp(bool dropped_by_me = true);
+	
+	// Frees the handshake state, unless it is retained. Nothing else needs
+	// it once frames are being read.
+	void release_handshake();
 private:
 	std::string get_header(const std::string& key,
 	                       const header_list& list) const;
 
 protected:
-	// Immutable state about the current connection from the handshake
-	// Client handshake
-	std::string					m_raw_client_handshake;
-	std::string					m_client_http_request;
+	// State that is only needed until the session opens, or for the life of
+	// the session if retain_handshake is called. It is allocated separately
+	// so that open sessions don't carry it.
+	struct handshake_state {
+		handshake_state() {}
+		
+		// the head of the HTTP request (on a server) or response (on a 
+		// client) read from the other endpoint
+		http_head					head;
+		
+		// Client handshake
+		std::string					raw_client_handshake;
+		std::string					http_version;
+		header_list					client_headers;
+		std::vector<std::string>	client_subprotocols;
+		std::vector<std::string>	client_extensions;
+		
+		// Server handshake
+		std::string					raw_server_handshake;
+		header_list					server_headers;
+		std::string					server_http_string;
+		std::string					server_http_body;
+	};
+	
+	// The handshake state, allocated again (empty) if it has been released.
+	handshake_state& handshake();
+	
+	// Immutable state about the current connection from the handshake, 
+	// valid once the connection is open.
 	std::string					m_resource;
 	std::string					m_http_method;
-	std::string					m_http_version;
 	std::string					m_client_origin;
-	header_list					m_client_headers;
-	std::vector<std::string>	m_client_subprotocols;
-	std::vector<std::string>	m_client_extensions;
 	unsigned int				m_version;
-
-	// Server handshake
-	std::string					m_raw_server_handshake;
-	std::string					m_server_http_request;
-	header_list					m_server_headers;
 	std::string					m_server_subprotocol;
 	std::vector<std::string>	m_server_extensions;
 	uint16_t					m_server_http_code;
-	std::string					m_server_http_string;
-	std::string					m_server_http_body;
+	
+	boost::scoped_ptr<handshake_state>	m_handshake;
+	bool						m_retain_handshake;
 
 	// Mutable connection state;
 	uint8_t						m_state;
 	bool						m_writing;
-	boost::shared_ptr<std::vector<unsigned char> > m_pending_send_data;
+	send_queue					m_send_queue;
+	size_t						m_send_low_watermark;
+	size_t						m_send_high_watermark;
+	
+	// true once a send has been refused or reported SEND_BLOCKED, until
+	// on_drain is called
+	bool						m_send_blocked;
+	
+	slow_consumer_policy		m_slow_consumer_policy;
+	uint32_t					m_send_stall_timeout;
+	size_t						m_max_frame_size;
+	send_counters				m_send_counters;
+	mpsc_queue<pending_send>	m_pending_sends;
+	
+	// conflation key to the id of the latest message queued with it
+	std::map<std::string,uint64_t>	m_conflation_ids;
 
 	// Close state
 	uint16_t					m_local_close_code;
@@ -305,18 +548,41 @@ protected:
 	tcp::socket 				m_socket;
 	boost::asio::io_service&	m_io_service;
 	connection_handler_ptr		m_local_interface;
-	boost::asio::deadline_timer	m_timer;
+	
+	// handshake and close timeouts
+	timing_wheel::timer			m_timer;
+	timing_wheel::timer			m_stall_timer;
+	
+	uint32_t					m_keepalive_interval;
+	uint32_t					m_keepalive_timeout;
+	keepalive_scheduler::entry	m_keepalive;
+	
+	// send time of the keepalive ping waiting for a pong, in microseconds. 0
+	// if there isn't one.
+	uint64_t					m_ping_sent;
+	rtt_stats					m_rtt;
+	rtt_histogram_ptr			m_rtt_histogram;
 	
 	// Buffers
-	boost::asio::streambuf		m_buf;
+	// Frames, and anything read after the handshake head, go through 
+	// m_read_buf.
+	// most bytes of an HTTP request body that will be buffered
+	uint64_t					m_buf_size;
+	receive_buffer				m_read_buf;
 	
 	// current message state
 	uint32_t					m_utf8_state;
 	uint32_t					m_utf8_codepoint;
 	std::vector<unsigned char>	m_current_message;
 	bool 						m_fragmented;
+	bool						m_compressed;
 	frame::opcode 				m_current_opcode;
 	
+	// extensions
+	permessage_deflate::settings	m_deflate_settings;
+	permessage_deflate			m_deflate;
+	std::vector<unsigned char>	m_deflate_buffer;
+	
 	// current frame state
 	frame						m_read_frame;
 
@@ -33,10 +33,60 @@
 #define __STDC_LIMIT_MACROS 
 #include <stdint.h>
 
+#include <sstream>
+
+// Error log statements below this level and access log statements for
+// channels outside this mask are removed at compile time. Release builds that
+// never turn on debug logging can define WEBSOCKETPP_MIN_LOG_LEVEL as 2 
+// (LOG_INFO) to drop the debug statements entirely.
+#ifndef WEBSOCKETPP_MIN_LOG_LEVEL
+	#define WEBSOCKETPP_MIN_LOG_LEVEL 0
+#endif
+
+#ifndef WEBSOCKETPP_ALOG_MASK
+	#define WEBSOCKETPP_ALOG_MASK 0xFFFF
+#endif
+
+// Logging front end for the endpoint and session classes. msg is anything 
+// that can be written to a std::ostream, including chains of <<. It is only
+// formatted if the level is compiled in and currently enabled, so a disabled
+// statement costs one test and no allocation. Must be used in a member of a
+// class providing test_elog_level/log (or test_alog_level/access_log).
+#define WEBSOCKETPP_LOG(level,msg) \
+	do { \
+		if ((level) >= WEBSOCKETPP_MIN_LOG_LEVEL && test_elog_level(level)) { \
+			std::stringstream websocketpp_log_msg; \
+			websocketpp_log_msg << msg; \
+			log(websocketpp_log_msg.str(),(level)); \
+		} \
+	} while (0)
+
+#define WEBSOCKETPP_ALOG(level,msg) \
+	do { \
+		if (((level) & WEBSOCKETPP_ALOG_MASK) != 0 && test_alog_level(level)) { \
+			std::stringstream websocketpp_log_msg; \
+			websocketpp_log_msg << msg; \
+			access_log(websocketpp_log_msg.str(),(level)); \
+		} \
+	} while (0)
+
 // Defaults
 namespace websocketpp {
 	const uint64_t DEFAULT_MAX_MESSAGE_SIZE = 0xFFFFFF; // ~16MB
 	
+	// outgoing bytes a session will buffer before refusing sends, and the
+	// level they must fall back to before on_drain is called
+	const size_t DEFAULT_SEND_HIGH_WATERMARK = 0x1000000; // 16MB
+	const size_t DEFAULT_SEND_LOW_WATERMARK = 0x400000; // 4MB
+	
+	// time SLOW_CONSUMER_DISCONNECT gives a session to drain its send buffer
+	// once it goes over the high watermark
+	const uint32_t DEFAULT_SEND_STALL_TIMEOUT = 5000; // ms
+	
+	// largest payload of an outgoing data frame before the message is split
+	// into fragments. 0 sends every message as a single frame.
+	const size_t DEFAULT_MAX_FRAME_SIZE = 0;
+	
 	// System logging levels
 	static const uint16_t LOG_ALL = 0;
 	static const uint16_t LOG_DEBUG = 1;
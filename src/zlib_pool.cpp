@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "zlib_pool.hpp"
+
+#include <boost/thread/once.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+	#define WEBSOCKETPP_THREAD_LOCAL __declspec(thread)
+#else
+	#define WEBSOCKETPP_THREAD_LOCAL __thread
+#endif
+
+using websocketpp::zlib_budget;
+using websocketpp::zlib_pool;
+
+const size_t zlib_pool::MAX_FREE_STREAMS;
+
+namespace {
+
+// As for buffer pools, the thread_specific_ptr owns each thread's pool and 
+// the thread local pointer makes lookups fast.
+boost::thread_specific_ptr<zlib_pool>* g_pools = NULL;
+boost::once_flag g_pools_once = BOOST_ONCE_INIT;
+WEBSOCKETPP_THREAD_LOCAL zlib_pool* t_pool = NULL;
+
+void create_pools() {
+	g_pools = new boost::thread_specific_ptr<zlib_pool>();
+}
+
+// zlib's own bookkeeping on top of the window and hash tables, roughly
+const size_t STREAM_OVERHEAD = 7168;
+
+}
+
+zlib_budget::zlib_budget(size_t limit) : m_limit(limit),m_used(0) {}
+
+bool zlib_budget::reserve(size_t bytes) {
+	boost::mutex::scoped_lock guard(m_lock);
+	
+	if (m_used + bytes > m_limit) {
+		return false;
+	}
+	m_used += bytes;
+	return true;
+}
+
+void zlib_budget::force_reserve(size_t bytes) {
+	boost::mutex::scoped_lock guard(m_lock);
+	m_used += bytes;
+}
+
+void zlib_budget::release(size_t bytes) {
+	boost::mutex::scoped_lock guard(m_lock);
+	m_used -= std::min(bytes,m_used);
+}
+
+size_t zlib_budget::get_used() const {
+	boost::mutex::scoped_lock guard(m_lock);
+	return m_used;
+}
+
+size_t zlib_budget::get_limit() const {
+	return m_limit;
+}
+
+zlib_pool& zlib_pool::local() {
+	if (t_pool == NULL) {
+		boost::call_once(g_pools_once,&create_pools);
+		t_pool = new zlib_pool();
+		g_pools->reset(t_pool);
+	}
+	return *t_pool;
+}
+
+uint32_t zlib_pool::deflate_key(int window_bits,int level,int memory_level) {
+	// compression levels run from -1 (the default) to 9
+	return (uint32_t(window_bits) << 16) | (uint32_t(level+1) << 8) | 
+	       uint32_t(memory_level);
+}
+
+// These are the figures given in zconf.h.
+size_t zlib_pool::deflate_memory(int window_bits,int memory_level) {
+	return (size_t(1) << (window_bits+2)) + (size_t(1) << (memory_level+9)) +
+	       STREAM_OVERHEAD;
+}
+
+size_t zlib_pool::inflate_memory(int window_bits) {
+	return (size_t(1) << window_bits) + STREAM_OVERHEAD;
+}
+
+zlib_pool::zlib_pool() {}
+
+zlib_pool::~zlib_pool() {
+	for (free_list::iterator it = m_deflate.begin(); it != m_deflate.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			deflateEnd(it->second[i]);
+			delete it->second[i];
+		}
+	}
+	for (free_list::iterator it = m_inflate.begin(); it != m_inflate.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			inflateEnd(it->second[i]);
+			delete it->second[i];
+		}
+	}
+	if (t_pool == this) {
+		t_pool = NULL;
+	}
+}
+
+z_stream* zlib_pool::acquire_deflate(int window_bits,int level,
+                                     int memory_level) {
+	std::vector<z_stream*>& free = m_deflate[
+		deflate_key(window_bits,level,memory_level)
+	];
+	
+	if (!free.empty()) {
+		z_stream* s = free.back();
+		free.pop_back();
+		return s;
+	}
+	
+	z_stream* s = new z_stream;
+	std::memset(s,0,sizeof(z_stream));
+	
+	if (deflateInit2(s,level,Z_DEFLATED,-window_bits,memory_level,
+	                 Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		delete s;
+		return NULL;
+	}
+	return s;
+}
+
+z_stream* zlib_pool::acquire_inflate(int window_bits) {
+	std::vector<z_stream*>& free = m_inflate[uint32_t(window_bits)];
+	
+	if (!free.empty()) {
+		z_stream* s = free.back();
+		free.pop_back();
+		return s;
+	}
+	
+	z_stream* s = new z_stream;
+	std::memset(s,0,sizeof(z_stream));
+	
+	if (inflateInit2(s,-window_bits) != Z_OK) {
+		delete s;
+		return NULL;
+	}
+	return s;
+}
+
+void zlib_pool::release_deflate(z_stream* s,int window_bits,int level,
+                                int memory_level) {
+	std::vector<z_stream*>& free = m_deflate[
+		deflate_key(window_bits,level,memory_level)
+	];
+	
+	if (free.size() >= MAX_FREE_STREAMS || deflateReset(s) != Z_OK) {
+		deflateEnd(s);
+		delete s;
+		return;
+	}
+	free.push_back(s);
+}
+
+void zlib_pool::release_inflate(z_stream* s,int window_bits) {
+	std::vector<z_stream*>& free = m_inflate[uint32_t(window_bits)];
+	
+	if (free.size() >= MAX_FREE_STREAMS || inflateReset(s) != Z_OK) {
+		inflateEnd(s);
+		delete s;
+		return;
+	}
+	free.push_back(s);
+}
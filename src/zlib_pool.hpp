@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef ZLIB_POOL_HPP
+#define ZLIB_POOL_HPP
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace websocketpp {
+
+// Memory held by the zlib streams of a server's sessions, with a limit on it.
+// Shared by the sessions and safe to use from any thread.
+class zlib_budget : boost::noncopyable {
+public:
+	explicit zlib_budget(size_t limit);
+	
+	// Counts bytes as in use if that keeps the total within the limit. 
+	// Returns false and counts nothing otherwise.
+	bool reserve(size_t bytes);
+	
+	// Counts bytes as in use even if that goes over the limit, for memory 
+	// that can't be done without.
+	void force_reserve(size_t bytes);
+	
+	void release(size_t bytes);
+	
+	size_t get_used() const;
+	size_t get_limit() const;
+private:
+	mutable boost::mutex	m_lock;
+	size_t					m_limit;
+	size_t					m_used;
+};
+
+typedef boost::shared_ptr<zlib_budget> zlib_budget_ptr;
+
+// Per thread cache of zlib streams for raw deflate data, by parameters. 
+// Sessions that start every message from a fresh state borrow a stream for 
+// each message and give it back after, so a thread needs only as many streams
+// as it has messages in progress rather than two for each of its sessions.
+//
+// Streams come out of the pool in their initial state.
+class zlib_pool : boost::noncopyable {
+public:
+	// most idle streams kept for each set of parameters
+	static const size_t MAX_FREE_STREAMS = 8;
+	
+	// The pool for the calling thread. It is created on first use.
+	static zlib_pool& local();
+	
+	// Identifies a set of deflate parameters.
+	static uint32_t deflate_key(int window_bits,int level,int memory_level);
+	
+	// Memory zlib allocates for a stream with these parameters.
+	static size_t deflate_memory(int window_bits,int memory_level);
+	static size_t inflate_memory(int window_bits);
+	
+	~zlib_pool();
+	
+	// Return a stream, or NULL if zlib couldn't create one.
+	z_stream* acquire_deflate(int window_bits,int level,int memory_level);
+	z_stream* acquire_inflate(int window_bits);
+	
+	// Take back a stream acquired with the same parameters.
+	void release_deflate(z_stream* s,int window_bits,int level,
+	                     int memory_level);
+	void release_inflate(z_stream* s,int window_bits);
+private:
+	typedef std::map< uint32_t,std::vector<z_stream*> > free_list;
+	
+	zlib_pool();
+	
+	free_list	m_deflate;
+	free_list	m_inflate;
+};
+
+}
+
+#endif // ZLIB_POOL_HPP
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/buffer_pool.hpp"
+
+#include <vector>
+
+using websocketpp::buffer_pool;
+using websocketpp::shared_buffer_ptr;
+
+BOOST_AUTO_TEST_SUITE ( buffer_pool_suite )
+
+BOOST_AUTO_TEST_CASE( buffer_pool_reuses_released_storage ) {
+	buffer_pool& pool = buffer_pool::local();
+	
+	std::vector<unsigned char> a;
+	pool.acquire(a,1000);
+	BOOST_CHECK( a.empty() );
+	BOOST_CHECK( a.capacity() >= 1000 );
+	
+	const unsigned char* storage = &*a.begin();
+	pool.release(a);
+	BOOST_CHECK( a.capacity() == 0 );
+	
+	buffer_pool::counters before = pool.get_counters();
+	
+	std::vector<unsigned char> b;
+	pool.acquire(b,600);
+	BOOST_CHECK( &*b.begin() == storage );
+	BOOST_CHECK( pool.get_counters().hits == before.hits+1 );
+	BOOST_CHECK( pool.get_counters().misses == before.misses );
+	
+	pool.release(b);
+}
+
+BOOST_AUTO_TEST_CASE( buffer_pool_steady_state_does_not_allocate ) {
+	buffer_pool& pool = buffer_pool::local();
+	
+	// warm up
+	for (int i = 0; i < 2; i++) {
+		std::vector<unsigned char> v;
+		pool.acquire(v,5000);
+		shared_buffer_ptr s = pool.make_shared_buffer(300);
+		pool.release(v);
+	}
+	
+	buffer_pool::counters before = pool.get_counters();
+	
+	for (int i = 0; i < 1000; i++) {
+		std::vector<unsigned char> v;
+		pool.acquire(v,5000);
+		v.resize(5000);
+		
+		shared_buffer_ptr s = pool.make_shared_buffer(300);
+		s->get_data().insert(s->get_data().end(),v.begin(),v.begin()+300);
+		
+		pool.release(v);
+	}
+	
+	BOOST_CHECK( pool.get_counters().misses == before.misses );
+	BOOST_CHECK( pool.get_counters().hits == before.hits+2000 );
+}
+
+BOOST_AUTO_TEST_CASE( buffer_pool_reserve_keeps_contents ) {
+	buffer_pool& pool = buffer_pool::local();
+	
+	std::vector<unsigned char> v;
+	pool.acquire(v,10);
+	for (int i = 0; i < 200; i++) {
+		v.push_back(static_cast<unsigned char>(i));
+	}
+	
+	pool.reserve(v,100000);
+	BOOST_CHECK( v.capacity() >= 100000 );
+	BOOST_REQUIRE( v.size() == 200 );
+	for (int i = 0; i < 200; i++) {
+		BOOST_CHECK( v[i] == static_cast<unsigned char>(i) );
+	}
+	
+	pool.release(v);
+}
+
+BOOST_AUTO_TEST_CASE( buffer_pool_discards_unpoolable_sizes ) {
+	buffer_pool& pool = buffer_pool::local();
+	
+	buffer_pool::counters before = pool.get_counters();
+	
+	std::vector<unsigned char> small;
+	small.reserve(16);
+	pool.release(small);
+	
+	std::vector<unsigned char> big;
+	pool.acquire(big,buffer_pool::MAX_CLASS_SIZE+1);
+	pool.release(big);
+	
+	BOOST_CHECK( pool.get_counters().discards == before.discards+2 );
+	BOOST_CHECK( pool.get_counters().returns == before.returns );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
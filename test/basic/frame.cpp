@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/websocket_frame.hpp"
+#include "../../src/receive_buffer.hpp"
+
+#include <string>
+#include <vector>
+
+using websocketpp::frame;
+using websocketpp::receive_buffer;
+
+namespace {
+
+// Builds a masked client frame with a short (< 126 byte) payload.
+std::string masked_frame(unsigned char opcode,const std::string& payload) {
+	const char key[4] = {'\x11','\x22','\x33','\x44'};
+	
+	std::string f;
+	f += static_cast<char>(0x80 | opcode);
+	f += static_cast<char>(0x80 | payload.size());
+	f.append(key,4);
+	for (size_t i = 0; i < payload.size(); i++) {
+		f += static_cast<char>(payload[i] ^ key[i % 4]);
+	}
+	return f;
+}
+
+void append(receive_buffer& buf,const std::string& s) {
+	buf.append(reinterpret_cast<const unsigned char*>(s.data()),s.size());
+}
+
+std::string payload(const frame& f) {
+	return std::string(reinterpret_cast<const char*>(f.get_payload_data()),
+	                   f.get_payload_size());
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( receive_buffer_compacts ) {
+	receive_buffer buf(64);
+	
+	append(buf,std::string(60,'a'));
+	buf.consume(58);
+	BOOST_CHECK_EQUAL( buf.size(), 2 );
+	
+	// not enough room at the back, the two unread bytes move to the front
+	unsigned char* p = buf.prepare(32);
+	BOOST_CHECK_EQUAL( buf.capacity(), 64 );
+	BOOST_CHECK( p == buf.data()+2 );
+	
+	// more than the capacity grows the buffer
+	append(buf,std::string(100,'b'));
+	BOOST_CHECK_EQUAL( buf.size(), 102 );
+	BOOST_CHECK( buf.data()[1] == 'a' && buf.data()[2] == 'b' );
+	
+	buf.consume(102);
+	BOOST_CHECK( buf.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( frame_payload_used_in_place ) {
+	receive_buffer buf;
+	append(buf,masked_frame(frame::TEXT_FRAME,"Hello"));
+	const unsigned char* start = buf.data();
+	
+	frame f;
+	f.consume(buf);
+	
+	BOOST_REQUIRE( f.get_state() == frame::STATE_READY );
+	BOOST_CHECK( buf.empty() );
+	BOOST_CHECK( f.get_payload_data() == start+6 );
+	BOOST_CHECK_EQUAL( payload(f), "Hello" );
+	
+	// asking for a vector copies it out
+	std::vector<unsigned char>& v = f.get_payload();
+	BOOST_CHECK_EQUAL( std::string(v.begin(),v.end()), "Hello" );
+}
+
+BOOST_AUTO_TEST_CASE( frame_payload_split_across_reads ) {
+	std::string wire = masked_frame(frame::BINARY_FRAME,std::string(100,'x'));
+	
+	receive_buffer buf;
+	frame f;
+	
+	for (size_t i = 0; i < wire.size(); i++) {
+		BOOST_REQUIRE( f.get_state() != frame::STATE_READY );
+		append(buf,wire.substr(i,1));
+		f.consume(buf);
+		BOOST_CHECK( buf.empty() );
+	}
+	
+	BOOST_REQUIRE( f.get_state() == frame::STATE_READY );
+	BOOST_CHECK_EQUAL( payload(f), std::string(100,'x') );
+}
+
+BOOST_AUTO_TEST_CASE( frame_consume_stops_at_frame_end ) {
+	receive_buffer buf;
+	append(buf,masked_frame(frame::TEXT_FRAME,"one")+masked_frame(frame::TEXT_FRAME,"two"));
+	
+	frame f;
+	f.consume(buf);
+	BOOST_REQUIRE( f.get_state() == frame::STATE_READY );
+	BOOST_CHECK_EQUAL( payload(f), "one" );
+	BOOST_CHECK_EQUAL( buf.size(), 9 );
+	
+	f.reset();
+	f.consume(buf);
+	BOOST_REQUIRE( f.get_state() == frame::STATE_READY );
+	BOOST_CHECK_EQUAL( payload(f), "two" );
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/http_head.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using websocketpp::http_head;
+
+namespace {
+
+// feeds s to the head n bytes at a time
+http_head::state feed(http_head& h,const std::string& s,size_t n) {
+	http_head::state state = http_head::READING;
+	
+	for (size_t i = 0; i < s.size() && state == http_head::READING; ) {
+		unsigned char* p = h.prepare();
+		size_t len = std::min(std::min(n,s.size()-i),h.space());
+		std::memcpy(p,s.data()+i,len);
+		state = h.commit(len);
+		i += len;
+	}
+	return state;
+}
+
+const char* request = 
+	"GET /chat?x=1 HTTP/1.1\r\n"
+	"Host: server.example.com\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Extensions: permessage-deflate\r\n"
+	"sec-websocket-extensions:  x-foo \r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"\r\n";
+
+}
+
+BOOST_AUTO_TEST_SUITE ( http_head_suite )
+
+BOOST_AUTO_TEST_CASE( http_head_parses_in_any_pieces ) {
+	std::string s = std::string(request) + "\x81\x05";
+	
+	for (size_t n = 1; n <= s.size(); n++) {
+		http_head h;
+		
+		BOOST_REQUIRE( feed(h,s,n) == http_head::DONE );
+		BOOST_CHECK( h.start_part(0).str() == "GET" );
+		BOOST_CHECK( h.start_part(1).str() == "/chat?x=1" );
+		BOOST_CHECK( h.start_part(2).str() == "HTTP/1.1" );
+		BOOST_CHECK( h.start_line().str() == "GET /chat?x=1 HTTP/1.1" );
+		BOOST_CHECK( h.raw().str() == request );
+		
+		// only the piece that ended the head is read past it
+		BOOST_CHECK( h.excess().size < n );
+	}
+	
+	http_head h;
+	BOOST_REQUIRE( feed(h,s,s.size()) == http_head::DONE );
+	BOOST_CHECK( h.excess().str() == "\x81\x05" );
+}
+
+BOOST_AUTO_TEST_CASE( http_head_finds_headers_in_any_case ) {
+	http_head h;
+	BOOST_REQUIRE( feed(h,request,7) == http_head::DONE );
+	
+	BOOST_CHECK( h.header("Host").str() == "server.example.com" );
+	BOOST_CHECK( h.header("HOST").str() == "server.example.com" );
+	BOOST_CHECK( h.header(std::string("upgrade")).iequals("WebSocket") );
+	BOOST_CHECK( h.header("Sec-WebSocket-Key").str() == "dGhlIHNhbXBsZSBub25jZQ==" );
+	BOOST_CHECK( h.header("Sec-WebSocket-Version").str() == "13" );
+	BOOST_CHECK( h.header("Origin").empty() );
+	BOOST_CHECK( h.header("Hos").empty() );
+	
+	// repeats are joined and trimmed
+	BOOST_CHECK( h.header("Sec-WebSocket-Extensions").str() == 
+	             "permessage-deflate, x-foo" );
+	
+	h.clear();
+	BOOST_CHECK( h.get_state() == http_head::READING );
+	BOOST_CHECK( h.header("Host").empty() );
+	
+	BOOST_REQUIRE( feed(h,"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n",100) == http_head::DONE );
+	BOOST_CHECK( h.start_part(1).str() == "101" );
+	BOOST_CHECK( h.start_part(2).str() == "Switching Protocols" );
+	BOOST_CHECK( h.header("upgrade").str() == "websocket" );
+}
+
+BOOST_AUTO_TEST_CASE( http_head_limits ) {
+	http_head big;
+	std::string s = "GET / HTTP/1.1\r\nX: " + std::string(http_head::MAX_SIZE,'a');
+	BOOST_CHECK( feed(big,s,4096) == http_head::FAILED );
+	
+	http_head many;
+	s = "GET / HTTP/1.1\r\n";
+	for (size_t i = 0; i <= http_head::MAX_HEADERS; i++) {
+		s += "X: y\r\n";
+	}
+	BOOST_CHECK( feed(many,s,s.size()) == http_head::FAILED );
+	
+	// blank lines before the start line and lines without a colon are skipped
+	http_head odd;
+	BOOST_REQUIRE( feed(odd,"\r\nGET / HTTP/1.1\nnot a header\nA:b\n\n",5) == http_head::DONE );
+	BOOST_CHECK( odd.start_part(0).str() == "GET" );
+	BOOST_CHECK( odd.header("a").str() == "b" );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+
+#include "loopback.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session;
+using websocketpp::session_ptr;
+using loopback::free_port;
+using loopback::run_io_service;
+using loopback::test_client;
+
+namespace {
+
+// Echoes text messages and records the thread that each session's handlers
+// run on.
+class thread_recorder : public websocketpp::connection_handler {
+public:
+	thread_recorder() : m_closed(0) {}
+	
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_opens.push_back(boost::this_thread::get_id());
+		record(session);
+	}
+	void on_close(session_ptr session) {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		record(session);
+		m_closed++;
+		m_changed.notify_all();
+	}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {
+		{
+			boost::lock_guard<boost::mutex> lock(m_lock);
+			record(session);
+		}
+		session->send(msg);
+	}
+	
+	// waits up to a few seconds for count sessions to have closed
+	bool wait_closed(size_t count) {
+		boost::unique_lock<boost::mutex> lock(m_lock);
+		boost::system_time deadline = boost::get_system_time() + 
+		                              boost::posix_time::seconds(5);
+		while (m_closed < count) {
+			if (!m_changed.timed_wait(lock,deadline)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	// threads that each session's handlers ran on
+	std::vector<std::set<boost::thread::id> > get_session_threads() {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		std::vector<std::set<boost::thread::id> > threads;
+		
+		std::map<session*,std::set<boost::thread::id> >::iterator it;
+		for (it = m_threads.begin(); it != m_threads.end(); ++it) {
+			threads.push_back(it->second);
+		}
+		return threads;
+	}
+	
+	// the thread that ran on_open, in the order the sessions opened
+	std::vector<boost::thread::id> get_opens() {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		return m_opens;
+	}
+private:
+	void record(session_ptr session) {
+		m_threads[session.get()].insert(boost::this_thread::get_id());
+	}
+	
+	boost::mutex				m_lock;
+	boost::condition_variable	m_changed;
+	size_t						m_closed;
+	std::vector<boost::thread::id>	m_opens;
+	std::map<session*,std::set<boost::thread::id> >	m_threads;
+};
+
+// An echo through c, after which its session has certainly opened.
+void round_trip(test_client& c) {
+	c.send_text("ping");
+	BOOST_CHECK( c.read_text() == "ping" );
+}
+
+// waits up to a few seconds for the server's io threads to hold sessions
+bool wait_sessions(server& s,const std::vector<size_t>& sessions) {
+	for (int i = 0; i < 500; i++) {
+		if (s.get_io_thread_sessions() == sessions) {
+			return true;
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+	return false;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( io_threads_suite )
+
+BOOST_AUTO_TEST_CASE( sessions_stay_on_their_io_thread ) {
+	boost::asio::io_service io_service;
+	unsigned short port = free_port(io_service);
+	boost::shared_ptr<thread_recorder> handler(new thread_recorder());
+	websocketpp::server_ptr s(new server(
+		io_service,
+		tcp::endpoint(boost::asio::ip::address_v4::loopback(),port),
+		handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->set_io_threads(3);
+	s->start_accept();
+	
+	boost::thread accept_thread(&run_io_service,&io_service);
+	
+	{
+		boost::asio::io_service client_io_service;
+		test_client a(client_io_service,port);
+		test_client b(client_io_service,port);
+		test_client c(client_io_service,port);
+		
+		for (int i = 0; i < 5; i++) {
+			a.send_text("a");
+			b.send_text("b");
+			c.send_text("c");
+			BOOST_CHECK( a.read_text() == "a" );
+			BOOST_CHECK( b.read_text() == "b" );
+			BOOST_CHECK( c.read_text() == "c" );
+		}
+		
+		a.close();
+		b.close();
+		c.close();
+	}
+	
+	BOOST_REQUIRE( handler->wait_closed(3) );
+	
+	// every handler of a session ran on one thread, each session on a 
+	// different one, and none on the thread that accepted them
+	std::vector<std::set<boost::thread::id> > threads = 
+		handler->get_session_threads();
+	std::set<boost::thread::id> used;
+	
+	BOOST_REQUIRE( threads.size() == 3 );
+	for (size_t i = 0; i < threads.size(); i++) {
+		BOOST_CHECK( threads[i].size() == 1 );
+		used.insert(threads[i].begin(),threads[i].end());
+	}
+	BOOST_CHECK( used.size() == 3 );
+	BOOST_CHECK( used.count(accept_thread.get_id()) == 0 );
+	BOOST_CHECK( used.count(boost::this_thread::get_id()) == 0 );
+	
+	s->stop_io_threads();
+	io_service.stop();
+	accept_thread.join();
+}
+
+BOOST_AUTO_TEST_CASE( least_loaded_picks_the_emptiest_thread ) {
+	boost::asio::io_service io_service;
+	unsigned short port = free_port(io_service);
+	boost::shared_ptr<thread_recorder> handler(new thread_recorder());
+	websocketpp::server_ptr s(new server(
+		io_service,
+		tcp::endpoint(boost::asio::ip::address_v4::loopback(),port),
+		handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->set_io_threads(3,server::DISTRIBUTE_LEAST_LOADED);
+	s->start_accept();
+	
+	boost::thread accept_thread(&run_io_service,&io_service);
+	boost::asio::io_service client_io_service;
+	
+	// The thread for a connection is picked when the server starts waiting
+	// for it, so the session waiting to accept counts as well. Three 
+	// connections go to threads 0, 1 and 2 and the next will go to 0.
+	test_client a(client_io_service,port);
+	round_trip(a);
+	test_client b(client_io_service,port);
+	round_trip(b);
+	test_client c(client_io_service,port);
+	round_trip(c);
+	
+	std::vector<size_t> sessions(3,1);
+	sessions[0] = 2;
+	BOOST_REQUIRE( wait_sessions(*s,sessions) );
+	
+	c.close();
+	BOOST_REQUIRE( handler->wait_closed(1) );
+	sessions[2] = 0;
+	BOOST_REQUIRE( wait_sessions(*s,sessions) );
+	
+	// d takes the waiting session on thread 0. Round robin would put the 
+	// next one on thread 1, but thread 2 is empty.
+	test_client d(client_io_service,port);
+	round_trip(d);
+	sessions[2] = 1;
+	BOOST_CHECK( wait_sessions(*s,sessions) );
+	
+	test_client e(client_io_service,port);
+	round_trip(e);
+	
+	std::vector<boost::thread::id> opens = handler->get_opens();
+	BOOST_REQUIRE( opens.size() == 5 );
+	BOOST_CHECK( opens[4] == opens[2] );
+	BOOST_CHECK( opens[3] == opens[0] );
+	
+	s->stop_io_threads();
+	io_service.stop();
+	accept_thread.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
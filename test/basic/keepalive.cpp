@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/keepalive.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include <vector>
+
+using websocketpp::keepalive_scheduler;
+using websocketpp::timing_wheel;
+
+namespace {
+
+void record(std::vector<int>* events,int event) {
+	events->push_back(event);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( keepalive_suite )
+
+BOOST_AUTO_TEST_CASE( keepalive_pings_idle_entries_then_times_out ) {
+	boost::asio::io_service io_service;
+	timing_wheel& wheel = boost::asio::use_service<timing_wheel>(io_service);
+	keepalive_scheduler& scheduler = 
+		boost::asio::use_service<keepalive_scheduler>(io_service);
+	std::vector<int> events;
+	
+	const uint32_t interval = 3*timing_wheel::TICK_MS;
+	const uint32_t timeout = 2*timing_wheel::TICK_MS;
+	
+	keepalive_scheduler::entry quiet(io_service);
+	keepalive_scheduler::entry busy(io_service);
+	quiet.start(interval,timeout,boost::bind(&record,&events,1),
+	            boost::bind(&record,&events,2));
+	busy.start(interval,timeout,boost::bind(&record,&events,3),
+	           boost::bind(&record,&events,4));
+	
+	BOOST_CHECK( scheduler.size() == 2 );
+	uint64_t start = wheel.get_tick();
+	
+	wheel.advance_to(start+2);
+	busy.touch();
+	scheduler.check();
+	BOOST_CHECK( events.empty() );
+	
+	// only the entry that hasn't been touched is pinged
+	wheel.advance_to(start+3);
+	scheduler.check();
+	BOOST_REQUIRE( events.size() == 1 );
+	BOOST_CHECK( events[0] == 1 );
+	
+	// and is timed out and stopped once the timeout has passed too
+	wheel.advance_to(start+5);
+	busy.touch();
+	scheduler.check();
+	BOOST_REQUIRE( events.size() == 2 );
+	BOOST_CHECK( events[1] == 2 );
+	BOOST_CHECK( !quiet.active() );
+	BOOST_CHECK( busy.active() );
+	BOOST_CHECK( scheduler.size() == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( keepalive_touch_cancels_a_pending_timeout ) {
+	boost::asio::io_service io_service;
+	timing_wheel& wheel = boost::asio::use_service<timing_wheel>(io_service);
+	keepalive_scheduler& scheduler = 
+		boost::asio::use_service<keepalive_scheduler>(io_service);
+	std::vector<int> events;
+	
+	keepalive_scheduler::entry e(io_service);
+	e.start(timing_wheel::TICK_MS,timing_wheel::TICK_MS,
+	        boost::bind(&record,&events,1),boost::bind(&record,&events,2));
+	uint64_t start = wheel.get_tick();
+	
+	wheel.advance_to(start+1);
+	scheduler.check();
+	BOOST_REQUIRE( events.size() == 1 );
+	
+	// the pong
+	e.touch();
+	
+	wheel.advance_to(start+2);
+	scheduler.check();
+	BOOST_REQUIRE( events.size() == 2 );
+	BOOST_CHECK( events[1] == 1 );
+	BOOST_CHECK( e.active() );
+	
+	e.stop();
+	BOOST_CHECK( scheduler.size() == 0 );
+	
+	// the scheduler's timer is gone with its last entry
+	BOOST_CHECK( wheel.size() == 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef LOOPBACK_HPP
+#define LOOPBACK_HPP
+
+// Helpers for tests that run a server on the loopback interface and talk to
+// it with a minimal blocking client.
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+
+#include <stdint.h>
+
+namespace loopback {
+
+using boost::asio::ip::tcp;
+
+const char REQUEST[] =
+	"GET / HTTP/1.1\r\n"
+	"Host: localhost\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"\r\n";
+
+// A blocking WebSocket client that completes its handshake on construction
+// and sends short text messages with a zero mask. A non-zero receive_buffer
+// sets the socket's receive buffer before connecting, so that a client that
+// stops reading holds up the server after that many bytes or so.
+class test_client {
+public:
+	test_client(boost::asio::io_service& io_service,unsigned short port,
+	            int receive_buffer = 0)
+	 : m_socket(io_service)
+	{
+		m_socket.open(tcp::v4());
+		if (receive_buffer != 0) {
+			m_socket.set_option(
+				boost::asio::socket_base::receive_buffer_size(receive_buffer)
+			);
+		}
+		m_socket.connect(
+			tcp::endpoint(boost::asio::ip::address_v4::loopback(),port)
+		);
+		boost::asio::write(m_socket,
+		                   boost::asio::buffer(REQUEST,sizeof(REQUEST)-1));
+		
+		size_t n = boost::asio::read_until(m_socket,m_buf,"\r\n\r\n");
+		std::string head(boost::asio::buffers_begin(m_buf.data()),
+		                 boost::asio::buffers_begin(m_buf.data())+n);
+		m_buf.consume(n);
+		
+		BOOST_REQUIRE( head.compare(0,12,"HTTP/1.1 101") == 0 );
+	}
+	
+	void send_text(const std::string& msg) {
+		send_frame(0x81,msg);
+	}
+	
+	// reads a whole unfragmented frame and returns its opcode
+	unsigned char read_frame(std::string& payload) {
+		read_bytes(2);
+		std::string header = take(2);
+		
+		uint64_t len = header[1] & 0x7F;
+		size_t extra = (len == 126 ? 2 : (len == 127 ? 8 : 0));
+		
+		if (extra != 0) {
+			read_bytes(extra);
+			std::string ext = take(extra);
+			len = 0;
+			for (size_t i = 0; i < extra; i++) {
+				len = (len << 8) | static_cast<unsigned char>(ext[i]);
+			}
+		}
+		
+		read_bytes(len);
+		payload = take(len);
+		return header[0] & 0x0F;
+	}
+	
+	std::string read_text() {
+		std::string payload;
+		BOOST_REQUIRE( read_frame(payload) == 0x1 );
+		return payload;
+	}
+	
+	// sends a close frame and reads until the server drops the connection
+	void close() {
+		send_frame(0x88,"");
+		
+		boost::system::error_code ec;
+		while (!ec) {
+			boost::asio::read(m_socket,m_buf,ec);
+		}
+	}
+private:
+	void send_frame(unsigned char op,const std::string& payload) {
+		std::string frame;
+		frame += static_cast<char>(op);
+		frame += static_cast<char>(0x80 | payload.size());
+		frame.append(4,'\0');
+		frame += payload;
+		boost::asio::write(m_socket,boost::asio::buffer(frame));
+	}
+	
+	void read_bytes(size_t n) {
+		if (m_buf.size() < n) {
+			boost::asio::read(m_socket,m_buf,
+			                  boost::asio::transfer_at_least(n-m_buf.size()));
+		}
+	}
+	
+	std::string take(size_t n) {
+		std::string s(boost::asio::buffers_begin(m_buf.data()),
+		              boost::asio::buffers_begin(m_buf.data())+n);
+		m_buf.consume(n);
+		return s;
+	}
+	
+	tcp::socket				m_socket;
+	boost::asio::streambuf	m_buf;
+};
+
+// a port that was free a moment ago
+inline unsigned short free_port(boost::asio::io_service& io_service) {
+	tcp::acceptor a(io_service,
+	                tcp::endpoint(boost::asio::ip::address_v4::loopback(),0));
+	return a.local_endpoint().port();
+}
+
+inline void run_io_service(boost::asio::io_service* io_service) {
+	io_service->run();
+}
+
+}
+
+#endif // LOOPBACK_HPP
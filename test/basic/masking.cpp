@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/simd/masking.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+// Runs kernel over every combination of length, buffer alignment and starting
+// key position up to the limits given and compares against mask_scalar, both
+// in place and out of place.
+bool matches_scalar(mask_kernel kernel) {
+	const char key[4] = {'\x12','\x9a','\xf0','\x3c'};
+	
+	std::vector<unsigned char> src(5000);
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = static_cast<unsigned char>(i*7+3);
+	}
+	
+	// lengths are chosen to cross every threshold inside the vector kernels
+	for (size_t len = 0; len < 4200; len += (len < 300 ? 1 : 61)) {
+		for (size_t offset = 0; offset < 33; offset += 3) {
+			for (size_t ki = 0; ki < 4; ki++) {
+				std::vector<unsigned char> expected(len+offset+1);
+				std::vector<unsigned char> out(len+offset+1);
+				std::vector<unsigned char> inplace(src.begin(),src.begin()+len+offset+1);
+				
+				size_t e = mask_scalar(&src[offset],&expected[offset],len,key,ki);
+				size_t r = kernel(&src[offset],&out[offset],len,key,ki);
+				size_t r2 = kernel(&inplace[offset],&inplace[offset],len,key,ki);
+				
+				if (e != r || e != r2) {
+					return false;
+				}
+				if (!std::equal(expected.begin()+offset,expected.begin()+offset+len,out.begin()+offset)) {
+					return false;
+				}
+				if (!std::equal(expected.begin()+offset,expected.begin()+offset+len,inplace.begin()+offset)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( mask_scalar_known_value ) {
+	const char key[4] = {'\x37','\xfa','\x21','\x3d'};
+	// "Hello" masked with the key from RFC 6455 section 5.7
+	unsigned char data[5] = {0x7f,0x9f,0x4d,0x51,0x58};
+	
+	BOOST_CHECK( mask_scalar(data,data,5,key,0) == 1 );
+	BOOST_CHECK( std::string(data,data+5) == "Hello" );
+}
+
+BOOST_AUTO_TEST_CASE( mask_streamed_in_pieces ) {
+	const char key[4] = {'\x37','\xfa','\x21','\x3d'};
+	unsigned char data[5] = {0x7f,0x9f,0x4d,0x51,0x58};
+	
+	size_t ki = mask(data,data,3,key,0);
+	BOOST_CHECK( ki == 3 );
+	mask(data+3,data+3,2,key,ki);
+	BOOST_CHECK( std::string(data,data+5) == "Hello" );
+}
+
+BOOST_AUTO_TEST_CASE( mask_word_matches_scalar ) {
+	BOOST_CHECK( matches_scalar(&mask_word) );
+}
+
+BOOST_AUTO_TEST_CASE( mask_dispatch_matches_scalar ) {
+	BOOST_CHECK( matches_scalar(&mask) );
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+BOOST_AUTO_TEST_CASE( mask_sse2_matches_scalar ) {
+	if (get_cpu_features().sse2) {
+		BOOST_CHECK( matches_scalar(&mask_sse2) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( mask_avx2_matches_scalar ) {
+	if (get_cpu_features().avx2) {
+		BOOST_CHECK( matches_scalar(&mask_avx2) );
+	}
+}
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/mpsc_queue.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+using websocketpp::mpsc_queue;
+
+namespace {
+
+struct node {
+	node() : next(NULL),producer(0),seq(0) {}
+	node(size_t p,size_t s) : next(NULL),producer(p),seq(s) {}
+	
+	node*	next;
+	size_t	producer;
+	size_t	seq;
+};
+
+void produce(mpsc_queue<node>* q,size_t producer,size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		q->push(new node(producer,i));
+	}
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( mpsc_queue_suite )
+
+BOOST_AUTO_TEST_CASE( mpsc_queue_pops_in_push_order ) {
+	mpsc_queue<node> q;
+	node n[3];
+	
+	BOOST_CHECK( q.empty() );
+	BOOST_CHECK( q.pop_all() == NULL );
+	
+	// only the first push of a batch reports that the consumer needs waking
+	BOOST_CHECK( q.push(&n[0]) );
+	BOOST_CHECK( !q.push(&n[1]) );
+	BOOST_CHECK( !q.push(&n[2]) );
+	BOOST_CHECK( !q.empty() );
+	
+	node* list = q.pop_all();
+	BOOST_CHECK( q.empty() );
+	BOOST_REQUIRE( list == &n[0] );
+	BOOST_REQUIRE( list->next == &n[1] );
+	BOOST_REQUIRE( list->next->next == &n[2] );
+	BOOST_CHECK( list->next->next->next == NULL );
+	
+	BOOST_CHECK( q.push(&n[1]) );
+	BOOST_CHECK( q.pop_all() == &n[1] );
+}
+
+BOOST_AUTO_TEST_CASE( mpsc_queue_keeps_each_producers_order ) {
+	const size_t producers = 4;
+	const size_t count = 20000;
+	
+	mpsc_queue<node> q;
+	boost::thread_group threads;
+	
+	for (size_t i = 0; i < producers; i++) {
+		threads.create_thread(boost::bind(&produce,&q,i,count));
+	}
+	
+	std::vector<size_t> next_seq(producers,0);
+	size_t received = 0;
+	bool in_order = true;
+	
+	while (received < producers*count) {
+		node* n = q.pop_all();
+		
+		while (n != NULL) {
+			in_order = in_order && n->seq == next_seq[n->producer];
+			next_seq[n->producer] = n->seq+1;
+			received++;
+			
+			node* next = n->next;
+			delete n;
+			n = next;
+		}
+		boost::this_thread::yield();
+	}
+	
+	threads.join_all();
+	
+	BOOST_CHECK( in_order );
+	BOOST_CHECK( q.empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/permessage_deflate.hpp"
+#include "../../src/network_utilities.hpp"
+#include "../../src/websocket_frame.hpp"
+
+#include <string>
+#include <vector>
+
+using websocketpp::frame;
+using websocketpp::frame_error;
+using websocketpp::permessage_deflate;
+using websocketpp::zlib_budget;
+using websocketpp::zlib_pool;
+
+namespace {
+
+std::string to_string(const std::vector<unsigned char>& v) {
+	return std::string(v.begin(),v.end());
+}
+
+permessage_deflate::settings enabled() {
+	permessage_deflate::settings s;
+	s.enabled = true;
+	return s;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( permessage_deflate_suite )
+
+BOOST_AUTO_TEST_CASE( split_header_list ) {
+	std::vector<std::string> list;
+	websocketpp::split_header_list(
+		" permessage-deflate; client_max_window_bits, x; y=\"a,b\" ,,foo",list);
+	
+	BOOST_REQUIRE( list.size() == 3 );
+	BOOST_CHECK( list[0] == "permessage-deflate; client_max_window_bits" );
+	BOOST_CHECK( list[1] == "x; y=\"a,b\"" );
+	BOOST_CHECK( list[2] == "foo" );
+}
+
+BOOST_AUTO_TEST_CASE( negotiate_parameters ) {
+	std::vector<std::string> o;
+	
+	o.push_back("permessage-deflate");
+	BOOST_CHECK( permessage_deflate().negotiate(enabled(),o) == 
+	             "permessage-deflate" );
+	
+	// the client's limits and requests are accepted
+	o[0] = "permessage-deflate; server_max_window_bits=10; "
+	       "client_max_window_bits; server_no_context_takeover";
+	BOOST_CHECK( permessage_deflate().negotiate(enabled(),o) == 
+	             "permessage-deflate; server_no_context_takeover; "
+	             "server_max_window_bits=10" );
+	
+	// ours are only sent where the client can take them
+	permessage_deflate::settings s = enabled();
+	s.client_max_window_bits = 12;
+	s.client_no_context_takeover = true;
+	o[0] = "permessage-deflate; client_max_window_bits";
+	BOOST_CHECK( permessage_deflate().negotiate(s,o) == 
+	             "permessage-deflate; client_no_context_takeover; "
+	             "client_max_window_bits=12" );
+	o[0] = "permessage-deflate";
+	BOOST_CHECK( permessage_deflate().negotiate(s,o) == 
+	             "permessage-deflate; client_no_context_takeover" );
+}
+
+BOOST_AUTO_TEST_CASE( negotiate_skips_bad_offers ) {
+	std::vector<std::string> o;
+	
+	o.push_back("x-webkit-deflate-frame");
+	o.push_back("permessage-deflate; server_max_window_bits=8");
+	o.push_back("permessage-deflate; server_max_window_bits");
+	o.push_back("permessage-deflate; client_max_window_bits=16");
+	o.push_back("permessage-deflate; server_no_context_takeover; "
+	            "server_no_context_takeover");
+	o.push_back("permessage-deflate; foo");
+	
+	permessage_deflate d;
+	BOOST_CHECK( d.negotiate(enabled(),o) == "" );
+	BOOST_CHECK( !d.is_active() );
+	
+	o.push_back("permessage-deflate; client_max_window_bits=\"9\"");
+	BOOST_CHECK( d.negotiate(enabled(),o) == 
+	             "permessage-deflate; client_max_window_bits=9" );
+	BOOST_CHECK( d.is_active() );
+}
+
+BOOST_AUTO_TEST_CASE( client_offer_and_response ) {
+	permessage_deflate::settings s = enabled();
+	s.server_max_window_bits = 10;
+	
+	BOOST_CHECK( permessage_deflate::generate_offer(s) == 
+	             "permessage-deflate; server_max_window_bits=10; "
+	             "client_max_window_bits" );
+	
+	// the server must accept our limit
+	BOOST_CHECK( !permessage_deflate().accept_response(s,"permessage-deflate") );
+	BOOST_CHECK( !permessage_deflate().accept_response(s,
+		"permessage-deflate; server_max_window_bits=11") );
+	BOOST_CHECK( !permessage_deflate().accept_response(s,
+		"permessage-deflate; server_max_window_bits=10; client_max_window_bits") );
+	
+	permessage_deflate d;
+	BOOST_CHECK( d.accept_response(s,
+		"permessage-deflate; server_max_window_bits=9; client_max_window_bits=12") );
+	BOOST_CHECK( d.is_active() );
+}
+
+BOOST_AUTO_TEST_CASE( decompress_rfc_examples ) {
+	std::vector<std::string> o(1,"permessage-deflate");
+	permessage_deflate d;
+	d.negotiate(enabled(),o);
+	
+	// RFC 7692 section 7.2.3.2, two messages sharing a context
+	const unsigned char hello1[] = {0xf2,0x48,0xcd,0xc9,0xc9,0x07,0x00};
+	const unsigned char hello2[] = {0xf2,0x00,0x11,0x00,0x00};
+	std::vector<unsigned char> out;
+	
+	d.decompress(hello1,sizeof(hello1),true,out,1000);
+	BOOST_CHECK( to_string(out) == "Hello" );
+	
+	out.clear();
+	d.decompress(hello2,sizeof(hello2),true,out,1000);
+	BOOST_CHECK( to_string(out) == "Hello" );
+	
+	// section 7.2.3.1, one message in two frames
+	const unsigned char frag1[] = {0xf2,0x48,0xcd};
+	const unsigned char frag2[] = {0xc9,0xc9,0x07,0x00};
+	permessage_deflate d2;
+	d2.negotiate(enabled(),o);
+	out.clear();
+	
+	d2.decompress(frag1,sizeof(frag1),false,out,1000);
+	d2.decompress(frag2,sizeof(frag2),true,out,1000);
+	BOOST_CHECK( to_string(out) == "Hello" );
+}
+
+BOOST_AUTO_TEST_CASE( compress_round_trip ) {
+	permessage_deflate::settings s = enabled();
+	permessage_deflate client;
+	permessage_deflate server;
+	
+	std::vector<std::string> o(1,permessage_deflate::generate_offer(s));
+	BOOST_REQUIRE( client.accept_response(s,server.negotiate(s,o)) );
+	
+	std::string msg;
+	for (int i = 0; i < 100; i++) {
+		msg += "{\"id\":12345,\"name\":\"websocket\",\"value\":[1,2,3]},";
+	}
+	
+	std::vector<unsigned char> wire;
+	std::vector<unsigned char> out;
+	size_t first_size = 0;
+	
+	for (int i = 0; i < 3; i++) {
+		client.compress(reinterpret_cast<const unsigned char*>(msg.data()),
+		                msg.size(),wire);
+		
+		if (i == 0) {
+			first_size = wire.size();
+		}
+		
+		out.clear();
+		server.decompress(&wire[0],wire.size(),true,out,msg.size());
+		BOOST_CHECK( to_string(out) == msg );
+	}
+	
+	BOOST_CHECK( first_size < msg.size()/8 );
+	
+	// later messages refer back to the first
+	BOOST_CHECK( wire.size() < first_size );
+}
+
+BOOST_AUTO_TEST_CASE( decompress_limits ) {
+	permessage_deflate::settings s = enabled();
+	permessage_deflate client;
+	permessage_deflate server;
+	
+	std::vector<std::string> o(1,permessage_deflate::generate_offer(s));
+	BOOST_REQUIRE( client.accept_response(s,server.negotiate(s,o)) );
+	
+	std::vector<unsigned char> big(100000,'a');
+	std::vector<unsigned char> wire;
+	std::vector<unsigned char> out;
+	
+	client.compress(&big[0],big.size(),wire);
+	BOOST_CHECK_THROW( server.decompress(&wire[0],wire.size(),true,out,
+	                                     big.size()-1),frame_error );
+	
+	// A message that compresses a thousand to one is refused once it gets
+	// to the limit, without being inflated in full.
+	permessage_deflate bomb_client;
+	permessage_deflate bomb_server;
+	BOOST_REQUIRE( bomb_client.accept_response(s,bomb_server.negotiate(s,o)) );
+	
+	std::vector<unsigned char> bomb(16*1024*1024,0);
+	const size_t limit = 1024*1024;
+	
+	bomb_client.compress(&bomb[0],bomb.size(),wire);
+	BOOST_REQUIRE( wire.size() < bomb.size()/1000 );
+	
+	out.clear();
+	try {
+		bomb_server.decompress(&wire[0],wire.size(),true,out,limit);
+		BOOST_ERROR( "decompress did not throw" );
+	} catch (const frame_error& e) {
+		BOOST_CHECK( e.code() == frame::FERR_MSG_TOO_BIG );
+	}
+	BOOST_CHECK( out.size() > limit && out.size() < 2*limit );
+	
+	const unsigned char garbage[] = {0xff,0xff,0xff,0xff};
+	permessage_deflate d;
+	d.negotiate(s,o);
+	BOOST_CHECK_THROW( d.decompress(garbage,sizeof(garbage),true,out,1000),
+	                   frame_error );
+}
+
+BOOST_AUTO_TEST_CASE( zlib_pool_reuses_streams ) {
+	zlib_pool& pool = zlib_pool::local();
+	
+	z_stream* a = pool.acquire_deflate(15,6,8);
+	BOOST_REQUIRE( a != NULL );
+	pool.release_deflate(a,15,6,8);
+	
+	// only streams with the same parameters are reused
+	z_stream* b = pool.acquire_deflate(12,6,8);
+	BOOST_CHECK( b != a );
+	BOOST_CHECK( pool.acquire_deflate(15,6,8) == a );
+	pool.release_deflate(a,15,6,8);
+	pool.release_deflate(b,12,6,8);
+	
+	z_stream* i = pool.acquire_inflate(15);
+	pool.release_inflate(i,15);
+	BOOST_CHECK( pool.acquire_inflate(15) == i );
+	pool.release_inflate(i,15);
+}
+
+BOOST_AUTO_TEST_CASE( streams_borrowed_per_message ) {
+	permessage_deflate::settings s = enabled();
+	s.server_no_context_takeover = true;
+	s.client_no_context_takeover = true;
+	s.budget.reset(new zlib_budget(1000000));
+	
+	permessage_deflate client;
+	permessage_deflate server;
+	
+	std::vector<std::string> o(1,permessage_deflate::generate_offer(s));
+	BOOST_REQUIRE( client.accept_response(s,server.negotiate(s,o)) );
+	BOOST_CHECK( s.budget->get_used() == 0 );
+	
+	std::string msg(1000,'x');
+	std::vector<unsigned char> wire;
+	std::vector<unsigned char> out;
+	
+	BOOST_REQUIRE( client.compress(
+		reinterpret_cast<const unsigned char*>(msg.data()),msg.size(),wire) );
+	BOOST_CHECK( s.budget->get_used() == 0 );
+	
+	// the inflate stream is held from the first frame to the last
+	server.decompress(&wire[0],1,false,out,msg.size());
+	BOOST_CHECK( s.budget->get_used() == zlib_pool::inflate_memory(15) );
+	server.decompress(&wire[1],wire.size()-1,true,out,msg.size());
+	BOOST_CHECK( s.budget->get_used() == 0 );
+	BOOST_CHECK( to_string(out) == msg );
+	
+	// with no room left messages go uncompressed
+	BOOST_REQUIRE( s.budget->reserve(1000000) );
+	BOOST_CHECK( !client.compress(
+		reinterpret_cast<const unsigned char*>(msg.data()),msg.size(),wire) );
+}
+
+BOOST_AUTO_TEST_CASE( memory_limit_shrinks_windows ) {
+	permessage_deflate::settings s = enabled();
+	
+	// room for a little over one connection with 12 bit windows
+	size_t small = zlib_pool::deflate_memory(12,5) + 
+	               zlib_pool::inflate_memory(12);
+	s.budget.reset(new zlib_budget(small+1000));
+	
+	std::vector<std::string> o(1,"permessage-deflate; client_max_window_bits");
+	std::vector<std::string> nct(1,"permessage-deflate; "
+	                             "server_no_context_takeover; "
+	                             "client_no_context_takeover");
+	
+	{
+		permessage_deflate a;
+		BOOST_CHECK( a.negotiate(s,o) == "permessage-deflate; "
+		             "server_max_window_bits=12; client_max_window_bits=12" );
+		BOOST_CHECK( s.budget->get_used() == small );
+		
+		// the next connection doesn't fit, even with the smallest windows
+		permessage_deflate b;
+		BOOST_CHECK( b.negotiate(s,o) == "" );
+		
+		// unless neither side keeps a stream
+		permessage_deflate c;
+		BOOST_CHECK( c.negotiate(s,nct) != "" );
+		BOOST_CHECK( s.budget->get_used() == small );
+	}
+	
+	BOOST_CHECK( s.budget->get_used() == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( compression_bypass ) {
+	permessage_deflate::settings s = enabled();
+	s.min_compress_size = 100;
+	s.bypass_messages = 10;
+	
+	// each message is compressed on its own, as repeats would otherwise 
+	// compress well
+	s.server_no_context_takeover = true;
+	
+	permessage_deflate d;
+	BOOST_REQUIRE( d.negotiate(s,std::vector<std::string>(1,
+	               "permessage-deflate")) != "" );
+	
+	BOOST_CHECK( !d.should_compress(frame::TEXT_FRAME,99) );
+	BOOST_CHECK( d.should_compress(frame::TEXT_FRAME,100) );
+	BOOST_CHECK( d.get_counters().too_small == 1 );
+	
+	// random data doesn't compress
+	std::vector<unsigned char> noise(1000);
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < noise.size(); i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		noise[i] = static_cast<unsigned char>(x);
+	}
+	
+	std::vector<unsigned char> wire;
+	for (int i = 0; i < 4; i++) {
+		BOOST_REQUIRE( d.should_compress(frame::BINARY_FRAME,noise.size()) );
+		d.compress(&noise[0],noise.size(),wire);
+		d.record(frame::BINARY_FRAME,noise.size(),wire.size());
+	}
+	BOOST_CHECK( d.get_counters().bypasses == 1 );
+	
+	// binary messages are skipped for a while, text ones aren't
+	for (int i = 0; i < 10; i++) {
+		BOOST_CHECK( !d.should_compress(frame::BINARY_FRAME,noise.size()) );
+	}
+	BOOST_CHECK( d.should_compress(frame::TEXT_FRAME,noise.size()) );
+	BOOST_CHECK( d.should_compress(frame::BINARY_FRAME,noise.size()) );
+	
+	const permessage_deflate::counters& c = d.get_counters();
+	BOOST_CHECK( c.bypassed == 10 );
+	BOOST_CHECK( c.compressed == 4 );
+	BOOST_CHECK( c.bytes_in == 4000 );
+	BOOST_CHECK( c.bytes_out >= c.bytes_in*95/100 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/prepared_message.hpp"
+
+#include <string>
+#include <vector>
+
+using websocketpp::frame;
+using websocketpp::permessage_deflate;
+using websocketpp::prepared_message;
+
+namespace {
+
+// a server side extension that compresses every message on its own
+void negotiate(permessage_deflate& d,int window_bits) {
+	permessage_deflate::settings s;
+	s.enabled = true;
+	s.server_no_context_takeover = true;
+	s.server_max_window_bits = window_bits;
+	
+	std::vector<std::string> offers(1,"permessage-deflate");
+	BOOST_REQUIRE( !d.negotiate(s,offers).empty() );
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( prepared_message_suite )
+
+BOOST_AUTO_TEST_CASE( prepared_message_short_text ) {
+	prepared_message m(std::string("Hello"));
+	
+	const std::vector<unsigned char>& buf = m.get_buffer()->get_data();
+	
+	BOOST_REQUIRE( buf.size() == 7 );
+	BOOST_CHECK( buf[0] == 0x81 );
+	BOOST_CHECK( buf[1] == 0x05 );
+	BOOST_CHECK( std::string(buf.begin()+2,buf.end()) == "Hello" );
+	BOOST_CHECK( m.get_opcode() == frame::TEXT_FRAME );
+	BOOST_CHECK( m.get_payload_size() == 5 );
+	BOOST_CHECK( m.get_payload_data() == &buf[2] );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_extended_lengths ) {
+	prepared_message m16(std::vector<unsigned char>(300,'a'));
+	const std::vector<unsigned char>& b16 = m16.get_buffer()->get_data();
+	
+	BOOST_REQUIRE( b16.size() == 4+300 );
+	BOOST_CHECK( b16[0] == 0x82 );
+	BOOST_CHECK( b16[1] == 126 );
+	BOOST_CHECK( b16[2] == 0x01 && b16[3] == 0x2C );
+	
+	prepared_message m64(std::vector<unsigned char>(70000,'b'));
+	const std::vector<unsigned char>& b64 = m64.get_buffer()->get_data();
+	
+	BOOST_REQUIRE( b64.size() == 10+70000 );
+	BOOST_CHECK( b64[1] == 127 );
+	BOOST_CHECK( b64[7] == 0x01 && b64[8] == 0x11 && b64[9] == 0x70 );
+	BOOST_CHECK( m64.get_payload_size() == 70000 );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_copies_share_buffer ) {
+	prepared_message a(std::string("shared"));
+	prepared_message b = a;
+	
+	BOOST_CHECK( a.get_buffer() == b.get_buffer() );
+	BOOST_CHECK( prepared_message().empty() );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_control_limit ) {
+	std::vector<unsigned char> big(126,'x');
+	
+	BOOST_CHECK_THROW( prepared_message(frame::PING,&big[0],big.size()), 
+	                   websocketpp::frame_error );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_compresses_once_per_key ) {
+	std::string text(1000,'a');
+	prepared_message m(text);
+	
+	permessage_deflate a,b,c;
+	negotiate(a,15);
+	negotiate(b,15);
+	negotiate(c,10);
+	
+	BOOST_REQUIRE( a.get_shared_key() != 0 );
+	BOOST_CHECK( a.get_shared_key() == b.get_shared_key() );
+	BOOST_CHECK( a.get_shared_key() != c.get_shared_key() );
+	
+	prepared_message ma = m.get_compressed(a);
+	prepared_message mb = prepared_message(m).get_compressed(b);
+	prepared_message mc = m.get_compressed(c);
+	
+	BOOST_CHECK( ma.is_compressed() && !m.is_compressed() );
+	BOOST_CHECK( ma.get_buffer() == mb.get_buffer() );
+	BOOST_CHECK( ma.get_buffer() != mc.get_buffer() );
+	BOOST_CHECK( ma.get_opcode() == frame::TEXT_FRAME );
+	BOOST_CHECK( ma.get_buffer()->get_data()[0] == 0xC1 );
+	BOOST_CHECK( ma.get_payload_size() < text.size() );
+	
+	// a compressed frame isn't compressed again
+	BOOST_CHECK( ma.get_compressed(c).get_buffer() == ma.get_buffer() );
+	
+	permessage_deflate receiver;
+	permessage_deflate::settings s;
+	s.enabled = true;
+	BOOST_REQUIRE( receiver.accept_response(s,"permessage-deflate") );
+	
+	std::vector<unsigned char> out;
+	receiver.decompress(ma.get_payload_data(),ma.get_payload_size(),true,out,
+	                    text.size());
+	BOOST_CHECK( std::string(out.begin(),out.end()) == text );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_control_not_compressed ) {
+	unsigned char data[] = {'p','i','n','g'};
+	prepared_message m(frame::PING,data,sizeof(data));
+	
+	permessage_deflate d;
+	negotiate(d,15);
+	
+	BOOST_CHECK( m.get_compressed(d).get_buffer() == m.get_buffer() );
+	BOOST_CHECK( !m.get_compressed(d).is_compressed() );
+}
+
+BOOST_AUTO_TEST_CASE( prepared_message_sent_as_is_if_not_smaller ) {
+	std::vector<unsigned char> noise(1000);
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < noise.size(); i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		noise[i] = static_cast<unsigned char>(x);
+	}
+	prepared_message m(noise);
+	
+	permessage_deflate a,b;
+	negotiate(a,15);
+	negotiate(b,15);
+	
+	prepared_message mb = m.get_compressed(b);
+	
+	BOOST_CHECK( m.get_compressed(a).get_buffer() == m.get_buffer() );
+	BOOST_CHECK( mb.get_buffer() == m.get_buffer() );
+	BOOST_CHECK( !mb.is_compressed() );
+	
+	// each session counts it, but it was compressed only once
+	BOOST_CHECK( a.get_counters().compressed == 1 );
+	BOOST_CHECK( b.get_counters().compressed == 1 );
+	
+	// small messages aren't compressed at all
+	prepared_message small(std::string("tiny"));
+	BOOST_CHECK( small.get_compressed(a).get_buffer() == small.get_buffer() );
+	BOOST_CHECK( a.get_counters().too_small == 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/rtt_histogram.hpp"
+
+#include <vector>
+
+using websocketpp::rtt_histogram;
+
+BOOST_AUTO_TEST_SUITE ( rtt_histogram_suite )
+
+BOOST_AUTO_TEST_CASE( rtt_histogram_buckets_cover_every_value ) {
+	// each bucket starts just after the one before it ends
+	BOOST_CHECK( rtt_histogram::bucket_for(0) == 0 );
+	
+	for (size_t b = 1; b < rtt_histogram::BUCKETS; b++) {
+		uint64_t first = rtt_histogram::bucket_max(b-1)+1;
+		BOOST_CHECK( rtt_histogram::bucket_for(first) == b );
+		BOOST_CHECK( rtt_histogram::bucket_for(rtt_histogram::bucket_max(b)) == b );
+	}
+	
+	BOOST_CHECK( rtt_histogram::bucket_max(rtt_histogram::BUCKETS-1) == 0xFFFFFFFF );
+	BOOST_CHECK( rtt_histogram::bucket_for(uint64_t(1) << 40) == 
+	             rtt_histogram::BUCKETS-1 );
+	
+	// a value is never more than a quarter below the end of its bucket
+	for (uint64_t v = 1; v < 1000000; v = v*3/2 + 1) {
+		uint64_t max = rtt_histogram::bucket_max(rtt_histogram::bucket_for(v));
+		BOOST_CHECK( max >= v );
+		BOOST_CHECK( max - v <= v/4 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( rtt_histogram_percentiles ) {
+	rtt_histogram h;
+	
+	BOOST_CHECK( h.count() == 0 );
+	BOOST_CHECK( h.percentile(0.5) == 0 );
+	
+	// 90 fast round trips and 10 slow ones
+	for (int i = 0; i < 90; i++) {
+		h.record(1000);
+	}
+	for (int i = 0; i < 10; i++) {
+		h.record(200000);
+	}
+	
+	BOOST_CHECK( h.count() == 100 );
+	
+	uint64_t fast = rtt_histogram::bucket_max(rtt_histogram::bucket_for(1000));
+	uint64_t slow = rtt_histogram::bucket_max(rtt_histogram::bucket_for(200000));
+	
+	BOOST_CHECK( h.percentile(0) == fast );
+	BOOST_CHECK( h.percentile(0.5) == fast );
+	BOOST_CHECK( h.percentile(0.9) == fast );
+	BOOST_CHECK( h.percentile(0.91) == slow );
+	BOOST_CHECK( h.percentile(0.99) == slow );
+	BOOST_CHECK( h.percentile(1) == slow );
+	
+	std::vector<uint64_t> counts = h.get_counts();
+	BOOST_CHECK( counts[rtt_histogram::bucket_for(1000)] == 90 );
+	BOOST_CHECK( counts[rtt_histogram::bucket_for(200000)] == 10 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
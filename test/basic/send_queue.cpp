@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/send_queue.hpp"
+
+#include <string>
+#include <vector>
+
+using websocketpp::buffer_pool;
+using websocketpp::frame;
+using websocketpp::send_queue;
+using websocketpp::shared_buffer_ptr;
+
+namespace {
+
+std::string gather(const std::vector<boost::asio::const_buffer>& bufs) {
+	std::string s;
+	for (size_t i = 0; i < bufs.size(); i++) {
+		const char* p = boost::asio::buffer_cast<const char*>(bufs[i]);
+		s.append(p,boost::asio::buffer_size(bufs[i]));
+	}
+	return s;
+}
+
+shared_buffer_ptr make_buffer(const std::string& s) {
+	shared_buffer_ptr b = buffer_pool::local().make_shared_buffer(s.size());
+	b->get_data().assign(s.begin(),s.end());
+	return b;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( send_queue_suite )
+
+BOOST_AUTO_TEST_CASE( send_queue_coalesces_copies ) {
+	send_queue q;
+	
+	q.append("ab",2);
+	q.append("cd",2);
+	q.push(make_buffer("small"));
+	
+	BOOST_CHECK( q.size() == 9 );
+	
+	const std::vector<boost::asio::const_buffer>& bufs = q.prepare_write();
+	BOOST_CHECK( bufs.size() == 1 );
+	BOOST_CHECK( gather(bufs) == "abcdsmall" );
+	BOOST_CHECK( q.empty() );
+	BOOST_CHECK( q.size() == 0 );
+	BOOST_CHECK( q.in_flight_size() == 9 );
+	
+	q.finish_write();
+	BOOST_CHECK( q.in_flight_size() == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_references_large_payloads ) {
+	send_queue q;
+	
+	std::string big(send_queue::COPY_THRESHOLD,'x');
+	shared_buffer_ptr b = make_buffer(big);
+	
+	q.append("h1",2);
+	q.push(b);
+	q.append("h2",2);
+	
+	const std::vector<boost::asio::const_buffer>& bufs = q.prepare_write();
+	BOOST_REQUIRE( bufs.size() == 3 );
+	BOOST_CHECK( boost::asio::buffer_cast<const unsigned char*>(bufs[1]) == &b->get_data()[0] );
+	BOOST_CHECK( gather(bufs) == "h1" + big + "h2" );
+	
+	q.finish_write();
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_does_not_append_to_in_flight_data ) {
+	send_queue q;
+	
+	q.append("first",5);
+	std::string first = gather(q.prepare_write());
+	
+	q.append("second",6);
+	BOOST_CHECK( !q.empty() );
+	BOOST_CHECK( q.size() == 6 );
+	
+	q.finish_write();
+	
+	BOOST_CHECK( first == "first" );
+	BOOST_CHECK( gather(q.prepare_write()) == "second" );
+	q.finish_write();
+	BOOST_CHECK( q.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_caps_segments_per_write ) {
+	send_queue q;
+	
+	std::string big(send_queue::COPY_THRESHOLD,'y');
+	shared_buffer_ptr b = make_buffer(big);
+	
+	for (size_t i = 0; i < send_queue::MAX_SEGMENTS+10; i++) {
+		q.push(b);
+	}
+	
+	BOOST_CHECK( q.prepare_write().size() == send_queue::MAX_SEGMENTS );
+	q.finish_write();
+	BOOST_CHECK( q.prepare_write().size() == 10 );
+	q.finish_write();
+	BOOST_CHECK( q.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_drops_queued_messages ) {
+	send_queue q;
+	
+	uint64_t a = q.begin_message(true);
+	q.append("aa",2);
+	uint64_t b = q.begin_message(true);
+	q.append("bb",2);
+	q.begin_message(false);
+	q.append("cc",2);
+	
+	BOOST_CHECK( q.drop_message(b) );
+	BOOST_CHECK( !q.drop_message(b) );
+	BOOST_CHECK( q.size() == 4 );
+	
+	// the gap splits the copy buffer into two writes
+	const std::vector<boost::asio::const_buffer>& bufs = q.prepare_write();
+	BOOST_CHECK( bufs.size() == 2 );
+	BOOST_CHECK( gather(bufs) == "aacc" );
+	
+	// too late once it is being written
+	BOOST_CHECK( !q.drop_message(a) );
+	
+	q.finish_write();
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_drop_oldest_keeps_control_and_in_flight ) {
+	send_queue q;
+	
+	q.begin_message(true);
+	q.append("1",1);
+	q.prepare_write();
+	
+	q.begin_message(false);
+	q.append("c",1);
+	q.begin_message(true);
+	q.append("2",1);
+	uint64_t last = q.begin_message(true);
+	q.append("3",1);
+	
+	BOOST_CHECK( q.drop_oldest(last) );
+	BOOST_CHECK( !q.drop_oldest(last) );
+	
+	q.finish_write();
+	BOOST_CHECK( gather(q.prepare_write()) == "c3" );
+	q.finish_write();
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_priority_messages_go_first ) {
+	send_queue q;
+	
+	q.begin_message(true);
+	q.append("data",4);
+	q.begin_message(false,true);
+	q.append("ping",4);
+	
+	BOOST_CHECK( gather(q.prepare_write()) == "pingdata" );
+	q.finish_write();
+	BOOST_CHECK( q.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_caps_bytes_per_write ) {
+	send_queue q;
+	std::string big(send_queue::MAX_WRITE_SIZE+100,'x');
+	
+	uint64_t id = q.begin_message(true);
+	q.push(make_buffer(big));
+	q.begin_message(true);
+	q.append("next",4);
+	
+	BOOST_CHECK( gather(q.prepare_write()).size() == send_queue::MAX_WRITE_SIZE );
+	
+	// the rest of a partly written frame can't be dropped
+	BOOST_CHECK( !q.drop_message(id) );
+	
+	// and a ping waits until it has been written
+	q.begin_message(false,true);
+	q.append("ping",4);
+	q.finish_write();
+	
+	BOOST_CHECK( gather(q.prepare_write()) == std::string(100,'x')+"pingnext" );
+	q.finish_write();
+	BOOST_CHECK( q.empty() );
+	BOOST_CHECK( q.size() == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_fragments_messages ) {
+	send_queue q;
+	shared_buffer_ptr b = make_buffer("0123456789");
+	
+	q.begin_message(true);
+	q.push_fragmented(b,&b->get_data()[0],10,frame::BINARY_FRAME,false,4);
+	
+	BOOST_CHECK( gather(q.prepare_write()) == 
+		std::string("\x02\x04" "0123" "\x00\x04" "4567" "\x80\x02" "89",16) );
+	q.finish_write();
+	BOOST_CHECK( q.empty() );
+	BOOST_CHECK( q.size() == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( send_queue_interleaves_priority_between_fragments ) {
+	send_queue q;
+	size_t frame_size = send_queue::MAX_WRITE_SIZE/2;
+	shared_buffer_ptr b = make_buffer(std::string(4*frame_size,'x'));
+	
+	uint64_t id = q.begin_message(true);
+	q.push_fragmented(b,&b->get_data()[0],4*frame_size,frame::TEXT_FRAME,false,
+	                  frame_size);
+	
+	// two headers don't leave room for all of the second frame
+	BOOST_CHECK( gather(q.prepare_write()).size() == send_queue::MAX_WRITE_SIZE );
+	
+	q.begin_message(false,true);
+	q.append("ping",4);
+	q.finish_write();
+	
+	// the rest of the second frame, then the ping, then the third frame
+	std::string s = gather(q.prepare_write());
+	BOOST_CHECK( s.substr(8,4) == "ping" );
+	BOOST_CHECK( s.substr(12,2) == std::string("\x00\x7e",2) );
+	q.finish_write();
+	
+	// a message can't be dropped once it has started
+	BOOST_CHECK( !q.drop_message(id) );
+	
+	while (!q.empty()) {
+		q.prepare_write();
+		q.finish_write();
+	}
+	BOOST_CHECK( q.size() == 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
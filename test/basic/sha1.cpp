@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/simd/sha1_kernels.hpp"
+#include "../../src/network_utilities.hpp"
+#include "../../src/sha1/sha1.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+std::string hex(const unsigned char* p,size_t len) {
+	static const char digits[] = "0123456789abcdef";
+	std::string s;
+	
+	for (size_t i = 0; i < len; i++) {
+		s += digits[p[i] >> 4];
+		s += digits[p[i] & 15];
+	}
+	return s;
+}
+
+// Hashes every length up to 300 bytes, which covers every way the padding
+// can fall, and compares against the SHA1 class.
+bool matches_reference(sha1_kernel kernel) {
+	std::vector<unsigned char> data(300);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = static_cast<unsigned char>(i*31+7);
+	}
+	
+	for (size_t len = 0; len <= data.size(); len++) {
+		SHA1 ref;
+		unsigned int words[5];
+		
+		ref.Input(&data[0],len);
+		ref.Result(words);
+		
+		unsigned char expected[20];
+		for (size_t i = 0; i < 5; i++) {
+			uint32_t w = htonl(words[i]);
+			std::memcpy(expected+4*i,&w,4);
+		}
+		
+		unsigned char digest[20];
+		sha1(&data[0],len,digest,kernel);
+		
+		if (std::memcmp(digest,expected,20) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( sha1_suite )
+
+BOOST_AUTO_TEST_CASE( sha1_known_values ) {
+	unsigned char digest[20];
+	
+	sha1(reinterpret_cast<const unsigned char*>("abc"),3,digest);
+	BOOST_CHECK( hex(digest,20) == "a9993e364706816aba3e25717850c26c9cd0d89d" );
+	
+	sha1(NULL,0,digest);
+	BOOST_CHECK( hex(digest,20) == "da39a3ee5e6b4b0d3255bfef95601890afd80709" );
+}
+
+BOOST_AUTO_TEST_CASE( sha1_scalar_matches_reference ) {
+	BOOST_CHECK( matches_reference(&sha1_scalar) );
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+BOOST_AUTO_TEST_CASE( sha1_sha_matches_reference ) {
+	if (get_cpu_features().sha) {
+		BOOST_CHECK( matches_reference(&sha1_sha) );
+	}
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( accept_key ) {
+	// the example from RFC 6455 section 1.3
+	const char* key = "dGhlIHNhbXBsZSBub25jZQ==";
+	char out[websocketpp::ACCEPT_KEY_SIZE];
+	
+	websocketpp::make_accept_key(key,std::strlen(key),out);
+	BOOST_CHECK( std::string(out,sizeof(out)) == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=" );
+	
+	// keys too long to be valid still get an answer
+	std::string long_key(100,'k');
+	websocketpp::make_accept_key(long_key.data(),long_key.size(),out);
+	BOOST_CHECK( out[27] == '=' );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+#include "../../src/prepared_message.hpp"
+
+#include "loopback.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session;
+using websocketpp::session_ptr;
+using loopback::free_port;
+using loopback::run_io_service;
+using loopback::test_client;
+
+namespace {
+
+const size_t LOW_WATERMARK = 64*1024;
+const size_t HIGH_WATERMARK = 256*1024;
+const size_t MESSAGE_SIZE = 32*1024;
+const size_t FILL_MESSAGES = 32;
+const uint32_t STALL_TIMEOUT = 100; // ms
+
+// Small socket buffers on both ends, so that the server's send queue stops
+// draining soon after the client stops reading.
+const int SOCKET_BUFFER = 16*1024;
+
+// Floods each session with FILL_MESSAGES messages of MESSAGE_SIZE, followed
+// by a ping, when it receives "fill". The payload of message i starts with 
+// the letter 'A'+i. "key <k><rest>" sends "<k><rest>" with the conflation
+// key "<k>". Records what send returned and the session's counters.
+class flood_handler : public websocketpp::connection_handler {
+public:
+	flood_handler(session::slow_consumer_policy policy)
+	 : m_policy(policy),m_fills(0),m_drains(0),m_closed(0) {}
+	
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {
+		session->socket().set_option(
+			boost::asio::socket_base::send_buffer_size(SOCKET_BUFFER)
+		);
+		session->set_send_watermarks(LOW_WATERMARK,HIGH_WATERMARK);
+		session->set_slow_consumer_policy(m_policy);
+		session->set_send_stall_timeout(STALL_TIMEOUT);
+	}
+	void on_close(session_ptr session) {
+		update(m_closed,session);
+	}
+	void on_drain(session_ptr session) {
+		update(m_drains,session);
+	}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {
+		if (msg == "fill") {
+			std::vector<session::send_status> statuses;
+			
+			for (size_t i = 0; i < FILL_MESSAGES; i++) {
+				std::string payload(MESSAGE_SIZE,'x');
+				payload[0] = static_cast<char>('A'+i);
+				statuses.push_back(session->send(payload));
+			}
+			session->ping("keep");
+			
+			boost::lock_guard<boost::mutex> lock(m_lock);
+			m_statuses = statuses;
+		} else if (msg.compare(0,4,"key ") == 0) {
+			session->send(websocketpp::prepared_message(msg.substr(4)),
+			              msg.substr(4,1));
+		}
+		update(m_fills,session);
+	}
+	
+	// waits up to a few seconds for one of the counts below to reach count
+	bool wait(const size_t& value,size_t count) {
+		boost::unique_lock<boost::mutex> lock(m_lock);
+		boost::system_time deadline = boost::get_system_time() + 
+		                              boost::posix_time::seconds(5);
+		while (value < count) {
+			if (!m_changed.timed_wait(lock,deadline)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	size_t get(const size_t& value) {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		return value;
+	}
+	
+	std::vector<session::send_status> get_statuses() {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		return m_statuses;
+	}
+	
+	session::send_counters get_counters() {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		return m_counters;
+	}
+	
+	// messages handled, on_drain calls and sessions closed
+	const size_t& fills() const {return m_fills;}
+	const size_t& drains() const {return m_drains;}
+	const size_t& closed() const {return m_closed;}
+private:
+	void update(size_t& value,session_ptr session) {
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_counters = session->get_send_counters();
+		value++;
+		m_changed.notify_all();
+	}
+	
+	session::slow_consumer_policy		m_policy;
+	
+	boost::mutex						m_lock;
+	boost::condition_variable			m_changed;
+	size_t								m_fills;
+	size_t								m_drains;
+	size_t								m_closed;
+	std::vector<session::send_status>	m_statuses;
+	session::send_counters				m_counters;
+};
+
+// Runs a server with a flood_handler on the loopback interface.
+class flood_server {
+public:
+	flood_server(session::slow_consumer_policy policy)
+	 : m_port(free_port(m_io_service)),
+	   m_handler(new flood_handler(policy)),
+	   m_server(new server(
+	   	m_io_service,
+	   	tcp::endpoint(boost::asio::ip::address_v4::loopback(),m_port),
+	   	m_handler
+	   ))
+	{
+		m_server->set_elog_level(websocketpp::LOG_OFF);
+		m_server->set_alog_level(websocketpp::ALOG_OFF);
+		m_server->start_accept();
+		
+		m_thread.reset(new boost::thread(&run_io_service,&m_io_service));
+	}
+	
+	~flood_server() {
+		m_io_service.stop();
+		m_thread->join();
+	}
+	
+	unsigned short port() const {return m_port;}
+	flood_handler& handler() {return *m_handler;}
+private:
+	boost::asio::io_service				m_io_service;
+	unsigned short						m_port;
+	boost::shared_ptr<flood_handler>	m_handler;
+	websocketpp::server_ptr				m_server;
+	boost::scoped_ptr<boost::thread>	m_thread;
+};
+
+// Reads until the fill's ping and count data messages have arrived and 
+// returns the first letter of each data message.
+std::string read_fill(test_client& c,size_t count) {
+	std::string letters;
+	bool pinged = false;
+	
+	while (letters.size() < count || !pinged) {
+		std::string payload;
+		unsigned char op = c.read_frame(payload);
+		
+		if (op == 0x9) {
+			BOOST_CHECK( payload == "keep" );
+			pinged = true;
+		} else {
+			BOOST_REQUIRE( op == 0x1 && payload.size() == MESSAGE_SIZE );
+			letters += payload[0];
+		}
+	}
+	return letters;
+}
+
+// Checks that the sends of a fill were accepted up to the one that took the
+// queue over the high watermark, which was reported, and the rest were 
+// refused. Returns how many were accepted.
+size_t check_refused(const std::vector<session::send_status>& statuses) {
+	size_t accepted = 0;
+	
+	while (accepted < statuses.size() && statuses[accepted] == session::SEND_OK) {
+		accepted++;
+	}
+	BOOST_REQUIRE( accepted > 1 && accepted+1 < statuses.size() );
+	BOOST_CHECK( statuses[accepted] == session::SEND_BLOCKED );
+	accepted++;
+	
+	for (size_t i = accepted; i < statuses.size(); i++) {
+		BOOST_CHECK( statuses[i] == session::SEND_REJECTED );
+	}
+	return accepted;
+}
+
+// Reads frames until a close frame arrives and returns its status code. 
+// Counts the data messages and pings that came before it.
+uint16_t read_close(test_client& c,size_t& messages,size_t& pings) {
+	messages = 0;
+	pings = 0;
+	
+	for (;;) {
+		std::string payload;
+		unsigned char op = c.read_frame(payload);
+		
+		if (op == 0x8) {
+			BOOST_REQUIRE( payload.size() >= 2 );
+			return static_cast<uint16_t>(
+				(static_cast<unsigned char>(payload[0]) << 8) | 
+				static_cast<unsigned char>(payload[1])
+			);
+		} else if (op == 0x9) {
+			pings++;
+		} else {
+			messages++;
+		}
+	}
+}
+
+// time for anything that is going to be written to be written
+void settle() {
+	boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( slow_consumer_suite )
+
+BOOST_AUTO_TEST_CASE( sends_block_then_refuse_until_drained ) {
+	flood_server s(session::SLOW_CONSUMER_REFUSE);
+	flood_handler& h = s.handler();
+	
+	boost::asio::io_service client_io_service;
+	test_client c(client_io_service,s.port(),SOCKET_BUFFER);
+	
+	// the client stops reading
+	c.send_text("fill");
+	BOOST_REQUIRE( h.wait(h.fills(),1) );
+	
+	size_t accepted = check_refused(h.get_statuses());
+	BOOST_CHECK( h.get_counters().refused == FILL_MESSAGES-accepted );
+	
+	// nothing drains while the client isn't reading
+	settle();
+	BOOST_CHECK( h.get(h.drains()) == 0 );
+	
+	// once it reads again the queue falls to the low watermark and on_drain
+	// is called, once
+	std::string letters = read_fill(c,accepted);
+	BOOST_CHECK( letters == std::string("ABCDEFGHIJKLMNOPQRSTUVWXYZ",accepted) );
+	BOOST_REQUIRE( h.wait(h.drains(),1) );
+	
+	c.send_text("fill");
+	BOOST_REQUIRE( h.wait(h.fills(),2) );
+	BOOST_CHECK( h.get(h.drains()) == 1 );
+	
+	read_fill(c,check_refused(h.get_statuses()));
+	c.close();
+	BOOST_REQUIRE( h.wait(h.closed(),1) );
+}
+
+BOOST_AUTO_TEST_CASE( disconnect_closes_a_stalled_session_with_1008 ) {
+	flood_server s(session::SLOW_CONSUMER_DISCONNECT);
+	flood_handler& h = s.handler();
+	
+	boost::asio::io_service client_io_service;
+	test_client c(client_io_service,s.port(),SOCKET_BUFFER);
+	
+	c.send_text("fill");
+	BOOST_REQUIRE( h.wait(h.fills(),1) );
+	size_t accepted = check_refused(h.get_statuses());
+	
+	// The buffer doesn't drain within the stall timeout. The session drops
+	// the data that hasn't started to be written and closes with 1008.
+	settle();
+	
+	size_t messages;
+	size_t pings;
+	BOOST_CHECK( read_close(c,messages,pings) == 
+	             session::CLOSE_STATUS_POLICY_VIOLATION );
+	BOOST_CHECK( messages < accepted );
+	BOOST_CHECK( pings == 1 );
+	BOOST_CHECK( h.get(h.drains()) == 0 );
+	
+	c.close();
+	BOOST_REQUIRE( h.wait(h.closed(),1) );
+	BOOST_CHECK( h.get_counters().dropped == accepted-messages );
+}
+
+BOOST_AUTO_TEST_CASE( drop_oldest_keeps_control_frames ) {
+	flood_server s(session::SLOW_CONSUMER_DROP_OLDEST);
+	flood_handler& h = s.handler();
+	
+	boost::asio::io_service client_io_service;
+	test_client c(client_io_service,s.port(),SOCKET_BUFFER);
+	
+	// every message is accepted, the oldest are dropped to make room
+	c.send_text("fill");
+	BOOST_REQUIRE( h.wait(h.fills(),1) );
+	
+	std::vector<session::send_status> statuses = h.get_statuses();
+	for (size_t i = 0; i < statuses.size(); i++) {
+		BOOST_CHECK( statuses[i] != session::SEND_REJECTED );
+	}
+	
+	uint64_t dropped = h.get_counters().dropped;
+	BOOST_REQUIRE( dropped > 0 && dropped < FILL_MESSAGES );
+	
+	// The ping queued after the messages still arrives, as does the newest
+	// message. What is left of the rest arrives in order.
+	settle();
+	std::string letters = read_fill(c,FILL_MESSAGES-dropped);
+	
+	BOOST_CHECK( letters[letters.size()-1] == 'A'+FILL_MESSAGES-1 );
+	for (size_t i = 1; i < letters.size(); i++) {
+		BOOST_CHECK( letters[i-1] < letters[i] );
+	}
+	
+	c.close();
+	BOOST_REQUIRE( h.wait(h.closed(),1) );
+}
+
+BOOST_AUTO_TEST_CASE( conflate_keeps_the_newest_message_per_key ) {
+	flood_server s(session::SLOW_CONSUMER_CONFLATE);
+	flood_handler& h = s.handler();
+	
+	boost::asio::io_service client_io_service;
+	test_client c(client_io_service,s.port(),SOCKET_BUFFER);
+	
+	// messages without a key are refused over the high watermark
+	c.send_text("fill");
+	BOOST_REQUIRE( h.wait(h.fills(),1) );
+	size_t accepted = check_refused(h.get_statuses());
+	
+	// keyed messages replace the queued message with the same key
+	for (char i = '1'; i <= '5'; i++) {
+		c.send_text(std::string("key a")+i);
+		c.send_text(std::string("key b")+i);
+	}
+	BOOST_REQUIRE( h.wait(h.fills(),11) );
+	BOOST_CHECK( h.get_counters().conflated == 8 );
+	BOOST_CHECK( h.get_counters().dropped == 0 );
+	
+	settle();
+	read_fill(c,accepted);
+	BOOST_CHECK( c.read_text() == "a5" );
+	BOOST_CHECK( c.read_text() == "b5" );
+	
+	c.close();
+	BOOST_REQUIRE( h.wait(h.closed(),1) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
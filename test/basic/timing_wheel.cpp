@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/timing_wheel.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include <vector>
+
+using websocketpp::timing_wheel;
+
+namespace {
+
+void record(std::vector<int>* fired,int id) {
+	fired->push_back(id);
+}
+
+void restart(timing_wheel::timer* t,std::vector<int>* fired,int id) {
+	fired->push_back(id);
+	t->start(timing_wheel::TICK_MS,boost::bind(&record,fired,id+1));
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE ( timing_wheel_suite )
+
+BOOST_AUTO_TEST_CASE( timing_wheel_fires_in_expiry_order ) {
+	boost::asio::io_service io_service;
+	timing_wheel& wheel = boost::asio::use_service<timing_wheel>(io_service);
+	std::vector<int> fired;
+	
+	timing_wheel::timer a(io_service);
+	timing_wheel::timer b(io_service);
+	timing_wheel::timer c(io_service);
+	timing_wheel::timer d(io_service);
+	
+	a.start(3*timing_wheel::TICK_MS,boost::bind(&record,&fired,1));
+	b.start(timing_wheel::TICK_MS,boost::bind(&record,&fired,2));
+	c.start(2*timing_wheel::TICK_MS,boost::bind(&record,&fired,3));
+	d.start(2*timing_wheel::TICK_MS,boost::bind(&record,&fired,4));
+	d.cancel();
+	
+	BOOST_CHECK( wheel.size() == 3 );
+	BOOST_CHECK( a.pending() && !d.pending() );
+	
+	// timers wait at least as long as asked, so nothing is due yet
+	uint64_t start = wheel.get_tick();
+	wheel.advance_to(start+1);
+	BOOST_CHECK( fired.empty() );
+	
+	wheel.advance_to(start+3);
+	BOOST_REQUIRE( fired.size() == 2 );
+	BOOST_CHECK( fired[0] == 2 );
+	BOOST_CHECK( fired[1] == 3 );
+	
+	wheel.advance_to(start+10);
+	BOOST_REQUIRE( fired.size() == 3 );
+	BOOST_CHECK( fired[2] == 1 );
+	BOOST_CHECK( wheel.size() == 0 );
+	BOOST_CHECK( !a.pending() );
+}
+
+BOOST_AUTO_TEST_CASE( timing_wheel_restarts_from_handlers ) {
+	boost::asio::io_service io_service;
+	timing_wheel& wheel = boost::asio::use_service<timing_wheel>(io_service);
+	std::vector<int> fired;
+	
+	timing_wheel::timer t(io_service);
+	t.start(0,boost::bind(&restart,&t,&fired,1));
+	
+	wheel.advance_to(wheel.get_tick()+1);
+	BOOST_REQUIRE( fired.size() == 1 );
+	BOOST_CHECK( t.pending() );
+	
+	wheel.advance_to(wheel.get_tick()+2);
+	BOOST_REQUIRE( fired.size() == 2 );
+	BOOST_CHECK( fired[1] == 2 );
+	BOOST_CHECK( !t.pending() );
+}
+
+BOOST_AUTO_TEST_CASE( timing_wheel_cascades_long_timeouts ) {
+	boost::asio::io_service io_service;
+	timing_wheel& wheel = boost::asio::use_service<timing_wheel>(io_service);
+	std::vector<int> fired;
+	
+	// one timeout for each level
+	const uint32_t ticks[] = {100,1000,30000,2000000};
+	timing_wheel::timer t0(io_service);
+	timing_wheel::timer t1(io_service);
+	timing_wheel::timer t2(io_service);
+	timing_wheel::timer t3(io_service);
+	timing_wheel::timer* timers[] = {&t0,&t1,&t2,&t3};
+	
+	for (int i = 0; i < 4; i++) {
+		timers[i]->start(ticks[i]*timing_wheel::TICK_MS,
+		                 boost::bind(&record,&fired,i));
+	}
+	
+	uint64_t start = wheel.get_tick();
+	
+	for (int i = 0; i < 4; i++) {
+		wheel.advance_to(start+ticks[i]);
+		BOOST_CHECK( fired.size() == size_t(i) );
+		
+		wheel.advance_to(start+ticks[i]+1);
+		BOOST_REQUIRE( fired.size() == size_t(i+1) );
+		BOOST_CHECK( fired[i] == i );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( timing_wheel_runs_on_the_io_service ) {
+	boost::asio::io_service io_service;
+	std::vector<int> fired;
+	
+	timing_wheel::timer t(io_service);
+	t.start(timing_wheel::TICK_MS,boost::bind(&record,&fired,1));
+	
+	// returns once the timer has fired and the wheel is empty
+	io_service.run();
+	
+	BOOST_REQUIRE( fired.size() == 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../../src/simd/utf8.hpp"
+#include "../../src/simd/masking.hpp"
+#include "../../src/utf8_validator/utf8_validator.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+// Validates s in one call, returns true if it is complete, valid UTF-8.
+bool valid(utf8_kernel kernel,const std::string& s) {
+	uint32_t state = utf8_validator::UTF8_ACCEPT;
+	uint32_t codep = 0;
+	
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+	
+	return kernel(p,s.size(),&state,&codep) && 
+	       state == utf8_validator::UTF8_ACCEPT;
+}
+
+// Validates s split at every possible point, as if it arrived in two
+// fragments. Returns true if every split gives the same answer as the DFA.
+bool split_matches_dfa(utf8_kernel kernel,const std::string& s) {
+	bool expected = valid(&validate_utf8_dfa,s);
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+	
+	for (size_t i = 0; i <= s.size(); i++) {
+		uint32_t state = utf8_validator::UTF8_ACCEPT;
+		uint32_t codep = 0;
+		
+		bool r = kernel(p,i,&state,&codep) && 
+		         kernel(p+i,s.size()-i,&state,&codep) &&
+		         state == utf8_validator::UTF8_ACCEPT;
+		
+		if (r != expected) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// A mix of ASCII runs long enough to hit the vector fast paths and multibyte
+// sequences landing at every position relative to a block boundary.
+std::vector<std::string> corpus() {
+	std::vector<std::string> c;
+	
+	const char* multibyte[] = {
+		"\xc3\xa9",              // e acute
+		"\xe4\xb8\xad",          // CJK
+		"\xf0\x9f\x98\x80",      // emoji
+	};
+	const char* invalid[] = {
+		"\xc3",                  // truncated
+		"\xc0\xaf",              // overlong
+		"\xed\xa0\x80",          // surrogate
+		"\xf4\x90\x80\x80",      // above U+10FFFF
+		"\xff",
+	};
+	
+	for (size_t pad = 0; pad < 70; pad++) {
+		for (size_t m = 0; m < 3; m++) {
+			c.push_back(std::string(pad,'a') + multibyte[m] + std::string(40,'b'));
+		}
+		for (size_t m = 0; m < 5; m++) {
+			c.push_back(std::string(pad,'a') + invalid[m] + std::string(40,'b'));
+		}
+	}
+	c.push_back(std::string(300,'x'));
+	return c;
+}
+
+bool matches_dfa(utf8_kernel kernel) {
+	std::vector<std::string> c = corpus();
+	for (size_t i = 0; i < c.size(); i++) {
+		if (!split_matches_dfa(kernel,c[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Masks s, then unmasks and validates it with kernel split at every possible
+// point and with every starting key position. Returns true if each run gives
+// the same answer as the DFA, and valid runs get back s and the right key
+// position.
+bool fused_split_matches_dfa(unmask_utf8_kernel kernel,const std::string& s) {
+	const char key[4] = {'\x9c','\x21','\x7f','\xe0'};
+	bool expected = valid(&validate_utf8_dfa,s);
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+	
+	for (size_t i = 0; i <= s.size(); i++) {
+		size_t ki = i & 3;
+		std::vector<unsigned char> masked(s.size()+1);
+		mask_scalar(p,&masked[0],s.size(),key,ki);
+		
+		uint32_t state = utf8_validator::UTF8_ACCEPT;
+		uint32_t codep = 0;
+		size_t key_index = ki;
+		
+		bool r = kernel(&masked[0],&masked[0],i,key,&key_index,&state,&codep) && 
+		         kernel(&masked[i],&masked[i],s.size()-i,key,&key_index,&state,&codep) &&
+		         state == utf8_validator::UTF8_ACCEPT;
+		
+		if (r != expected) {
+			return false;
+		}
+		if (r && (key_index != ((ki+s.size()) & 3) || 
+		          std::string(masked.begin(),masked.end()-1) != s)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The fused kernels work in larger blocks than the validators, so they are
+// also run over the corpus behind a long ASCII prefix.
+bool fused_matches_dfa(unmask_utf8_kernel kernel) {
+	std::vector<std::string> c = corpus();
+	for (size_t i = 0; i < c.size(); i++) {
+		if (!fused_split_matches_dfa(kernel,c[i]) ||
+		    !fused_split_matches_dfa(kernel,std::string(150,'c')+c[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( utf8_dfa_known_values ) {
+	BOOST_CHECK( valid(&validate_utf8_dfa,"Hello-\xc2\xb5@\xc3\x9f\xc3\xb6\xc3\xa4\xc3\xbc\xc3\xa0\xc3\xa1-UTF-8!!") );
+	BOOST_CHECK( !valid(&validate_utf8_dfa,"\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5\xed\xa0\x80" "edited") );
+	BOOST_CHECK( !valid(&validate_utf8_dfa,"\xf0\x9f\x98") );
+}
+
+BOOST_AUTO_TEST_CASE( utf8_word_matches_dfa ) {
+	BOOST_CHECK( matches_dfa(&validate_utf8_word) );
+}
+
+BOOST_AUTO_TEST_CASE( utf8_dispatch_matches_dfa ) {
+	BOOST_CHECK( matches_dfa(&validate_utf8) );
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+BOOST_AUTO_TEST_CASE( utf8_sse2_matches_dfa ) {
+	if (get_cpu_features().sse2) {
+		BOOST_CHECK( matches_dfa(&validate_utf8_sse2) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( utf8_avx2_matches_dfa ) {
+	if (get_cpu_features().avx2) {
+		BOOST_CHECK( matches_dfa(&validate_utf8_avx2) );
+	}
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( unmask_utf8_reference_matches_dfa ) {
+	BOOST_CHECK( fused_matches_dfa(&unmask_validate_utf8_reference) );
+}
+
+BOOST_AUTO_TEST_CASE( unmask_utf8_word_matches_dfa ) {
+	BOOST_CHECK( fused_matches_dfa(&unmask_validate_utf8_word) );
+}
+
+BOOST_AUTO_TEST_CASE( unmask_utf8_dispatch_matches_dfa ) {
+	BOOST_CHECK( fused_matches_dfa(&unmask_validate_utf8) );
+}
+
+#if defined(WEBSOCKETPP_SIMD_X86)
+BOOST_AUTO_TEST_CASE( unmask_utf8_sse2_matches_dfa ) {
+	if (get_cpu_features().sse2) {
+		BOOST_CHECK( fused_matches_dfa(&unmask_validate_utf8_sse2) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( unmask_utf8_avx2_matches_dfa ) {
+	if (get_cpu_features().avx2) {
+		BOOST_CHECK( fused_matches_dfa(&unmask_validate_utf8_avx2) );
+	}
+}
+#endif
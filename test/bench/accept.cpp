@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+// Reports how many Sec-WebSocket-Accept values can be computed per second,
+// by the old SHA1 class and base64_encode path and by make_accept_key, and
+// how fast each SHA-1 kernel hashes the 60 byte input on its own.
+
+#include "bench.hpp"
+
+#include "../../src/network_utilities.hpp"
+#include "../../src/simd/sha1_kernels.hpp"
+#include "../../src/sha1/sha1.h"
+#include "../../src/base64/base64.h"
+
+#include <arpa/inet.h>
+
+#include <string>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+const size_t ITERATIONS = 2000000;
+
+const char* KEY = "dGhlIHNhbXBsZSBub25jZQ==";
+
+// what the handshake code did before make_accept_key
+std::string old_accept_key(const std::string& key) {
+	std::string server_key = key;
+	server_key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	
+	SHA1		sha;
+	uint32_t	message_digest[5];
+	
+	sha.Reset();
+	sha << server_key.c_str();
+	sha.Result(message_digest);
+	
+	for (int i = 0; i < 5; i++) {
+		message_digest[i] = htonl(message_digest[i]);
+	}
+	
+	return base64_encode(
+		reinterpret_cast<const unsigned char*>(message_digest),20);
+}
+
+void run_old() {
+	std::string key(KEY);
+	size_t n = 0;
+	
+	bench::timer t;
+	for (size_t i = 0; i < ITERATIONS; i++) {
+		n += old_accept_key(key).size();
+	}
+	double secs = t.elapsed();
+	bench::do_not_optimize(n);
+	
+	bench::report("SHA1 class + base64_encode",ITERATIONS/secs/1e6,"M keys/s");
+}
+
+void run_new() {
+	size_t len = std::strlen(KEY);
+	char out[websocketpp::ACCEPT_KEY_SIZE];
+	
+	bench::timer t;
+	for (size_t i = 0; i < ITERATIONS; i++) {
+		websocketpp::make_accept_key(KEY,len,out);
+		bench::do_not_optimize(out[0]);
+	}
+	double secs = t.elapsed();
+	
+	bench::report("make_accept_key",ITERATIONS/secs/1e6,"M keys/s");
+}
+
+void run_kernel(const std::string& name,sha1_kernel kernel) {
+	unsigned char data[60];
+	unsigned char digest[20];
+	std::memcpy(data,KEY,24);
+	std::memcpy(data+24,"258EAFA5-E914-47DA-95CA-C5AB0DC85B11",36);
+	
+	bench::timer t;
+	for (size_t i = 0; i < ITERATIONS; i++) {
+		sha1(data,sizeof(data),digest,kernel);
+		bench::do_not_optimize(digest[0]);
+	}
+	double secs = t.elapsed();
+	
+	bench::report("sha1 60B "+name,ITERATIONS/secs/1e6,"M hashes/s");
+}
+
+}
+
+int main() {
+	std::cout << "dispatching to: " << get_sha1_kernel_name() << std::endl;
+	
+	run_old();
+	run_new();
+	
+	run_kernel("scalar",&sha1_scalar);
+#if defined(WEBSOCKETPP_SIMD_X86)
+	if (get_cpu_features().sha) {
+		run_kernel("sha",&sha1_sha);
+	}
+#endif
+	
+	return 0;
+}
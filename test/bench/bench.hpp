@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#ifndef WEBSOCKETPP_BENCH_HPP
+#define WEBSOCKETPP_BENCH_HPP
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Shared helpers for the benchmark programs in this directory.
+namespace bench {
+
+class timer {
+public:
+	timer() : m_start(boost::posix_time::microsec_clock::universal_time()) {}
+	
+	// seconds since construction
+	double elapsed() const {
+		boost::posix_time::time_duration d = 
+			boost::posix_time::microsec_clock::universal_time() - m_start;
+		return d.total_microseconds() / 1e6;
+	}
+private:
+	boost::posix_time::ptime m_start;
+};
+
+// Prints one result line: name, a value and its unit, aligned in columns.
+inline void report(const std::string& name,double value,const std::string& unit) {
+	std::cout << std::left << std::setw(40) << name 
+	          << std::right << std::setw(12) << std::fixed 
+	          << std::setprecision(2) << value << " " << unit << std::endl;
+}
+
+// Keeps the optimizer from discarding work whose result is otherwise unused.
+// The empty asm statement tells the compiler that v is read and that memory
+// may have changed, so v has to be computed and stored before this point.
+template <typename T>
+inline void do_not_optimize(const T& v) {
+#if defined(__GNUC__)
+	__asm__ __volatile__("" : : "g"(&v) : "memory");
+#else
+	static const volatile T* volatile sink;
+	sink = &v;
+#endif
+}
+
+}
+
+#endif // WEBSOCKETPP_BENCH_HPP
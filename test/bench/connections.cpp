@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Measures the memory an idle open connection costs the server, as the 
+// growth in resident set size per connection as connections are opened and
+// left idle, at 10k, 100k and 1M connections by default. The clients are 
+// plain sockets in the same process, spread over loopback addresses so that
+// they don't run out of ports, and cost little next to the server side.
+//
+// Each connection takes two file descriptors and the kernel needs memory 
+// for both sockets. The benchmark raises RLIMIT_NOFILE as far as it needs,
+// hard limit included when it runs as root, up to fs.nr_open, and stops at
+// whatever count the limit allows. 1M connections needs fs.nr_open above 
+// 2M and a machine to match. It also stops at the first connection that
+// fails and reports what it reached.
+//
+// usage: connections [count...]
+
+#include "bench.hpp"
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session_ptr;
+
+namespace {
+
+const unsigned short PORT = 19301;
+
+// connections per loopback source address, well within the port range
+const size_t PER_ADDRESS = 20000;
+
+// Completes every handshake and counts the sessions that open.
+class count_opens : public websocketpp::connection_handler {
+public:
+	count_opens() : opened(0) {}
+	
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {
+		++opened;
+	}
+	void on_close(session_ptr session) {}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {}
+	
+	boost::detail::atomic_count opened;
+};
+
+const char REQUEST[] =
+	"GET /chat HTTP/1.1\r\n"
+	"Host: localhost:19301\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"Sec-WebSocket-Protocol: chat, superchat\r\n"
+	"Origin: http://localhost\r\n"
+	"User-Agent: websocketpp-bench/1.0\r\n"
+	"Accept-Language: en-US,en;q=0.9\r\n"
+	"Cache-Control: no-cache\r\n"
+	"\r\n";
+
+size_t resident_bytes() {
+	long pages = 0;
+	long resident = 0;
+	
+	FILE* f = fopen("/proc/self/statm","r");
+	if (f != NULL) {
+		if (fscanf(f,"%ld %ld",&pages,&resident) != 2) {
+			resident = 0;
+		}
+		fclose(f);
+	}
+	return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// Opens a connection from 127.0.0.x and completes its handshake. Returns 
+// the descriptor, or -1.
+int open_connection(size_t i) {
+	int fd = socket(AF_INET,SOCK_STREAM,0);
+	if (fd < 0) {
+		return -1;
+	}
+	
+	sockaddr_in local;
+	memset(&local,0,sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(0x7F000001 + i/PER_ADDRESS);
+	
+	sockaddr_in remote;
+	memset(&remote,0,sizeof(remote));
+	remote.sin_family = AF_INET;
+	remote.sin_port = htons(PORT);
+	remote.sin_addr.s_addr = htonl(0x7F000001);
+	
+	if (bind(fd,reinterpret_cast<sockaddr*>(&local),sizeof(local)) != 0 ||
+	    connect(fd,reinterpret_cast<sockaddr*>(&remote),sizeof(remote)) != 0 ||
+	    send(fd,REQUEST,sizeof(REQUEST)-1,0) != sizeof(REQUEST)-1)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	// the response is small enough to arrive in one piece
+	char response[1024];
+	std::string got;
+	while (got.find("\r\n\r\n") == std::string::npos) {
+		ssize_t n = recv(fd,response,sizeof(response),0);
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		got.append(response,n);
+	}
+	
+	return fd;
+}
+
+// Raises RLIMIT_NOFILE to what connections need and returns how many 
+// connections the limit allows. The hard limit can only be raised with 
+// privileges, and no further than fs.nr_open. If it can't be, the soft 
+// limit goes as far as the hard one.
+size_t raise_fd_limit(size_t connections) {
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE,&limit) != 0) {
+		return connections;
+	}
+	
+	rlim_t wanted = connections*2 + 64;
+	if (limit.rlim_cur >= wanted) {
+		return connections;
+	}
+	
+	if (limit.rlim_max < wanted) {
+		rlimit raised;
+		raised.rlim_cur = wanted;
+		raised.rlim_max = wanted;
+		
+		if (setrlimit(RLIMIT_NOFILE,&raised) == 0) {
+			return connections;
+		}
+	}
+	
+	limit.rlim_cur = std::min(wanted,limit.rlim_max);
+	setrlimit(RLIMIT_NOFILE,&limit);
+	getrlimit(RLIMIT_NOFILE,&limit);
+	
+	return limit.rlim_cur < 64 ? 0 : (limit.rlim_cur-64)/2;
+}
+
+void run_io_service(boost::asio::io_service* io_service) {
+	io_service->run();
+}
+
+}
+
+int main(int argc,char* argv[]) {
+	std::vector<size_t> counts;
+	
+	for (int i = 1; i < argc; i++) {
+		counts.push_back(atoi(argv[i]));
+	}
+	if (counts.empty()) {
+		counts.push_back(10000);
+		counts.push_back(100000);
+		counts.push_back(1000000);
+	}
+	
+	// the server aborts if it runs out of descriptors, so stay within them
+	size_t reach = raise_fd_limit(counts.back());
+	if (counts.back() > reach) {
+		std::cout << "RLIMIT_NOFILE allows about " << reach 
+		          << " connections" << std::endl;
+		
+		while (!counts.empty() && counts.back() > reach) {
+			counts.pop_back();
+		}
+		counts.push_back(reach);
+	}
+	
+	boost::asio::io_service io_service;
+	boost::shared_ptr<count_opens> handler(new count_opens());
+	websocketpp::server_ptr s(new server(
+		io_service,tcp::endpoint(tcp::v4(),PORT),handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->start_accept();
+	
+	boost::thread io_thread(&run_io_service,&io_service);
+	
+	bench::report("sizeof(server_session)",
+	              sizeof(websocketpp::server_session),"bytes");
+	
+	// one connection first, so that what every connection shares is in the
+	// baseline
+	std::vector<int> fds;
+	fds.push_back(open_connection(0));
+	
+	while (handler->opened < 1) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+	
+	size_t baseline = resident_bytes();
+	bool failed = fds.back() < 0;
+	
+	for (size_t c = 0; c < counts.size() && !failed; c++) {
+		while (fds.size() < counts[c]) {
+			int fd = open_connection(fds.size());
+			if (fd < 0) {
+				failed = true;
+				break;
+			}
+			fds.push_back(fd);
+		}
+		
+		while (handler->opened < static_cast<long>(fds.size())) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+		
+		std::stringstream name;
+		name << "idle connections: " << fds.size();
+		bench::report(name.str(),
+		              double(resident_bytes() - baseline) / (fds.size() - 1),
+		              "bytes/connection");
+	}
+	
+	if (failed) {
+		std::cout << "stopped at " << fds.size() << " connections: " 
+		          << strerror(errno) << std::endl;
+	}
+	
+	for (size_t i = 0; i < fds.size(); i++) {
+		close(fds[i]);
+	}
+	
+	io_service.stop();
+	io_thread.join();
+	
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Reports what permessage-deflate costs and saves on JSON-like messages:
+// compression and decompression throughput against the size of the input,
+// and the compression ratio, for a few zlib levels and message sizes, with
+// and without context takeover.
+
+#include "bench.hpp"
+
+#include "../../src/permessage_deflate.hpp"
+#include "../../src/prepared_message.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using websocketpp::permessage_deflate;
+using websocketpp::prepared_message;
+
+namespace {
+
+// Records that look alike but not the same, as a typical JSON feed does.
+std::string json_message(size_t size,unsigned int seed) {
+	std::stringstream s;
+	s << "[";
+	for (unsigned int i = 0; s.tellp() < static_cast<std::streampos>(size); i++) {
+		unsigned int n = (seed+i)*2654435761u;
+		s << "{\"id\":" << (n % 100000)
+		  << ",\"symbol\":\"SYM" << (n % 97)
+		  << "\",\"price\":" << (n % 10000) << "." << (n % 100)
+		  << ",\"volume\":" << (n % 1000000)
+		  << ",\"side\":\"" << ((n & 1) ? "buy" : "sell") << "\"},";
+	}
+	return s.str().substr(0,size);
+}
+
+// Negotiates the extension between a server side sender and a client side
+// receiver.
+void negotiate(const permessage_deflate::settings& s,
+               permessage_deflate& sender,permessage_deflate& receiver)
+{
+	std::vector<std::string> offers(1,permessage_deflate::generate_offer(s));
+	receiver.accept_response(s,sender.negotiate(s,offers));
+}
+
+void run(int level,bool takeover,size_t size) {
+	permessage_deflate::settings s;
+	s.enabled = true;
+	s.compression_level = level;
+	s.server_no_context_takeover = !takeover;
+	
+	// A stream of different messages, as a connection would send them. There
+	// are enough that a message is out of the window by the time it repeats.
+	const size_t count = std::max(size_t(64),size_t(1 << 17)/size);
+	std::vector<std::string> messages;
+	for (size_t i = 0; i < count; i++) {
+		messages.push_back(json_message(size,i*7919));
+	}
+	
+	size_t iterations = (size_t(1) << 25) / (size*count) + 1;
+	
+	std::vector<std::vector<unsigned char> > wire(count);
+	size_t in_bytes = 0;
+	size_t out_bytes = 0;
+	
+	permessage_deflate sender;
+	permessage_deflate receiver;
+	negotiate(s,sender,receiver);
+	
+	bench::timer t;
+	for (size_t i = 0; i < iterations; i++) {
+		for (size_t j = 0; j < count; j++) {
+			sender.compress(
+				reinterpret_cast<const unsigned char*>(messages[j].data()),
+				size,wire[j]
+			);
+			in_bytes += size;
+			out_bytes += wire[j].size();
+		}
+	}
+	double compress_secs = t.elapsed();
+	
+	// Inflating depends on the messages before, so each pass starts over
+	// with a fresh pair on messages compressed from the start of a stream.
+	{
+		permessage_deflate first;
+		permessage_deflate unused;
+		negotiate(s,first,unused);
+		
+		for (size_t j = 0; j < count; j++) {
+			first.compress(
+				reinterpret_cast<const unsigned char*>(messages[j].data()),
+				size,wire[j]
+			);
+		}
+	}
+	
+	std::vector<unsigned char> out;
+	
+	bench::timer t2;
+	for (size_t i = 0; i < iterations; i++) {
+		permessage_deflate unused;
+		permessage_deflate r;
+		negotiate(s,unused,r);
+		
+		for (size_t j = 0; j < count; j++) {
+			out.clear();
+			r.decompress(&wire[j][0],wire[j].size(),true,out,size);
+		}
+	}
+	double decompress_secs = t2.elapsed();
+	bench::do_not_optimize(out);
+	
+	std::stringstream label;
+	label << size << "B level " << level << (takeover ? "" : " no takeover");
+	
+	bench::report(label.str()+" deflate",in_bytes/compress_secs/1e6,"MB/s");
+	bench::report(label.str()+" inflate",in_bytes/decompress_secs/1e6,"MB/s");
+	bench::report(label.str()+" ratio",double(in_bytes)/out_bytes,":1");
+}
+
+}
+
+// Sends one message of size bytes to sessions that compress every message on
+// its own, first compressing it for each, then once through a prepared 
+// message.
+void broadcast(size_t size) {
+	const size_t sessions = 100;
+	
+	permessage_deflate::settings s;
+	s.enabled = true;
+	s.server_no_context_takeover = true;
+	
+	std::vector<permessage_deflate*> senders;
+	for (size_t i = 0; i < sessions; i++) {
+		permessage_deflate unused;
+		senders.push_back(new permessage_deflate());
+		negotiate(s,*senders.back(),unused);
+	}
+	
+	std::vector<std::string> messages;
+	for (size_t i = 0; i < 16; i++) {
+		messages.push_back(json_message(size,i*7919));
+	}
+	
+	// the first message sets up each session's zlib stream
+	std::vector<unsigned char> out;
+	for (size_t j = 0; j < sessions; j++) {
+		senders[j]->compress(
+			reinterpret_cast<const unsigned char*>(messages[0].data()),
+			size,out
+		);
+	}
+	
+	bench::timer t;
+	for (size_t i = 0; i < messages.size(); i++) {
+		for (size_t j = 0; j < sessions; j++) {
+			senders[j]->compress(
+				reinterpret_cast<const unsigned char*>(messages[i].data()),
+				size,out
+			);
+		}
+	}
+	double each_secs = t.elapsed();
+	bench::do_not_optimize(out);
+	
+	bench::timer t2;
+	for (size_t i = 0; i < messages.size(); i++) {
+		prepared_message m(messages[i]);
+		
+		for (size_t j = 0; j < sessions; j++) {
+			bench::do_not_optimize(m.get_compressed(*senders[j]));
+		}
+	}
+	double shared_secs = t2.elapsed();
+	
+	for (size_t i = 0; i < sessions; i++) {
+		delete senders[i];
+	}
+	
+	std::stringstream label;
+	label << size << "B broadcast to " << sessions << " sessions";
+	
+	double n = messages.size();
+	bench::report(label.str()+" per session",each_secs/n*1e6,"us");
+	bench::report(label.str()+" shared",shared_secs/n*1e6,"us");
+}
+
+int main() {
+	const size_t sizes[] = {256,4096,65536};
+	const int levels[] = {1,6,9};
+	
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			run(levels[j],true,sizes[i]);
+		}
+		run(1,false,sizes[i]);
+	}
+	
+	for (size_t i = 0; i < 3; i++) {
+		broadcast(sizes[i]);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+// Measures echo throughput with the server's sessions spread over io 
+// threads, to show how messages/s scales with the number of threads. Every
+// client connection runs on a thread of its own in this process, keeps
+// WINDOW short text messages in flight and sends a new one for each echo it
+// reads until the time is up. The clients need CPU as well, so scaling is
+// best measured with fewer io threads than the machine has cores.
+//
+// usage: echo [io threads] [connections] [seconds]
+//
+// 0 io threads runs the sessions on the server's own io_service, as before
+// io threads existed. The default is one thread per core.
+
+#include "bench.hpp"
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session_ptr;
+
+namespace {
+
+const unsigned short PORT = 19401;
+
+// messages each connection keeps in flight
+const size_t WINDOW = 16;
+
+// Sends every text message straight back.
+class echo_handler : public websocketpp::connection_handler {
+public:
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {}
+	void on_close(session_ptr session) {}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {
+		session->send(msg);
+	}
+};
+
+const char REQUEST[] =
+	"GET / HTTP/1.1\r\n"
+	"Host: localhost\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"Origin: http://localhost\r\n"
+	"\r\n";
+
+// 32 bytes of text. The client sends it masked with a 6 byte header and
+// the server echoes it unmasked with a 2 byte header.
+const size_t PAYLOAD_SIZE = 32;
+const size_t ECHO_SIZE = PAYLOAD_SIZE+2;
+
+std::string make_frames(size_t count) {
+	std::string frame;
+	frame += static_cast<char>(0x81);
+	frame += static_cast<char>(0x80 | PAYLOAD_SIZE);
+	frame += "\x12\x34\x56\x78";
+	
+	for (size_t i = 0; i < PAYLOAD_SIZE; i++) {
+		frame += static_cast<char>('x' ^ frame[2 + i%4]);
+	}
+	
+	std::string frames;
+	for (size_t i = 0; i < count; i++) {
+		frames += frame;
+	}
+	return frames;
+}
+
+// Runs one connection until stop is set, adding the echoes it reads to 
+// echoes as they arrive.
+void run_client(const boost::atomic<bool>* stop,boost::atomic<long>* echoes) {
+	boost::asio::io_service io_service;
+	tcp::socket socket(io_service);
+	socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(),PORT));
+	socket.set_option(tcp::no_delay(true));
+	boost::asio::write(socket,boost::asio::buffer(REQUEST,sizeof(REQUEST)-1));
+	
+	boost::asio::streambuf response;
+	size_t header = boost::asio::read_until(socket,response,"\r\n\r\n");
+	size_t pending = response.size()-header;
+	
+	const std::string frames = make_frames(WINDOW);
+	const size_t frame_size = frames.size()/WINDOW;
+	boost::asio::write(socket,boost::asio::buffer(frames));
+	
+	std::vector<char> buf(WINDOW*ECHO_SIZE);
+	
+	while (!stop->load(boost::memory_order_relaxed)) {
+		boost::system::error_code ec;
+		pending += socket.read_some(boost::asio::buffer(buf),ec);
+		if (ec) {
+			break;
+		}
+		
+		// one new message for each echo that has come back in full
+		size_t n = pending/ECHO_SIZE;
+		pending -= n*ECHO_SIZE;
+		echoes->fetch_add(n,boost::memory_order_relaxed);
+		
+		boost::asio::write(socket,boost::asio::buffer(frames.data(),n*frame_size),ec);
+		if (ec) {
+			break;
+		}
+	}
+}
+
+void run_io_service(boost::asio::io_service* io_service) {
+	io_service->run();
+}
+
+}
+
+int main(int argc,char* argv[]) {
+	size_t threads = boost::thread::hardware_concurrency();
+	size_t connections = 64;
+	double seconds = 5;
+	
+	if (argc > 1) {
+		threads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		connections = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		seconds = atof(argv[3]);
+	}
+	
+	boost::asio::io_service io_service;
+	boost::shared_ptr<echo_handler> handler(new echo_handler());
+	websocketpp::server_ptr s(new server(
+		io_service,tcp::endpoint(tcp::v4(),PORT),handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->set_io_threads(threads);
+	s->start_accept();
+	
+	boost::thread io_thread(&run_io_service,&io_service);
+	
+	boost::atomic<bool> stop(false);
+	boost::atomic<long> echoes(0);
+	boost::thread_group clients;
+	
+	for (size_t i = 0; i < connections; i++) {
+		clients.create_thread(boost::bind(&run_client,&stop,&echoes));
+	}
+	
+	bench::timer t;
+	boost::this_thread::sleep(boost::posix_time::milliseconds(
+		static_cast<long>(seconds*1000)
+	));
+	double elapsed = t.elapsed();
+	long total = echoes.load();
+	
+	// Each client still has messages in flight, so the echoes wake it up to
+	// see the stop flag.
+	stop.store(true);
+	clients.join_all();
+	
+	s->stop_io_threads();
+	io_service.stop();
+	io_thread.join();
+	
+	std::stringstream name;
+	name << "echo, " << threads << " io threads, " << connections 
+	     << " connections";
+	bench::report(name.str(),total/elapsed,"messages/s");
+	
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Reports how many small masked text frames per second the read path can
+// parse, unmask and validate out of a receive buffer, as a session does after
+// each socket read.
+
+#include "bench.hpp"
+
+#include "../../src/websocket_frame.hpp"
+#include "../../src/receive_buffer.hpp"
+#include "../../src/utf8_validator/utf8_validator.hpp"
+
+#include <sstream>
+#include <string>
+
+using websocketpp::frame;
+using websocketpp::receive_buffer;
+
+namespace {
+
+std::string masked_frame(size_t size) {
+	const char key[4] = {'\x0f','\x1e','\x2d','\x3c'};
+	
+	std::string f;
+	f += static_cast<char>(0x81);
+	f += static_cast<char>(0x80 | size);
+	f.append(key,4);
+	for (size_t i = 0; i < size; i++) {
+		f += static_cast<char>(('a' + i % 26) ^ key[i % 4]);
+	}
+	return f;
+}
+
+void run(size_t size) {
+	// one socket read worth of back to back frames
+	const size_t read_size = 16384;
+	std::string frame_bytes = masked_frame(size);
+	std::string wire;
+	while (wire.size()+frame_bytes.size() <= read_size) {
+		wire += frame_bytes;
+	}
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(wire.data());
+	
+	size_t iterations = (size_t(1) << 28) / wire.size();
+	
+	receive_buffer buf;
+	frame f;
+	uint32_t state = utf8_validator::UTF8_ACCEPT;
+	uint32_t codep = 0;
+	size_t frames = 0;
+	size_t bytes = 0;
+	
+	bench::timer t;
+	for (size_t i = 0; i < iterations; i++) {
+		buf.append(p,wire.size());
+		
+		while (!buf.empty()) {
+			f.set_message_context(false,frame::TEXT_FRAME,&state,&codep);
+			f.consume(buf);
+			
+			if (f.get_state() == frame::STATE_READY) {
+				bytes += f.get_payload_size();
+				frames++;
+				f.reset();
+			}
+		}
+	}
+	double secs = t.elapsed();
+	bench::do_not_optimize(bytes);
+	
+	std::stringstream label;
+	label << size << "B frames";
+	bench::report(label.str(),frames/secs/1e6,"Mframes/s");
+}
+
+}
+
+int main() {
+	const size_t sizes[] = {20,64,125};
+	
+	for (size_t i = 0; i < 3; i++) {
+		run(sizes[i]);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Measures opening handshakes per second against a server on the loopback
+// interface with io threads, accepting through the server's single acceptor
+// and through an SO_REUSEPORT acceptor for each thread, with and without CPU
+// steering. Client threads connect, complete a handshake and disconnect as
+// fast as they can, as clients do in a reconnect storm.
+//
+// usage: handshake [io threads] [client threads] [seconds]
+//
+// The server only steers with one io thread for each CPU, the default.
+
+#include "bench.hpp"
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session_ptr;
+
+namespace {
+
+// Completes every handshake and does nothing else. It has no state, so it is
+// safe on any number of threads.
+class accept_all : public websocketpp::connection_handler {
+public:
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {}
+	void on_close(session_ptr session) {}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {}
+};
+
+const char REQUEST[] =
+	"GET / HTTP/1.1\r\n"
+	"Host: localhost\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"Origin: http://localhost\r\n"
+	"\r\n";
+
+// Handshakes until stop is set, counting the ones that succeed.
+void client(unsigned short port,const volatile bool* stop,
+            boost::detail::atomic_count* handshakes)
+{
+	boost::asio::io_service io_service;
+	tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(),port);
+	boost::asio::streambuf response;
+	
+	while (!*stop) {
+		tcp::socket socket(io_service);
+		boost::system::error_code ec;
+		
+		socket.connect(endpoint,ec);
+		if (ec) {
+			continue;
+		}
+		
+		boost::asio::write(socket,boost::asio::buffer(REQUEST,sizeof(REQUEST)-1),
+		                   ec);
+		boost::asio::read_until(socket,response,"\r\n\r\n",ec);
+		
+		if (!ec) {
+			++*handshakes;
+		}
+		response.consume(response.size());
+	}
+}
+
+void run_io_service(boost::asio::io_service* io_service) {
+	io_service->run();
+}
+
+// Each run listens on a port of its own, as the sessions the server 
+// abandons when it stops keep it, and its sockets, around.
+void run(const std::string& name,unsigned short port,size_t io_threads,
+         size_t clients,double seconds,bool reuseport,bool steer_by_cpu)
+{
+	boost::asio::io_service io_service;
+	websocketpp::connection_handler_ptr handler(new accept_all());
+	websocketpp::server_ptr s(new server(
+		io_service,tcp::endpoint(tcp::v4(),port),handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->set_io_threads(io_threads);
+	s->set_reuseport_acceptors(reuseport,steer_by_cpu);
+	s->start_accept();
+	
+	boost::thread acceptor(&run_io_service,&io_service);
+	
+	volatile bool stop = false;
+	boost::detail::atomic_count handshakes(0);
+	boost::thread_group client_threads;
+	
+	bench::timer t;
+	for (size_t i = 0; i < clients; i++) {
+		client_threads.create_thread(
+			boost::bind(&client,port,&stop,&handshakes)
+		);
+	}
+	
+	boost::this_thread::sleep(boost::posix_time::milliseconds(
+		static_cast<long>(seconds*1000)
+	));
+	stop = true;
+	client_threads.join_all();
+	double elapsed = t.elapsed();
+	
+	s->stop_io_threads();
+	io_service.stop();
+	acceptor.join();
+	
+	bench::report(name,handshakes/elapsed,"handshakes/s");
+}
+
+}
+
+int main(int argc,char* argv[]) {
+	size_t io_threads = boost::thread::hardware_concurrency();
+	size_t clients = 4;
+	double seconds = 2;
+	
+	if (argc > 1) {
+		io_threads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		clients = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		seconds = atof(argv[3]);
+	}
+	
+	run("single acceptor",19101,io_threads,clients,seconds,false,false);
+	run("SO_REUSEPORT",19102,io_threads,clients,seconds,true,false);
+	run("SO_REUSEPORT CPU steering",19103,io_threads,clients,seconds,true,true);
+	
+	return 0;
+}
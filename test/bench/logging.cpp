@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Parses small frames the way session::handle_read_frame does, with and
+// without its per frame debug log statements, to check that log statements
+// for a disabled level cost nothing measurable. The formatted variant shows
+// what the same statements cost when their messages were built before the
+// level was checked.
+
+#include "bench.hpp"
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_frame.hpp"
+#include "../../src/receive_buffer.hpp"
+#include "../../src/utf8_validator/utf8_validator.hpp"
+
+#include <sstream>
+#include <string>
+
+using websocketpp::frame;
+using websocketpp::receive_buffer;
+using websocketpp::LOG_DEBUG;
+using websocketpp::LOG_ERROR;
+
+namespace {
+
+enum variant {
+	NO_LOGGING,
+	DISABLED_MACRO,
+	DISABLED_FORMATTED
+};
+
+// Stands in for a session. The level checks are virtual, as they are there.
+class reader {
+public:
+	reader() : m_elog_level(LOG_ERROR), m_logged(0) {}
+	virtual ~reader() {}
+	
+	virtual bool test_elog_level(uint16_t level) const {
+		return level >= m_elog_level;
+	}
+	
+	virtual void log(const std::string& msg,uint16_t level) const {
+		if (!test_elog_level(level)) {
+			return;
+		}
+		m_logged += msg.size();
+	}
+	
+	size_t run(variant v,const std::string& wire,size_t iterations);
+private:
+	uint16_t		m_elog_level;
+	mutable size_t	m_logged;
+};
+
+size_t reader::run(variant v,const std::string& wire,size_t iterations) {
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(wire.data());
+	receive_buffer buf;
+	frame f;
+	uint32_t state = utf8_validator::UTF8_ACCEPT;
+	uint32_t codep = 0;
+	size_t frames = 0;
+	
+	for (size_t i = 0; i < iterations; i++) {
+		buf.append(p,wire.size());
+		
+		while (!buf.empty()) {
+			if (v == DISABLED_MACRO) {
+				WEBSOCKETPP_LOG(LOG_DEBUG,"consuming. have: " << buf.size() << " bytes. Need: " << f.get_bytes_needed() << " state: " << (int)f.get_state());
+			} else if (v == DISABLED_FORMATTED) {
+				std::stringstream err;
+				err << "consuming. have: " << buf.size() << " bytes. Need: " << f.get_bytes_needed() << " state: " << (int)f.get_state();
+				log(err.str(),LOG_DEBUG);
+			}
+			
+			f.set_message_context(false,frame::TEXT_FRAME,&state,&codep);
+			f.consume(buf);
+			
+			if (v == DISABLED_MACRO) {
+				WEBSOCKETPP_LOG(LOG_DEBUG,"consume complete, " << buf.size() << " bytes left, " << f.get_bytes_needed() << " still needed, state: " << (int)f.get_state());
+			} else if (v == DISABLED_FORMATTED) {
+				std::stringstream err;
+				err << "consume complete, " << buf.size() << " bytes left, " << f.get_bytes_needed() << " still needed, state: " << (int)f.get_state();
+				log(err.str(),LOG_DEBUG);
+			}
+			
+			if (f.get_state() == frame::STATE_READY) {
+				if (v == DISABLED_MACRO) {
+					WEBSOCKETPP_LOG(LOG_DEBUG,"processing frame " << buf.size());
+				} else if (v == DISABLED_FORMATTED) {
+					std::stringstream err;
+					err << "processing frame " << buf.size();
+					log(err.str(),LOG_DEBUG);
+				}
+				frames++;
+				f.reset();
+			}
+		}
+	}
+	return frames;
+}
+
+void run(const std::string& name,variant v,size_t size) {
+	const char key[4] = {'\x0f','\x1e','\x2d','\x3c'};
+	
+	std::string frame_bytes;
+	frame_bytes += static_cast<char>(0x81);
+	frame_bytes += static_cast<char>(0x80 | size);
+	frame_bytes.append(key,4);
+	for (size_t i = 0; i < size; i++) {
+		frame_bytes += static_cast<char>(('a' + i % 26) ^ key[i % 4]);
+	}
+	
+	std::string wire;
+	while (wire.size()+frame_bytes.size() <= 16384) {
+		wire += frame_bytes;
+	}
+	
+	size_t iterations = (size_t(1) << 27) / wire.size();
+	
+	reader r;
+	bench::timer t;
+	size_t frames = r.run(v,wire,iterations);
+	double secs = t.elapsed();
+	
+	std::stringstream label;
+	label << size << "B " << name;
+	bench::report(label.str(),frames/secs/1e6,"Mframes/s");
+}
+
+}
+
+int main() {
+	const size_t sizes[] = {20,125};
+	
+	for (size_t i = 0; i < 2; i++) {
+		run("no log statements",NO_LOGGING,sizes[i]);
+		run("WEBSOCKETPP_LOG (disabled)",DISABLED_MACRO,sizes[i]);
+		run("formatted, then discarded",DISABLED_FORMATTED,sizes[i]);
+	}
+	
+	return 0;
+}
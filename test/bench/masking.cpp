@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+// Reports masking throughput in GB/s for every kernel the running processor
+// supports, over a range of payload sizes and buffer alignments.
+
+#include "bench.hpp"
+
+#include "../../src/simd/masking.hpp"
+
+#include <sstream>
+#include <vector>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+void run(const std::string& name,mask_kernel kernel,size_t size,size_t offset) {
+	const char key[4] = {'\x12','\x34','\x56','\x78'};
+	std::vector<unsigned char> buf(size+64,0x5a);
+	
+	// aim for roughly 1GB of traffic per measurement
+	size_t iterations = (size_t(1) << 30) / size;
+	if (iterations < 1) {
+		iterations = 1;
+	}
+	
+	size_t ki = 0;
+	bench::timer t;
+	for (size_t i = 0; i < iterations; i++) {
+		ki = kernel(&buf[offset],&buf[offset],size,key,ki);
+	}
+	double secs = t.elapsed();
+	bench::do_not_optimize(buf[offset]);
+	
+	std::stringstream label;
+	label << name << " " << size << "B +" << offset;
+	bench::report(label.str(),double(size)*iterations/secs/1e9,"GB/s");
+}
+
+}
+
+int main() {
+	std::cout << "dispatching to: " << get_mask_kernel_name() << std::endl;
+	
+	const size_t sizes[] = {20,64,200,1024,16384,1048576};
+	const size_t offsets[] = {0,1,3};
+	
+	for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		for (size_t o = 0; o < sizeof(offsets)/sizeof(offsets[0]); o++) {
+			run("scalar",&mask_scalar,sizes[s],offsets[o]);
+			run("word",&mask_word,sizes[s],offsets[o]);
+#if defined(WEBSOCKETPP_SIMD_X86)
+			if (get_cpu_features().sse2) {
+				run("sse2",&mask_sse2,sizes[s],offsets[o]);
+			}
+			if (get_cpu_features().avx2) {
+				run("avx2",&mask_avx2,sizes[s],offsets[o]);
+			}
+#endif
+		}
+	}
+	
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Measures how fast other threads can publish to one session, by posting a
+// handler per message to the session's io_service and by calling send from
+// the publishing threads, which queues messages for the session's thread 
+// and wakes it once per batch. The messages are written to a client on the
+// loopback interface, and a run ends when it has read all of them.
+//
+// usage: publish [publisher threads] [messages per publisher]
+
+#include "bench.hpp"
+
+#include "../../src/websocketpp.hpp"
+#include "../../src/websocket_server.hpp"
+#include "../../src/websocket_connection_handler.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using websocketpp::server;
+using websocketpp::session_ptr;
+
+namespace {
+
+// Hands the first session that opens to the benchmark.
+class capture_session : public websocketpp::connection_handler {
+public:
+	void on_client_connect(session_ptr session) {
+		session->start_websocket();
+	}
+	void on_open(session_ptr session) {
+		// nothing is refused, the client reads as fast as it can
+		session->set_send_watermarks(size_t(1) << 30,size_t(1) << 30);
+		
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_session = session;
+		m_opened.notify_all();
+	}
+	void on_close(session_ptr session) {}
+	void on_message(session_ptr session,const std::vector<unsigned char>& data) {}
+	void on_message(session_ptr session,const std::string& msg) {}
+	
+	session_ptr wait() {
+		boost::unique_lock<boost::mutex> lock(m_lock);
+		while (!m_session) {
+			m_opened.wait(lock);
+		}
+		return m_session;
+	}
+private:
+	boost::mutex				m_lock;
+	boost::condition_variable	m_opened;
+	session_ptr					m_session;
+};
+
+const char REQUEST[] =
+	"GET / HTTP/1.1\r\n"
+	"Host: localhost\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"Origin: http://localhost\r\n"
+	"\r\n";
+
+// 32 bytes of text, sent with a 2 byte header
+const std::string MESSAGE(32,'x');
+const size_t FRAME_SIZE = 34;
+
+void send_text(session_ptr session,const std::string& msg) {
+	session->send(msg);
+}
+
+void publish_by_post(session_ptr session,size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		session->io_service().post(boost::bind(&send_text,session,MESSAGE));
+	}
+}
+
+void publish_by_send(session_ptr session,size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		session->send(MESSAGE);
+	}
+}
+
+void read_bytes(tcp::socket* socket,size_t bytes) {
+	std::vector<char> buf(65536);
+	
+	while (bytes > 0) {
+		boost::system::error_code ec;
+		size_t n = socket->read_some(boost::asio::buffer(buf),ec);
+		if (ec) {
+			return;
+		}
+		bytes -= std::min(n,bytes);
+	}
+}
+
+void run_io_service(boost::asio::io_service* io_service) {
+	io_service->run();
+}
+
+void run(const std::string& name,unsigned short port,
+         void (*publish)(session_ptr,size_t),size_t publishers,size_t count)
+{
+	boost::asio::io_service io_service;
+	boost::shared_ptr<capture_session> handler(new capture_session());
+	websocketpp::server_ptr s(new server(
+		io_service,tcp::endpoint(tcp::v4(),port),handler
+	));
+	
+	s->set_elog_level(websocketpp::LOG_OFF);
+	s->set_alog_level(websocketpp::ALOG_OFF);
+	s->start_accept();
+	
+	boost::thread io_thread(&run_io_service,&io_service);
+	
+	boost::asio::io_service client_io_service;
+	tcp::socket socket(client_io_service);
+	socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(),port));
+	boost::asio::write(socket,boost::asio::buffer(REQUEST,sizeof(REQUEST)-1));
+	
+	boost::asio::streambuf response;
+	size_t header = boost::asio::read_until(socket,response,"\r\n\r\n");
+	size_t early = response.size()-header;
+	
+	session_ptr session = handler->wait();
+	
+	bench::timer t;
+	boost::thread reader(&read_bytes,&socket,
+	                     publishers*count*FRAME_SIZE-early);
+	
+	boost::thread_group threads;
+	for (size_t i = 0; i < publishers; i++) {
+		threads.create_thread(boost::bind(publish,session,count));
+	}
+	threads.join_all();
+	reader.join();
+	double elapsed = t.elapsed();
+	
+	socket.close();
+	io_service.stop();
+	io_thread.join();
+	
+	bench::report(name,publishers*count/elapsed,"messages/s");
+}
+
+}
+
+int main(int argc,char* argv[]) {
+	size_t publishers = 4;
+	size_t count = 250000;
+	
+	if (argc > 1) {
+		publishers = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		count = atoi(argv[2]);
+	}
+	
+	run("post per message",19201,&publish_by_post,publishers,count);
+	run("send from publisher",19202,&publish_by_send,publishers,count);
+	
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2011, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+// Compares UTF-8 validation throughput of the byte at a time DFA against the
+// accelerated kernels on ASCII, Latin, CJK and emoji text, then compares
+// unmasking and validating a text payload in two passes against the fused
+// kernels.
+
+#include "bench.hpp"
+
+#include "../../src/simd/utf8.hpp"
+#include "../../src/simd/masking.hpp"
+#include "../../src/utf8_validator/utf8_validator.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace websocketpp::simd;
+
+namespace {
+
+// Builds roughly size bytes of text by repeating sample.
+std::string make_text(const std::string& sample,size_t size) {
+	std::string s;
+	while (s.size() < size) {
+		s += sample;
+	}
+	return s;
+}
+
+void run(const std::string& corpus,const std::string& name,utf8_kernel kernel,
+         const std::string& text) {
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+	size_t iterations = (size_t(1) << 30) / text.size();
+	
+	bool ok = true;
+	bench::timer t;
+	for (size_t i = 0; i < iterations; i++) {
+		uint32_t state = utf8_validator::UTF8_ACCEPT;
+		uint32_t codep = 0;
+		ok = kernel(p,text.size(),&state,&codep) && ok;
+	}
+	double secs = t.elapsed();
+	
+	if (!ok) {
+		std::cout << "validation failed for " << corpus << std::endl;
+	}
+	
+	bench::report(corpus+" "+name,double(text.size())*iterations/secs/1e9,"GB/s");
+}
+
+// Stands in for a fused kernel: the best masking kernel followed by the best
+// validation kernel, which is what a frame did before the two were fused.
+bool two_pass(const unsigned char* src,unsigned char* dst,size_t len,
+              const char* key,size_t* key_index,uint32_t* state,
+              uint32_t* codep) {
+	*key_index = mask(src,dst,len,key,*key_index);
+	return validate_utf8(dst,len,state,codep);
+}
+
+void run_fused(const std::string& corpus,const std::string& name,
+               unmask_utf8_kernel kernel,const std::string& text) {
+	const char key[4] = {'\x37','\xfa','\x21','\x3d'};
+	
+	std::vector<unsigned char> masked(text.size());
+	std::vector<unsigned char> out(text.size());
+	mask_scalar(reinterpret_cast<const unsigned char*>(text.data()),&masked[0],
+	            text.size(),key,0);
+	
+	size_t iterations = (size_t(1) << 30) / text.size();
+	
+	bool ok = true;
+	bench::timer t;
+	for (size_t i = 0; i < iterations; i++) {
+		uint32_t state = utf8_validator::UTF8_ACCEPT;
+		uint32_t codep = 0;
+		size_t key_index = 0;
+		ok = kernel(&masked[0],&out[0],text.size(),key,&key_index,&state,&codep) && ok;
+	}
+	double secs = t.elapsed();
+	
+	if (!ok) {
+		std::cout << "validation failed for " << corpus << std::endl;
+	}
+	
+	std::stringstream label;
+	label << corpus << " " << text.size()/1024 << "k " << name;
+	bench::report(label.str(),double(text.size())*iterations/secs/1e9,"GB/s");
+}
+
+}
+
+int main() {
+	std::cout << "dispatching to: " << get_utf8_kernel_name() << std::endl;
+	
+	const size_t size = 16384;
+	
+	const char* names[] = {"ascii-json","latin","cjk","emoji"};
+	const char* samples[] = {
+		"{\"id\":12345,\"price\":101.25,\"sym\":\"ABCD\",\"side\":\"bid\"},",
+		"Le c\xc5\x93ur d\xc3\xa9\xc3\xa7u mais l'\xc3\xa2me h\xc3\xa9las, ",
+		"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88",
+		"\xf0\x9f\x98\x80\xf0\x9f\x9a\x80 ok \xf0\x9f\x8e\x89",
+	};
+	std::string texts[4];
+	for (size_t i = 0; i < 4; i++) {
+		texts[i] = make_text(samples[i],size);
+	}
+	
+	for (size_t i = 0; i < 4; i++) {
+		run(names[i],"dfa",&validate_utf8_dfa,texts[i]);
+		run(names[i],"word",&validate_utf8_word,texts[i]);
+#if defined(WEBSOCKETPP_SIMD_X86)
+		if (get_cpu_features().sse2) {
+			run(names[i],"sse2",&validate_utf8_sse2,texts[i]);
+		}
+		if (get_cpu_features().avx2) {
+			run(names[i],"avx2",&validate_utf8_avx2,texts[i]);
+		}
+#endif
+	}
+	
+	std::cout << std::endl << "unmask and validate, fused kernel: " 
+	          << get_unmask_utf8_kernel_name() << std::endl;
+	
+	// 1MB does not fit in cache, which is where the second pass hurts.
+	const size_t sizes[] = {size,1 << 20};
+	
+	for (size_t i = 0; i < 4; i++) {
+		for (size_t j = 0; j < 2; j++) {
+			std::string text = make_text(samples[i],sizes[j]);
+			
+			run_fused(names[i],"two-pass",&two_pass,text);
+			run_fused(names[i],"fused",&unmask_validate_utf8,text);
+		}
+	}
+	
+	return 0;
+}